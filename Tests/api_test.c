@@ -0,0 +1,240 @@
+//
+// Tests of the interfaces the shell does not reach on its own: binding,
+// stepping and rebinding prepared statements, and the embeddable library
+// built on them. Run by Tests/tests.py with a scratch database file,
+// which it replaces; prints every check that fails and exits with 1 if
+// there was one.
+//
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "btree.h"
+#include "library.h"
+#include "statement.h"
+
+uint32_t checksFailed = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+void check(bool passed, const char *text, int line) {
+    if (!passed) {
+        printf("Check failed on line %d: %s\n", line, text);
+        checksFailed++;
+    }
+}
+
+PrepareResult prepareText(const char *text, Statement *statement, Arena *arena) {
+    InputBuffer input = {(char *) text, 0, (ssize_t) strlen(text)};
+    return prepareStatement(&input, statement, arena);
+}
+
+/* Read the rest of an executed select, returning how many rows it had */
+uint32_t readRows(Statement *statement, Row *last) {
+    uint32_t count = 0;
+    while (statementNextRow(statement, last)) {
+        count++;
+    }
+    return count;
+}
+
+void statementTests(const char *fileName) {
+    unlink(fileName);
+    Table *table = dbOpen(fileName, PAGER_DEFAULT_PAGE_SIZE, &DEFAULT_FLUSH_OPTIONS);
+    Arena arena;
+    arenaInit(&arena);
+
+    // Bind results: each parameter takes only values its column can hold
+    Statement insert;
+    CHECK(prepareText("insert ? ? ?", &insert, NULL) == PREPARE_SUCCESS && insert.numParams == 3);
+    CHECK(statementBindInt(&insert, 0, 1) == BIND_RANGE);
+    CHECK(statementBindInt(&insert, 4, 1) == BIND_RANGE);
+    CHECK(statementBindInt(&insert, 1, (int64_t) UINT32_MAX + 1) == BIND_RANGE);
+    CHECK(statementBindInt(&insert, 1, -1) == BIND_NEGATIVE_ID);
+    CHECK(statementBindInt(&insert, 2, 1) == BIND_TYPE_MISMATCH);
+    CHECK(statementBindText(&insert, 1, "1", 1) == BIND_TYPE_MISMATCH);
+    CHECK(statementBindText(&insert, 2, "u", COLUMN_USERNAME_SIZE + 1) == BIND_STRING_TOO_LONG);
+    CHECK(insert.boundMask == 0);
+
+    // Only some parameters bound
+    CHECK(statementBindInt(&insert, 1, 1) == BIND_SUCCESS);
+    CHECK(executeStatement(&insert, table) == EXECUTE_UNBOUND_PARAMETER);
+
+    // Bind and execute, then rebind only what changes; the rest is kept
+    CHECK(statementBindText(&insert, 2, "alice", 5) == BIND_SUCCESS);
+    CHECK(statementBindText(&insert, 3, "alice@a.com", 11) == BIND_SUCCESS);
+    CHECK(executeStatement(&insert, table) == EXECUTE_SUCCESS);
+    CHECK(statementBindInt(&insert, 1, 2) == BIND_SUCCESS);
+    CHECK(executeStatement(&insert, table) == EXECUTE_SUCCESS);
+    CHECK(statementBindInt(&insert, 1, 3) == BIND_SUCCESS);
+    CHECK(statementBindText(&insert, 2, "bob", 3) == BIND_SUCCESS);
+    CHECK(statementBindText(&insert, 3, "bob@b.com", 9) == BIND_SUCCESS);
+    CHECK(executeStatement(&insert, table) == EXECUTE_SUCCESS);
+    CHECK(executeStatement(&insert, table) == EXECUTE_DUPLICATE_KEY);
+    CHECK(statementBindInt(&insert, 1, UINT32_MAX) == BIND_SUCCESS);
+    CHECK(executeStatement(&insert, table) == EXECUTE_SUCCESS);
+    CHECK(tableRowCount(table) == 4);
+
+    statementClearBindings(&insert);
+    CHECK(executeStatement(&insert, table) == EXECUTE_UNBOUND_PARAMETER);
+
+    // A select with a bound where clause, read to the end and executed again
+    Statement select;
+    Row row;
+    CHECK(prepareText("select where username = ?", &select, &arena) == PREPARE_SUCCESS);
+    CHECK(statementBindInt(&select, 1, 1) == BIND_TYPE_MISMATCH);
+    CHECK(statementBindText(&select, 1, "alice", 5) == BIND_SUCCESS);
+    CHECK(executeStatement(&select, table) == EXECUTE_SUCCESS);
+    CHECK(readRows(&select, &row) == 2 && row.id == 2 && strcmp(row.email, "alice@a.com") == 0);
+    CHECK(executeStatement(&select, table) == EXECUTE_SUCCESS);
+    CHECK(readRows(&select, &row) == 2);
+
+    // Reset part way through keeps the bindings
+    CHECK(executeStatement(&select, table) == EXECUTE_SUCCESS);
+    CHECK(statementNextRow(&select, &row) && row.id == 1);
+    statementReset(&select);
+    CHECK(select.cursor == NULL && select.boundMask == 1);
+    CHECK(executeStatement(&select, table) == EXECUTE_SUCCESS);
+    CHECK(readRows(&select, &row) == 2);
+    CHECK(statementBindText(&select, 1, "bob", 3) == BIND_SUCCESS);
+    CHECK(executeStatement(&select, table) == EXECUTE_SUCCESS);
+    CHECK(readRows(&select, &row) == 2 && row.id == UINT32_MAX && strcmp(row.username, "bob") == 0);
+
+    // A count takes its suffix from a parameter too
+    Statement count;
+    CHECK(prepareText("select count(*) where email like %?", &count, &arena) == PREPARE_SUCCESS);
+    CHECK(executeStatement(&count, table) == EXECUTE_UNBOUND_PARAMETER);
+    CHECK(statementBindText(&count, 1, "@a.com", 6) == BIND_SUCCESS);
+    CHECK(executeStatement(&count, table) == EXECUTE_SUCCESS && count.count == 2);
+    CHECK(statementBindText(&count, 1, ".com", 4) == BIND_SUCCESS);
+    CHECK(executeStatement(&count, table) == EXECUTE_SUCCESS && count.count == 4);
+    statementReset(&count);
+
+    arenaFree(&arena);
+    dbClose(table);
+}
+
+SQLCloneResult prepareLibrary(SQLCloneDb *db, const char *text, SQLCloneStmt **statement) {
+    return sqlclonePrepare(db, text, strlen(text), statement);
+}
+
+/* Step a select to the end, returning how many rows it had */
+uint32_t stepRows(SQLCloneStmt *statement, uint32_t *lastId) {
+    uint32_t count = 0;
+    SQLCloneResult result;
+    while ((result = sqlcloneStep(statement)) == SQLCLONE_ROW) {
+        *lastId = sqlcloneStatementRow(statement)->id;
+        count++;
+    }
+    return result == SQLCLONE_DONE ? count : UINT32_MAX;
+}
+
+void libraryTests(const char *fileName) {
+    unlink(fileName);
+    SQLCloneDb *db;
+    CHECK(sqlcloneOpenWithPageSize(fileName, 1000, &db) == SQLCLONE_CANT_OPEN && db == NULL);
+    CHECK(sqlcloneOpen(fileName, &db) == SQLCLONE_OK);
+
+    SQLCloneStmt *statement;
+    CHECK(prepareLibrary(db, "update 1", &statement) == SQLCLONE_UNRECOGNIZED_STATEMENT && statement == NULL);
+    CHECK(prepareLibrary(db, "insert 1 a", &statement) == SQLCLONE_SYNTAX_ERROR && statement == NULL);
+
+    // Inserts with bound values; the text only has to last until the step
+    SQLCloneStmt *insert;
+    CHECK(prepareLibrary(db, "insert ? ? ?", &insert) == SQLCLONE_OK);
+    CHECK(sqlcloneStep(insert) == SQLCLONE_UNBOUND_PARAMETER);
+    CHECK(sqlcloneBindInt(insert, 1, -5) == SQLCLONE_NEGATIVE_ID);
+    CHECK(sqlcloneBindText(insert, 4, "x", 1) == SQLCLONE_RANGE);
+    CHECK(sqlcloneBindText(insert, 1, "x", 1) == SQLCLONE_TYPE_MISMATCH);
+    for (uint32_t id = 1; id <= 500; id++) {
+        char username[COLUMN_USERNAME_SIZE + 1];
+        char email[COLUMN_EMAIL_SIZE + 1];
+        int usernameLength = snprintf(username, sizeof(username), "user%u", id % 10);
+        int emailLength = snprintf(email, sizeof(email), "person%u@%s", id, id % 2 ? "odd.com" : "even.org");
+        CHECK(sqlcloneBindInt(insert, 1, (int64_t) (id * 7919 % 500 + 1)) == SQLCLONE_OK);
+        CHECK(sqlcloneBindText(insert, 2, username, (size_t) usernameLength) == SQLCLONE_OK);
+        CHECK(sqlcloneBindText(insert, 3, email, (size_t) emailLength) == SQLCLONE_OK);
+        CHECK(sqlcloneStep(insert) == SQLCLONE_DONE);
+    }
+    CHECK(sqlcloneStep(insert) == SQLCLONE_DUPLICATE_KEY);
+    sqlcloneClearBindings(insert);
+    CHECK(sqlcloneStep(insert) == SQLCLONE_UNBOUND_PARAMETER);
+    sqlcloneFinalize(insert);
+    CHECK(sqlcloneRowCount(db) == 500);
+
+    // A select stepped to the end starts over when stepped again
+    SQLCloneStmt *select;
+    uint32_t lastId = 0;
+    CHECK(prepareLibrary(db, "select", &select) == SQLCLONE_OK);
+    CHECK(stepRows(select, &lastId) == 500 && lastId == 500);
+    CHECK(stepRows(select, &lastId) == 500);
+
+    // Reset part way through, then read it all
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(sqlcloneStep(select) == SQLCLONE_ROW && sqlcloneStatementRow(select)->id == i + 1);
+    }
+    sqlcloneReset(select);
+    CHECK(sqlcloneStep(select) == SQLCLONE_ROW && sqlcloneStatementRow(select)->id == 1);
+    sqlcloneReset(select);
+    sqlcloneFinalize(select);
+
+    // Counts with a bound where clause, rebound between steps
+    SQLCloneStmt *count;
+    CHECK(prepareLibrary(db, "select count(*) where email like %?", &count) == SQLCLONE_OK);
+    CHECK(sqlcloneBindText(count, 1, "@odd.com", 8) == SQLCLONE_OK);
+    CHECK(sqlcloneStep(count) == SQLCLONE_DONE && sqlcloneStatementCount(count) == 250);
+    CHECK(sqlcloneBindText(count, 1, "0@even.org", 10) == SQLCLONE_OK);
+    CHECK(sqlcloneStep(count) == SQLCLONE_DONE && sqlcloneStatementCount(count) == 50);
+    sqlcloneFinalize(count);
+    CHECK(prepareLibrary(db, "select where username = ?", &select) == SQLCLONE_OK);
+    CHECK(sqlcloneBindText(select, 1, "user3", 5) == SQLCLONE_OK);
+    CHECK(stepRows(select, &lastId) == 50);
+    sqlcloneFinalize(select);
+
+    // Cursors start at the first id at or after the key
+    SQLCloneCursor *cursor;
+    SQLCloneRow row;
+    CHECK(sqlcloneCursorOpen(db, 250, &cursor) == SQLCLONE_OK);
+    uint32_t expected = 250;
+    while (sqlcloneCursorNext(cursor, &row)) {
+        CHECK(row.id == expected);
+        expected++;
+    }
+    CHECK(expected == 501);
+    sqlcloneCursorClose(cursor);
+    CHECK(sqlcloneCursorOpen(db, 501, &cursor) == SQLCLONE_OK);
+    CHECK(!sqlcloneCursorNext(cursor, &row));
+    sqlcloneCursorClose(cursor);
+    sqlcloneClose(db);
+
+    // Everything is there after reopening
+    CHECK(sqlcloneOpen(fileName, &db) == SQLCLONE_OK);
+    CHECK(sqlcloneRowCount(db) == 500);
+    CHECK(sqlcloneCursorOpen(db, 42, &cursor) == SQLCLONE_OK);
+    CHECK(sqlcloneCursorNext(cursor, &row) && row.id == 42);
+    sqlcloneCursorClose(cursor);
+    CHECK(prepareLibrary(db, "select", &select) == SQLCLONE_OK);
+    CHECK(stepRows(select, &lastId) == 500 && lastId == 500);
+    sqlcloneFinalize(select);
+    sqlcloneClose(db);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s <scratch database file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    statementTests(argv[1]);
+    libraryTests(argv[1]);
+    unlink(argv[1]);
+
+    if (checksFailed > 0) {
+        printf("%u checks failed.\n", checksFailed);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed.\n");
+    return EXIT_SUCCESS;
+}
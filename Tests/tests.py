@@ -1,3 +1,9 @@
+import json
+import os
+import random
+import socket
+import struct
+import time
 from subprocess import Popen, PIPE, run
 
 
@@ -15,6 +21,38 @@ def run_scripts(commands):
     return res.split('\n')
 
 
+def run_batch(commands, args=(), env=None):
+    p = run(["cmake-build-debug/SQLCloneExp", "--batch", *args, "test.db"], input=b''.join(commands),
+            stdout=PIPE, stderr=PIPE, env=None if env is None else {**os.environ, **env})
+    run(["chmod", "+rw", "test.db"])
+    return p.stdout.decode("utf-8").split('\n')
+
+
+def predicate_kernels():
+    # the kernel levels this processor can run, best last
+    flags = set()
+    if os.path.exists("/proc/cpuinfo"):
+        for line in open("/proc/cpuinfo"):
+            if line.startswith("flags"):
+                flags.update(line.split(":", 1)[1].split())
+    return ["scalar"] + [level for level in ("sse2", "avx2") if level in flags]
+
+
+def shuffled_inserts(seed, row=lambda i: "user{} person{}@example.com".format(i, i), count=3000):
+    ids = list(range(1, count + 1))
+    random.Random(seed).shuffle(ids)
+    return [bytes("insert {} {}\n".format(i, row(i)), 'utf8') for i in ids]
+
+
+def plain_run(commands, queries):
+    # the output of the queries on a table in the default format, which is left in plain.db
+    run(["rm", "-rf", "test.db", "plain.db"])
+    run_batch(commands)
+    out = run_batch(queries)
+    run(["mv", "test.db", "plain.db"])
+    return out
+
+
 def simple_tests():
     run(["rm", "-rf", "test.db"])
 
@@ -65,6 +103,7 @@ def constants_test():
         "LEAF_NODE_CELL_SIZE: 297",
         "LEAF_NODE_SPACE_FOR_CELLS: 4086",
         "LEAF_NODE_MAX_CELLS: 13",
+        "PREDICATE_KERNELS: " + predicate_kernels()[-1],
         "db > ",
     ]
 
@@ -102,6 +141,371 @@ def duplicate_test():
     assert expected_output == run_scripts(commands)
 
 
+def unbound_parameter_test():
+    run(["rm", "-rf", "test.db"])
+    commands = [b'insert ? user1 person1@example.com\n', b'select\n', b'.exit\n']
+    expected_out = ['db > Error: Statement has unbound parameters.', 'db > Executed.', 'db > ']
+
+    assert expected_out == run_scripts(commands)
+
+
+def id_range_test():
+    run(["rm", "-rf", "test.db"])
+    commands = [b'insert 4294967295 user1 person1@example.com\n', b'insert 4294967296 user2 person2@example.com\n',
+                b'insert 12ab user3 person3@example.com\n', b'select\n', b'.exit\n']
+    expected_out = ['db > Executed.', 'db > ID is too large.', 'db > Syntax error. Could not parse statement.',
+                    'db > (4294967295, user1, person1@example.com)', 'Executed.', 'db > ']
+
+    assert expected_out == run_scripts(commands)
+
+
+def batch_test():
+    run(["rm", "-rf", "test.db"])
+    # no prompts, and reaching the end of the input closes the database like .exit
+    commands = [b'insert 1 user1 person1@example.com\n', b'\n', b'select']
+    expected_out = ['Executed.', '(1, user1, person1@example.com)', 'Executed.', '']
+
+    assert expected_out == run_batch(commands)
+    assert ['(1, user1, person1@example.com)', 'Executed.', ''] == run_batch([b'select\n'])
+
+
+def output_mode_test():
+    run(["rm", "-rf", "test.db"])
+    commands = [b'insert 1 user,1 "person"1@example.com\n', b'select\n']
+
+    assert ['1,"user,1","""person""1@example.com"', ''] == run_batch(commands, ["--mode=csv"])
+    assert ['{"id":1,"username":"user,1","email":"\\"person\\"1@example.com"}', ''] == \
+        run_batch([b'select\n'], ["--mode=json"])
+    # uint16 frame length, uint32 id, uint8-prefixed strings, then an empty frame
+    expected_binary = b'\x21\x00' + b'\x01\x00\x00\x00' + b'\x06user,1' + b'\x15"person"1@example.com' + b'\x00\x00'
+    assert expected_binary == run(["cmake-build-debug/SQLCloneExp", "--batch", "--mode=binary", "test.db"],
+                                  input=b'select\n', stdout=PIPE, stderr=PIPE).stdout
+
+
+def multi_level_tree_test():
+    run(["rm", "-rf", "test.db"])
+    ids = [(i * 37) % 101 + 1 for i in range(101)]
+    commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in ids]
+    commands.append(b'select\n')
+
+    expected_out = ["({}, user{}, person{}@example.com)".format(i, i, i) for i in range(1, 102)]
+    assert expected_out == [line for line in run_batch(commands) if line.startswith('(')]
+
+
+def import_test():
+    run(["rm", "-rf", "test.db", "import.csv"])
+    with open("import.csv", "w") as f:
+        f.write("id,username,email\n")
+        for i in list(range(1, 51)) + [75, 60, 3]:
+            f.write('{},user{},"person ""{}""@example.com"\n'.format(i, i, i))
+
+    out = run_batch([b'.import import.csv\n', b'select\n'])
+    run(["rm", "-rf", "import.csv"])
+
+    assert out[0] == 'Skipped 1 malformed or duplicate rows, first on line 54.'
+    assert out[1].startswith('Imported 52 rows (51 appended in key order) in ')
+    rows = [line for line in out if line.startswith('(')]
+    assert len(rows) == 52 and rows[-1] == '(75, user75, person "75"@example.com)'
+
+
+def large_table_test():
+    run(["rm", "-rf", "test.db"])
+    # well past the old limit of 100 pages
+    ids = [(i * 7919) % 5000 + 1 for i in range(5000)]
+    commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in ids]
+    assert 'Error: Table full.' not in run_batch(commands)
+
+    rows = [line for line in run_batch([b'select\n']) if line.startswith('(')]
+    assert rows == ["({}, user{}, person{}@example.com)".format(i, i, i) for i in range(1, 5001)]
+    # read-ahead without io_uring
+    assert rows == [line for line in run_batch([b'select\n'], env={"SQLCLONE_IO": "sync"}) if line.startswith('(')]
+
+
+def page_size_test():
+    run(["rm", "-rf", "test.db"])
+    commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in range(200, 0, -1)]
+    run_batch(commands, args=["--page-size=16384"])
+    assert os.path.getsize("test.db") % 16384 == 0
+
+    # recorded in the file, so later opens need no flag
+    out = run_batch([b'.constants\n', b'select\n'])
+    assert "LEAF_NODE_SPACE_FOR_CELLS: 16374" in out and "LEAF_NODE_MAX_CELLS: 55" in out
+    assert [line for line in out if line.startswith('(')] == \
+           ["({}, user{}, person{}@example.com)".format(i, i, i) for i in range(1, 201)]
+
+    # files without a header are refused
+    with open("test.db", "wb") as f:
+        f.write(bytes(4096))
+    p = run(["cmake-build-debug/SQLCloneExp", "--batch", "test.db"], input=b'select\n', stdout=PIPE)
+    assert p.returncode != 0 and p.stdout.startswith(b'Not a SQLClone database')
+
+
+def count_test():
+    run(["rm", "-rf", "test.db"])
+    commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in range(1, 301)]
+    commands += [b'insert 7 user7 person7@example.com\n', b'select count(*)\n']
+    assert "(300)" in run_batch(commands)
+
+    # kept in the header, so it survives a reopen
+    assert ['{"count":300}', ''] == run_batch([b'select count(*)\n'], ["--mode=json"])
+    assert b'\x08\x00' + struct.pack('<Q', 300) + b'\x00\x00' == \
+        run(["cmake-build-debug/SQLCloneExp", "--batch", "--mode=binary", "test.db"],
+            input=b'select count(*)\n', stdout=PIPE, stderr=PIPE).stdout
+    assert "Syntax error. Could not parse statement." in run_batch([b'select count(*) extra\n'])
+
+
+def stats_test():
+    run(["rm", "-rf", "test.db"])
+    commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in range(1, 201)]
+    out = run_batch(commands + [b'select\n', b'.stats\n'])
+    stats = dict(line.split(': ') for line in out[out.index("Stats:") + 1:] if line)
+    assert stats["CURSORS_OPENED"] == "1" and stats["BYTES_DESERIALIZED"] == str(200 * 293)
+    assert int(stats["LEAF_SPLITS"]) > 0 and int(stats["TREE_DESCENTS"]) >= 200 and stats["PAGES_READ"] == "0"
+
+    # a new process starts from an empty cache
+    out = run_batch([b'select\n', b'.stats\n'])
+    stats = dict(line.split(': ') for line in out[out.index("Stats:") + 1:] if line)
+    assert int(stats["PAGES_READ"]) > 0 and int(stats["CACHE_MISSES"]) > 0
+
+
+def analyze_test():
+    run(["rm", "-rf", "test.db"])
+    ids = list(range(1, 2001))
+    random.Random(7).shuffle(ids)
+    commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in ids]
+    run_batch(commands)
+
+    # a fresh process, so every page read is the analysis' own
+    out = run_batch([b'.analyze\n', b'.stats\n'])
+    analysis = dict(line.split(': ', 1) for line in out[out.index("Analysis:") + 1:out.index("Stats:")])
+    stats = dict(line.split(': ') for line in out[out.index("Stats:") + 1:] if line)
+    depth = int(analysis["depth"])
+    assert depth >= 2 and analysis["level 0"].startswith("1 internal pages")
+    leaves = analysis["level {}".format(depth - 1)].split()
+    assert leaves[1:3] == ["leaf", "pages,"] and leaves[3] == "2000"
+    assert sum(int(n) for n in analysis["leaf fill"].split()[1::2]) == int(leaves[0])
+    assert analysis["pages"].endswith(" unused, 0 bad") and analysis["rows"].startswith("2000, bytes per row: ")
+    # random inserts leave the leaves out of order in the file
+    order = analysis["leaf order"].split()
+    assert int(order[2]) == int(leaves[0]) - 1 and int(order[0]) < int(order[2]) // 2
+    # streamed past the page cache, not through it
+    tree_pages = int(analysis["pages"].split()[3])
+    assert int(stats["PAGES_READ"]) >= tree_pages and int(stats["CACHE_MISSES"]) == 1
+
+
+def vacuum_test():
+    run(["rm", "-rf", "test.db"])
+    commands = shuffled_inserts(11)
+    expected = ["({}, user{}, person{}@example.com)".format(i, i, i) for i in range(1, 3001)]
+
+    def analyze():
+        out = run_batch([b'.analyze\n'])
+        return dict(line.split(': ', 1) for line in out[out.index("Analysis:") + 1:] if line and ': ' in line)
+
+    run_batch(commands)
+    before = analyze()
+    size = os.path.getsize("test.db")
+
+    # a few bounded steps, with inserts in between, then the rest of the pass
+    out = run_batch([b'vacuum 5\n', b'insert 3001 a b\n', b'vacuum 5\n', b'vacuum 5\n'])
+    assert out.count("Executed.") == 4
+    steps = [line.split() for line in out if line.startswith("Vacuumed ")]
+    assert len(steps) == 3 and all(step[1] == "5" and step[-1] == "continues." for step in steps)
+    out = run_batch([b'vacuum\n', b'select\n', b'select count(*)\n'])
+    assert [line for line in out if line.startswith("(")] == expected + ["(3001, a, b)", "(3001)"]
+    assert out[0].startswith("Vacuumed ") and out[0].endswith(" pass complete.")
+
+    after = analyze()
+    assert os.path.getsize("test.db") < size * 3 // 4
+    assert os.path.getsize("test.db") == int(after["pages"].split()[0]) * 4096
+    assert after["pages"].endswith(" 0 unused, 0 bad") and after["rows"].startswith("3001, ")
+    order = after["leaf order"].split()
+    assert order[0] == order[2] and order[-2] == "0"
+    fill = [float(a["level {}".format(int(a["depth"]) - 1)].split()[-2][:-1]) for a in (before, after)]
+    assert fill[1] > 95 > fill[0]
+
+    # vacuumed pages take new rows as usual
+    commands = [bytes("insert {} u e\n".format(i), 'utf8') for i in range(3002, 3202)]
+    out = run_batch(commands + [b'select count(*)\n', b'vacuum 0\n', b'vacuum 1 2\n'])
+    assert out[-5:] == ["(3201)", "Executed.", "Syntax error. Could not parse statement.",
+                        "Syntax error. Could not parse statement.", ""]
+
+
+def compress_test():
+    commands = shuffled_inserts(12)
+    expected = ["({}, user{}, person{}@example.com)".format(i, i, i) for i in range(1, 3001)]
+    compress = {"SQLCLONE_COMPRESS": "1"}
+
+    plain = plain_run(commands, [b'select\n', b'.stats\n'])
+    run_batch(commands, env=compress)
+    # the setting only matters at creation: the file says how it was made
+    out = run_batch([b'select\n', b'.stats\n'])
+    assert [line for line in out if line.startswith("(")] == expected
+    stats = [dict(line.split(': ') for line in o[o.index("Stats:") + 1:] if line) for o in (plain, out)]
+    assert stats[0]["PAGES_READ"] == stats[1]["PAGES_READ"]
+    assert int(stats[1]["BYTES_READ"]) * 4 < int(stats[0]["BYTES_READ"])
+    assert os.stat("test.db").st_blocks * 4 < os.stat("plain.db").st_blocks
+
+    # a vacuum rewrites most pages, and the space they leave behind is given back
+    out = run_batch([b'vacuum\n', b'insert 3001 a b\n', b'select\n'])
+    assert [line for line in out if line.startswith("(")] == expected + ["(3001, a, b)"]
+    out = run_batch([b'select\n'], env={"SQLCLONE_IO": "sync"})
+    assert [line for line in out if line.startswith("(")] == expected + ["(3001, a, b)"]
+    assert os.stat("test.db").st_blocks * 4 < os.stat("plain.db").st_blocks
+    run(["rm", "-rf", "plain.db"])
+
+
+def dictionary_test():
+    commands = shuffled_inserts(13, lambda i: "tenant{} user{}@domain{}.com".format(i % 7, i % 50, i % 3))
+    queries = [b'select\n', b'select where username = tenant3\n', b'select count(*) where email = user7@domain1.com\n',
+               b'select count(*) where username = nobody\n', b'select count(*)\n']
+    dictionary = {"SQLCLONE_LEAF_FORMAT": "dictionary"}
+
+    plain = plain_run(commands, queries)
+    run_batch(commands, env=dictionary)
+    # the format is chosen at creation and kept by the leaves after that
+    out = run_batch(queries + [b'.stats\n'])
+    assert out[:len(plain) - 1] == plain[:-1]
+    rows = [line for line in plain if line.startswith("(")]
+    assert len(rows) == 3000 + 429 + 3 and rows[-3:] == ["(20)", "(0)", "(3000)"]
+    assert os.stat("test.db").st_size * 4 < os.stat("plain.db").st_size
+    stats = dict(line.split(': ') for line in out[out.index("Stats:") + 1:] if line)
+    assert int(stats["LEAVES_SKIPPED"]) > 0
+
+    out = run_batch([b'vacuum\n'] + queries)
+    assert out[-len(plain):] == plain
+    run(["rm", "-rf", "plain.db"])
+
+
+def pax_test():
+    commands = shuffled_inserts(14, lambda i: "user{} person{}@example{}.com".format(i % 40, i, i % 5))
+    commands += [b'insert 3001 ' + b'u' * 32 + b' ' + b'e' * 255 + b'\n']
+    queries = [b'select\n', b'select where username = user17\n', b'select where username = ' + b'u' * 32 + b'\n',
+               b'select count(*) where email = person34@example4.com\n', b'select count(*)\n']
+
+    plain = plain_run(commands, queries)
+    run_batch(commands, env={"SQLCLONE_LEAF_FORMAT": "pax"})
+    out = run_batch(queries + [b'.analyze\n'])
+    assert out[:len(plain) - 1] == plain[:-1]
+    rows = [line for line in plain if line.startswith("(")]
+    assert len(rows) == 3001 + 75 + 1 + 2 and rows[-2:] == ["(1)", "(3001)"]
+
+    # columns are stored at their length, not at the width of the row
+    analysis = dict(line.split(': ', 1) for line in out[out.index("Analysis:") + 1:] if line)
+    assert analysis["pages"].endswith(" 0 bad") and float(analysis["rows"].split()[7]) < 100
+
+    out = run_batch([b'vacuum\n'] + queries)
+    assert out[-len(plain):] == plain
+    run(["rm", "-rf", "plain.db"])
+
+
+def filter_test():
+    domains = ["example.com", "corp.io", "mail.example.com", "a" * 200 + ".net"]
+    rows = {i: ("user{}".format(i % 30) if i % 9 else "u" * 32, "person{}@{}".format(i, domains[i % 4]))
+            for i in range(1, 2001)}
+    commands = shuffled_inserts(15, lambda i: "{} {}".format(*rows[i]), 2000)
+    queries = [b'select where email like %@corp.io\n', b'select count(*) where email like %example.com\n',
+               b'select count(*) where username like %7\n', b'select count(*) where username = ' + b'u' * 32 + b'\n',
+               b'select count(*) where email like %.org\n', b'select where email like @corp.io\n']
+    selected = ["({}, {}, {})".format(i, *rows[i]) for i in sorted(rows) if rows[i][1].endswith("@corp.io")]
+    counts = [sum(1 for r in rows.values() if test(r)) for test in (
+        lambda r: r[1].endswith("example.com"), lambda r: r[0].endswith("7"), lambda r: r[0] == "u" * 32)]
+    expected = selected + ["Executed."] + [line for c in counts + [0] for line in ("({})".format(c), "Executed.")] + \
+        ["Syntax error. Could not parse statement.", ""]
+
+    # every leaf format, with each set of kernels the processor runs
+    for leaf_format in ("rows", "dictionary", "pax"):
+        run(["rm", "-rf", "test.db"])
+        run_batch(commands, env={"SQLCLONE_LEAF_FORMAT": leaf_format})
+        for simd in predicate_kernels():
+            out = run_batch(queries + [b'.constants\n'], env={"SQLCLONE_SIMD": simd})
+            assert out[:len(expected) - 1] == expected[:-1] and "PREDICATE_KERNELS: " + simd in out
+
+
+def timer_test():
+    run(["rm", "-rf", "test.db"])
+    commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in range(1, 101)]
+    out = run_batch([b'.timer on\n'] + commands + [b'select count(*)\n', b'.timer off\n', b'select\n',
+                                                    b'.histograms\n'])
+    timings = [line for line in out if line.startswith("Run Time: real ")]
+    assert len(timings) == 101 and all(" pages read " in line and " written " in line for line in timings)
+
+    latency = dict(line.split(': ') for line in out[out.index("Latency:") + 1:] if line)
+    assert latency["point select"] == "count 0"
+    for kind, count in (("insert", 100), ("scan", 1), ("count", 1)):
+        fields = latency[kind].split()
+        assert fields[1] == str(count) and fields[-1] == "us"
+        assert float(fields[5]) <= float(fields[7]) <= float(fields[9]) <= float(fields[11]) <= float(fields[13])
+
+
+def api_test():
+    p = run(["cmake-build-debug/SQLCloneTest", "api.db"], stdout=PIPE)
+    assert p.stdout.decode("utf-8").splitlines()[-1:] == ["All checks passed."] and p.returncode == 0
+    assert not os.path.exists("api.db")
+
+
+def bench_test():
+    p = run(["cmake-build-debug/SQLCloneBench", "--rows=3000", "--operations=2000", "--distribution=zipfian",
+             "--format=json", "bench.db"], stdout=PIPE)
+    assert p.returncode == 0
+    results = [json.loads(line) for line in p.stdout.decode("utf-8").splitlines()]
+    assert [r["workload"] for r in results] == ["seqinsert", "randinsert", "lookup", "scan", "mixed", "bulkload"]
+    for r in results:
+        assert r["errors"] == 0 and r["opsPerSecond"] > 0 and r["p50Us"] <= r["p99Us"] <= r["p999Us"]
+        assert r["operations"] == (2000 if r["workload"] in ("lookup", "scan", "mixed") else 3000)
+    # the read workloads start from a cold page cache
+    assert all(r["pagesRead"] > 0 for r in results[2:5]) and results[0]["pagesWritten"] > 0
+    assert not os.path.exists("bench.db")
+
+
+def server_test():
+    run(["rm", "-rf", "test.db", "test.sock"])
+    server = Popen(["cmake-build-debug/SQLCloneExp", "--serve=unix:test.sock", "test.db"], stdout=PIPE)
+    assert server.stdout.readline() == b'Listening on unix:test.sock\n'
+
+    # pipelined requests, each answered with a u32 length, a status byte and any rows
+    requests = [b'insert 1 user1 person1@example.com', b'insert 1 user1 person1@example.com', b'select', b'update']
+    client = socket.socket(socket.AF_UNIX)
+    client.connect("test.sock")
+    client.sendall(b''.join(struct.pack('<I', len(r)) + r for r in requests))
+    client.shutdown(socket.SHUT_WR)
+    replies = b''
+    while chunk := client.recv(4096):
+        replies += chunk
+    client.close()
+
+    load = run(["cmake-build-debug/SQLCloneLoad", "--connections=3", "--requests=100", "--pipeline=8",
+                "--start-id=2", "unix:test.sock"], stdout=PIPE)
+    server.terminate()
+    assert server.wait() == 0
+
+    done, duplicate_key, unrecognized = b'\x02', b'\x0c', b'\x05'
+    row = b'\x1e\x00' + b'\x01\x00\x00\x00' + b'\x05user1' + b'\x13person1@example.com' + b'\x00\x00'
+    expected = [done, duplicate_key, done + row, unrecognized]
+    assert replies == b''.join(struct.pack('<I', len(r)) + r for r in expected)
+    assert load.stdout.decode("utf-8").split('\n')[0].startswith('100 requests over 3 connections (pipeline 8)')
+    assert load.returncode == 0
+    assert len([line for line in run_batch([b'select\n']) if line.startswith('(')]) == 101
+
+
+def flusher_test():
+    run(["rm", "-rf", "test.db"])
+    p = Popen(["cmake-build-debug/SQLCloneExp", "--flush-interval=20", "test.db"], stdin=PIPE, stdout=PIPE)
+    p.stdin.write(b'insert 1 user1 person1@example.com\n')
+    p.stdin.flush()
+    assert p.stdout.readline() == b'db > Executed.\n'
+
+    # written by the background flusher while the database is still open
+    deadline = time.time() + 5
+    while b'person1@example.com' not in open("test.db", "rb").read() and time.time() < deadline:
+        time.sleep(0.02)
+    assert b'person1@example.com' in open("test.db", "rb").read()
+
+    p.stdin.write(b'.exit\n')
+    p.stdin.close()
+    assert p.wait() == 0
+
+
 def print_test():
     run(["rm", "-rf", "test.db"])
     commands = [bytes("insert {} user{} person{}@example.com\n".format(i, i, i), 'utf8') for i in range(1, 15)]
@@ -112,29 +516,27 @@ def print_test():
     expected_out = [
         "db > Tree:",
         "- internal (size 1)",
-        "  - leaf (size 7)",
-        "    - 1",
-        "    - 2",
-        "    - 3",
-        "    - 4",
-        "    - 5",
-        "    - 6",
-        "    - 7",
-        "  - key 7",
-        "  - leaf (size 7)",
-        "    - 8",
-        "    - 9",
-        "    - 10",
-        "    - 11",
-        "    - 12",
-        "    - 13",
-        "    - 14",
-        "db > Need to implement searching an internal node"
+        " - leaf (size 7)",
+        "  - 1",
+        "  - 2",
+        "  - 3",
+        "  - 4",
+        "  - 5",
+        "  - 6",
+        "  - 7",
+        " - key 7",
+        " - leaf (size 7)",
+        "  - 8",
+        "  - 9",
+        "  - 10",
+        "  - 11",
+        "  - 12",
+        "  - 13",
+        "  - 14",
+        "db > Executed.",
+        "db > "
     ]
 
-    u = run_scripts(commands)
-    print(u[14:])
-
     assert expected_out == run_scripts(commands)[14:]
 
 
@@ -144,4 +546,25 @@ if __name__ == '__main__':
     field_test()
     constants_test()
     btree_test()
+    unbound_parameter_test()
+    id_range_test()
+    batch_test()
+    output_mode_test()
+    multi_level_tree_test()
+    import_test()
+    large_table_test()
+    page_size_test()
+    count_test()
+    stats_test()
+    analyze_test()
+    vacuum_test()
+    compress_test()
+    dictionary_test()
+    pax_test()
+    filter_test()
+    timer_test()
+    api_test()
+    bench_test()
+    server_test()
+    flusher_test()
     print_test()
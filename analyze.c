@@ -0,0 +1,117 @@
+#include "analyze.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One batch buffer per level of the tree, allocated as the walk gets there */
+typedef struct {
+    Table *table;
+    TreeStats *stats;
+    char *buffers[ANALYZE_MAX_DEPTH];
+    // The previous leaf in key order, if there has been one
+    bool afterLeaf;
+    uint32_t lastLeaf;
+} TreeWalk;
+
+char *analyzeBuffer(uint32_t pages, uint32_t pageSize) {
+    char *buffer = malloc((size_t) pages * pageSize);
+    if (buffer == NULL) {
+        printf("Out of memory for analysis\n");
+        exit(EXIT_FAILURE);
+    }
+    return buffer;
+}
+
+void analyzeLeaf(TreeWalk *walk, void *node, uint32_t pageNum) {
+    TreeStats *stats = walk->stats;
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t maxCells = leafNodeCapacity(walk->table, node);
+    stats->rows += numCells;
+
+    uint32_t bucket = numCells * ANALYZE_FILL_BUCKETS / maxCells;
+    stats->leafFill[bucket < ANALYZE_FILL_BUCKETS ? bucket : ANALYZE_FILL_BUCKETS - 1]++;
+
+    if (walk->afterLeaf) {
+        if (pageNum == walk->lastLeaf + 1) {
+            stats->sequentialSteps++;
+        } else if (pageNum < walk->lastLeaf) {
+            stats->backwardSteps++;
+        }
+        stats->leafSteps++;
+    }
+    walk->afterLeaf = true;
+    walk->lastLeaf = pageNum;
+}
+
+void analyzeNode(TreeWalk *walk, void *node, uint32_t pageNum, uint32_t depth) {
+    TreeStats *stats = walk->stats;
+    NodeType type = getNodeType(node);
+    uint32_t numCells = type == NODE_LEAF ? *leafNodeNumCells(node) : *internalNodeNumKeys(node);
+    uint32_t maxCells = type == NODE_LEAF ? leafNodeCellLimit(walk->table, node)
+                                          : walk->table->layout.internalNodeMaxCells;
+    bool knownFormat = type == NODE_INTERNAL || (leafNodeFormat(node) >= LEAF_FORMAT_ROWS &&
+                                                 leafNodeFormat(node) <= LEAF_FORMAT_PAX);
+    if (!knownFormat || numCells > maxCells) {
+        stats->badPages++;
+        return;
+    }
+
+    stats->treePages++;
+    if (depth + 1 > stats->depth) {
+        stats->depth = depth + 1;
+    }
+    LevelStats *level = &(stats->levels[depth]);
+    level->pages++;
+    level->cells += numCells;
+    level->capacity += type == NODE_LEAF ? leafNodeCapacity(walk->table, node) : maxCells;
+    if (type == NODE_LEAF) {
+        analyzeLeaf(walk, node, pageNum);
+        return;
+    }
+
+    if (depth + 1 == ANALYZE_MAX_DEPTH) {
+        stats->badPages += numCells + 1;
+        return;
+    }
+    if (walk->buffers[depth + 1] == NULL) {
+        walk->buffers[depth + 1] = analyzeBuffer(ANALYZE_BATCH_PAGES, stats->pageSize);
+    }
+    char *buffer = walk->buffers[depth + 1];
+    uint32_t children[ANALYZE_BATCH_PAGES];
+    // A batch ends after ANALYZE_BATCH_PAGES good children, so bad ones do not shift the next
+    for (uint32_t child = 0; child <= numCells;) {
+        uint32_t count = 0;
+        for (; child <= numCells && count < ANALYZE_BATCH_PAGES; child++) {
+            uint32_t childPageNum = child == numCells ? *internalNodeRightChild(node)
+                                                      : *internalNodeChild(node, child);
+            if (childPageNum == 0 || childPageNum >= stats->filePages) {
+                stats->badPages++;
+                continue;
+            }
+            children[count++] = childPageNum;
+        }
+        pagerCopyPages(walk->table->pager, children, count, buffer);
+        for (uint32_t i = 0; i < count; i++) {
+            analyzeNode(walk, buffer + (size_t) i * stats->pageSize, children[i], depth + 1);
+        }
+    }
+}
+
+void analyzeTree(Table *table, TreeStats *stats) {
+    memset(stats, 0, sizeof(TreeStats));
+    stats->filePages = atomic_load(&(table->pager->numPages));
+    stats->pageSize = table->pager->pageSize;
+
+    TreeWalk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.table = table;
+    walk.stats = stats;
+    walk.buffers[0] = analyzeBuffer(1, stats->pageSize);
+    pagerCopyPages(table->pager, &(table->rootPageNum), 1, walk.buffers[0]);
+    analyzeNode(&walk, walk.buffers[0], table->rootPageNum, 0);
+
+    for (uint32_t i = 0; i < ANALYZE_MAX_DEPTH; i++) {
+        free(walk.buffers[i]);
+    }
+}
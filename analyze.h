@@ -0,0 +1,51 @@
+#ifndef SQLCLONE_ANALYZE_H
+#define SQLCLONE_ANALYZE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+#define ANALYZE_MAX_DEPTH 32
+// Leaf fill factors are counted in buckets this many percent wide.
+#define ANALYZE_FILL_BUCKET_PERCENT 10
+#define ANALYZE_FILL_BUCKETS (100 / ANALYZE_FILL_BUCKET_PERCENT)
+// Children of a node are read in batches of this many pages.
+#define ANALYZE_BATCH_PAGES PAGE_IO_QUEUE_DEPTH
+
+typedef struct {
+    uint32_t pages;
+    // Cells for leaves, keys for internal nodes
+    uint64_t cells;
+    uint64_t capacity;
+} LevelStats;
+
+typedef struct {
+    uint32_t depth;
+    // From the root down; the last level holds the leaves.
+    LevelStats levels[ANALYZE_MAX_DEPTH];
+    uint64_t leafFill[ANALYZE_FILL_BUCKETS];
+    /*
+     * Fragmentation: of the steps from one leaf to the next in key
+     * order, how many go to the next page in the file, and how many go
+     * back towards the start of the file.
+     */
+    uint64_t leafSteps;
+    uint64_t sequentialSteps;
+    uint64_t backwardSteps;
+    uint64_t rows;
+    uint32_t filePages;
+    uint32_t treePages;
+    uint32_t pageSize;
+    // Pages that could not be part of a well formed tree
+    uint32_t badPages;
+} TreeStats;
+
+/*
+ * Walk the whole tree in key order, a batch of sibling pages at a time,
+ * without leaving it in the page cache. Keys are never looked at, so
+ * the cost is one read per page.
+ */
+void analyzeTree(Table *table, TreeStats *stats);
+
+#endif //SQLCLONE_ANALYZE_H
@@ -0,0 +1,64 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGNMENT alignof(max_align_t)
+#define ARENA_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+void arenaInit(Arena *arena) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->used = 0;
+}
+
+/* A block with room for at least size bytes */
+ArenaBlock *arenaNewBlock(size_t size) {
+    size = (ARENA_HEADER_SIZE + size > ARENA_BLOCK_SIZE) ? ARENA_HEADER_SIZE + size : ARENA_BLOCK_SIZE;
+    ArenaBlock *block = malloc(size);
+    if (block == NULL) {
+        printf("Out of memory for a statement\n");
+        exit(EXIT_FAILURE);
+    }
+    block->next = NULL;
+    block->size = size;
+    return block;
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if (arena->current == NULL) {
+        arena->first = arenaNewBlock(size);
+        arena->current = arena->first;
+        arena->used = ARENA_HEADER_SIZE;
+    }
+
+    // Move on through the blocks kept from earlier statements, adding one if none is big enough.
+    while (arena->used + size > arena->current->size) {
+        if (arena->current->next == NULL) {
+            arena->current->next = arenaNewBlock(size);
+        }
+        arena->current = arena->current->next;
+        arena->used = ARENA_HEADER_SIZE;
+    }
+
+    void *memory = (char *) arena->current + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+void arenaReset(Arena *arena) {
+    arena->current = arena->first;
+    arena->used = ARENA_HEADER_SIZE;
+}
+
+void arenaFree(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arenaInit(arena);
+}
@@ -0,0 +1,36 @@
+#ifndef SQLCLONE_ARENA_H
+#define SQLCLONE_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for the temporaries of a statement, such as its cursor.
+ * Nothing is freed on its own: resetting the arena releases everything
+ * at once, in constant time, and keeps the memory for the next
+ * statement. Blocks are only allocated the first time they are needed,
+ * so an arena that is never used costs nothing.
+ */
+#define ARENA_BLOCK_SIZE (128 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;
+    // Bytes of the current block in use, counting its header
+    size_t used;
+} Arena;
+
+void arenaInit(Arena *arena);
+
+/* Never fails; the memory is aligned for any type. */
+void *arenaAlloc(Arena *arena, size_t size);
+
+void arenaReset(Arena *arena);
+
+void arenaFree(Arena *arena);
+
+#endif //SQLCLONE_ARENA_H
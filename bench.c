@@ -0,0 +1,456 @@
+//
+// Benchmarks for the storage engine, which is linked in directly. Every
+// workload runs against a fresh database file and reports throughput,
+// latency percentiles and the pages it read and wrote, as text or as
+// one JSON object per line for tracking across releases.
+//
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btree.h"
+#include "stats.h"
+
+typedef enum {
+    BENCH_SEQUENTIAL_INSERT,
+    BENCH_RANDOM_INSERT,
+    BENCH_POINT_LOOKUP,
+    BENCH_RANGE_SCAN,
+    BENCH_MIXED,
+    BENCH_BULK_LOAD
+} BenchWorkload;
+
+const struct {
+    const char *name;
+    BenchWorkload workload;
+} BENCH_WORKLOADS[] = {
+        {"seqinsert",  BENCH_SEQUENTIAL_INSERT},
+        {"randinsert", BENCH_RANDOM_INSERT},
+        {"lookup",     BENCH_POINT_LOOKUP},
+        {"scan",       BENCH_RANGE_SCAN},
+        {"mixed",      BENCH_MIXED},
+        {"bulkload",   BENCH_BULK_LOAD},
+};
+
+#define BENCH_NUM_WORKLOADS (sizeof(BENCH_WORKLOADS) / sizeof(BENCH_WORKLOADS[0]))
+
+typedef enum {
+    KEYS_UNIFORM,
+    KEYS_ZIPFIAN
+} KeyDistribution;
+
+/* Skew of the Zipfian distribution, as in YCSB */
+#define BENCH_ZIPFIAN_THETA 0.99
+
+typedef struct {
+    const char *fileName;
+    uint64_t rows;
+    uint64_t operations;
+    uint32_t pageSize;
+    KeyDistribution distribution;
+    uint64_t readPercent;
+    uint64_t scanLength;
+    uint64_t seed;
+    bool json;
+} BenchOptions;
+
+typedef struct {
+    uint64_t state;
+} BenchRandom;
+
+/* xorshift64*: fast, and good enough to pick keys with */
+uint64_t benchRandomNext(BenchRandom *random) {
+    random->state ^= random->state >> 12;
+    random->state ^= random->state << 25;
+    random->state ^= random->state >> 27;
+    return random->state * 0x2545F4914F6CDD1DULL;
+}
+
+double benchRandomDouble(BenchRandom *random) {
+    return (benchRandomNext(random) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * Zipfian ranks over [0, items) by the method of Gray et al., "Quickly
+ * Generating Billion-Record Synthetic Databases", which YCSB uses too.
+ * Ranks are hashed onto keys so the popular keys are spread over the
+ * table instead of sharing a leaf.
+ */
+typedef struct {
+    uint64_t items;
+    double alpha;
+    double zetan;
+    double eta;
+} Zipfian;
+
+double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+        sum += 1 / pow((double) i, theta);
+    }
+    return sum;
+}
+
+void zipfianInit(Zipfian *zipfian, uint64_t items) {
+    double zeta2 = zeta(2, BENCH_ZIPFIAN_THETA);
+    zipfian->items = items;
+    zipfian->alpha = 1 / (1 - BENCH_ZIPFIAN_THETA);
+    zipfian->zetan = zeta(items, BENCH_ZIPFIAN_THETA);
+    zipfian->eta = (1 - pow(2.0 / items, 1 - BENCH_ZIPFIAN_THETA)) / (1 - zeta2 / zipfian->zetan);
+}
+
+uint64_t zipfianNext(Zipfian *zipfian, BenchRandom *random) {
+    double u = benchRandomDouble(random);
+    double uz = u * zipfian->zetan;
+    uint64_t rank;
+    if (uz < 1) {
+        rank = 0;
+    } else if (uz < 1 + pow(0.5, BENCH_ZIPFIAN_THETA)) {
+        rank = 1;
+    } else {
+        rank = (uint64_t) (zipfian->items * pow(zipfian->eta * u - zipfian->eta + 1, zipfian->alpha));
+    }
+
+    // FNV-1a over the bytes of the rank
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (uint32_t i = 0; i < 8; i++) {
+        hash = (hash ^ ((rank >> (8 * i)) & 0xFF)) * 0x100000001B3ULL;
+    }
+    return hash % zipfian->items;
+}
+
+typedef struct {
+    BenchOptions *options;
+    Table *table;
+    BenchRandom random;
+    Zipfian zipfian;
+    // Rows in the table, with keys 1 to numKeys
+    uint64_t numKeys;
+    uint64_t *latencies;
+    uint64_t completed;
+    uint64_t errors;
+} BenchRun;
+
+uint64_t nowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+int compareLatencies(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *) a, right = *(const uint64_t *) b;
+    return (left > right) - (left < right);
+}
+
+double percentileMicroseconds(uint64_t *sorted, uint64_t count, double percentile) {
+    uint64_t index = (uint64_t) (percentile / 100 * (count - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+/* A key already in the table, drawn from the chosen distribution */
+uint32_t benchExistingKey(BenchRun *run) {
+    if (run->options->distribution == KEYS_ZIPFIAN) {
+        return (uint32_t) zipfianNext(&(run->zipfian), &(run->random)) + 1;
+    }
+    return (uint32_t) (benchRandomNext(&(run->random)) % run->numKeys) + 1;
+}
+
+typedef struct {
+    char username[COLUMN_USERNAME_SIZE + 1];
+    char email[COLUMN_EMAIL_SIZE + 1];
+    RowView view;
+} BenchRow;
+
+void benchMakeRow(BenchRow *row, uint32_t key) {
+    row->view.id = key;
+    row->view.username = row->username;
+    row->view.usernameLength = snprintf(row->username, sizeof(row->username), "user%u", key);
+    row->view.email = row->email;
+    row->view.emailLength = snprintf(row->email, sizeof(row->email), "person%u@example.com", key);
+}
+
+void benchRecord(BenchRun *run, uint64_t startTime) {
+    run->latencies[run->completed++] = nowNanoseconds() - startTime;
+}
+
+void benchInsert(BenchRun *run, uint32_t key) {
+    BenchRow row;
+    benchMakeRow(&row, key);
+    uint64_t startTime = nowNanoseconds();
+    tableBeginWrite(run->table);
+    TableInsertResult result = tableInsert(run->table, &(row.view));
+    tableEndWrite(run->table);
+    benchRecord(run, startTime);
+    run->errors += (result != TABLE_INSERT_SUCCESS);
+}
+
+void benchLookup(BenchRun *run, uint32_t key) {
+    uint64_t startTime = nowNanoseconds();
+    Cursor *cursor = tableFind(run->table, key);
+    Row row;
+    bool found = false;
+    if (!cursor->endOfTable) {
+        cursorRow(cursor, &row);
+        found = (row.id == key);
+    }
+    cursorClose(cursor);
+    benchRecord(run, startTime);
+    run->errors += !found;
+}
+
+void benchScan(BenchRun *run, uint32_t key) {
+    uint64_t startTime = nowNanoseconds();
+    Cursor *cursor = tableFind(run->table, key);
+    Row row;
+    uint32_t previous = 0;
+    for (uint64_t i = 0; i < run->options->scanLength && !cursor->endOfTable; i++) {
+        cursorRow(cursor, &row);
+        run->errors += (row.id <= previous);
+        previous = row.id;
+        cursorAdvance(cursor);
+    }
+    cursorClose(cursor);
+    benchRecord(run, startTime);
+}
+
+/*
+ * Rows arriving in key order go straight onto the end of the rightmost
+ * leaf, as in an import.
+ */
+void benchBulkLoad(BenchRun *run, uint64_t rows, bool timed) {
+    Table *table = run->table;
+    tableBeginWrite(table);
+    uint32_t appendPageNum = tableRightmostLeaf(table);
+    for (uint64_t i = 0; i < rows; i++) {
+        BenchRow row;
+        benchMakeRow(&row, (uint32_t) ++run->numKeys);
+        uint64_t startTime = nowNanoseconds();
+        uint32_t numPagesBefore = table->pager->numPages;
+        TableInsertResult result = tableAppend(table, appendPageNum, &(row.view));
+        if (table->pager->numPages != numPagesBefore) {
+            appendPageNum = tableRightmostLeaf(table);
+        }
+        if (timed) {
+            benchRecord(run, startTime);
+        }
+        if (result != TABLE_INSERT_SUCCESS) {
+            run->errors++;
+            run->numKeys--;
+        }
+    }
+    tableEndWrite(table);
+}
+
+Table *benchOpen(BenchOptions *options) {
+    Table *table = dbOpen(options->fileName, options->pageSize, NULL);
+    if (table == NULL) {
+        printf("Unable to open %s\n", options->fileName);
+        exit(EXIT_FAILURE);
+    }
+    return table;
+}
+
+void benchReport(BenchRun *run, const char *name, double seconds, uint64_t pagesRead, uint64_t pagesWritten) {
+    BenchOptions *options = run->options;
+    qsort(run->latencies, run->completed, sizeof(uint64_t), compareLatencies);
+    double p50 = percentileMicroseconds(run->latencies, run->completed, 50);
+    double p99 = percentileMicroseconds(run->latencies, run->completed, 99);
+    double p999 = percentileMicroseconds(run->latencies, run->completed, 99.9);
+    double maximum = run->latencies[run->completed - 1] / 1000.0;
+    const char *distribution = options->distribution == KEYS_ZIPFIAN ? "zipfian" : "uniform";
+
+    if (options->json) {
+        printf("{\"workload\":\"%s\",\"rows\":%llu,\"operations\":%llu,\"pageSize\":%u,"
+               "\"distribution\":\"%s\",\"seconds\":%.6f,\"opsPerSecond\":%.0f,"
+               "\"p50Us\":%.2f,\"p99Us\":%.2f,\"p999Us\":%.2f,\"maxUs\":%.2f,"
+               "\"pagesRead\":%llu,\"pagesWritten\":%llu,\"errors\":%llu}\n",
+               name, (unsigned long long) options->rows, (unsigned long long) run->completed, options->pageSize,
+               distribution, seconds, run->completed / seconds, p50, p99, p999, maximum,
+               (unsigned long long) pagesRead, (unsigned long long) pagesWritten,
+               (unsigned long long) run->errors);
+    } else {
+        printf("%s: %llu operations in %.3f s: %.0f ops/s\n", name, (unsigned long long) run->completed,
+               seconds, run->completed / seconds);
+        printf("  Latency (us): p50 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n", p50, p99, p999, maximum);
+        printf("  Pages: %llu read, %llu written; %llu errors\n", (unsigned long long) pagesRead,
+               (unsigned long long) pagesWritten, (unsigned long long) run->errors);
+    }
+    fflush(stdout);
+}
+
+/*
+ * Reads and mixed workloads first load the table and reopen it, so they
+ * start with an empty page cache as a new process would. Pages written
+ * include everything the workload left dirty, flushed once the clock
+ * has stopped.
+ */
+void benchRunWorkload(BenchOptions *options, uint32_t index) {
+    BenchWorkload workload = BENCH_WORKLOADS[index].workload;
+    unlink(options->fileName);
+
+    BenchRun run = {.options = options};
+    run.random.state = options->seed * 0x9E3779B97F4A7C15ULL + index + 1;
+    run.table = benchOpen(options);
+
+    bool reads = (workload == BENCH_POINT_LOOKUP || workload == BENCH_RANGE_SCAN || workload == BENCH_MIXED);
+    uint64_t operations = reads ? options->operations : options->rows;
+    run.latencies = malloc(operations * sizeof(uint64_t));
+    uint32_t *keys = NULL;
+    if (reads) {
+        benchBulkLoad(&run, options->rows, false);
+        dbClose(run.table);
+        run.table = benchOpen(options);
+        if (options->distribution == KEYS_ZIPFIAN) {
+            zipfianInit(&(run.zipfian), run.numKeys);
+        }
+    } else if (workload == BENCH_RANDOM_INSERT) {
+        keys = malloc(operations * sizeof(uint32_t));
+        for (uint64_t i = 0; i < operations; i++) {
+            keys[i] = (uint32_t) i + 1;
+        }
+        for (uint64_t i = operations - 1; i > 0; i--) {
+            uint64_t j = benchRandomNext(&(run.random)) % (i + 1);
+            uint32_t key = keys[i];
+            keys[i] = keys[j];
+            keys[j] = key;
+        }
+    }
+
+    uint64_t before[STAT_COUNT];
+    statsCollect(before);
+    uint64_t startTime = nowNanoseconds();
+    switch (workload) {
+        case BENCH_SEQUENTIAL_INSERT:
+            for (uint64_t i = 0; i < operations; i++) {
+                benchInsert(&run, (uint32_t) i + 1);
+            }
+            break;
+        case BENCH_RANDOM_INSERT:
+            for (uint64_t i = 0; i < operations; i++) {
+                benchInsert(&run, keys[i]);
+            }
+            break;
+        case BENCH_POINT_LOOKUP:
+            for (uint64_t i = 0; i < operations; i++) {
+                benchLookup(&run, benchExistingKey(&run));
+            }
+            break;
+        case BENCH_RANGE_SCAN:
+            for (uint64_t i = 0; i < operations; i++) {
+                benchScan(&run, benchExistingKey(&run));
+            }
+            break;
+        case BENCH_MIXED:
+            // Reads of existing keys; writes add new keys at the end.
+            for (uint64_t i = 0; i < operations; i++) {
+                if (benchRandomNext(&(run.random)) % 100 < options->readPercent) {
+                    benchLookup(&run, benchExistingKey(&run));
+                } else {
+                    benchInsert(&run, (uint32_t) (options->rows + i + 1));
+                }
+            }
+            break;
+        case BENCH_BULK_LOAD:
+            benchBulkLoad(&run, operations, true);
+            break;
+    }
+    double seconds = (nowNanoseconds() - startTime) / 1e9;
+
+    pagerFlushDirty(run.table->pager, false);
+    uint64_t after[STAT_COUNT];
+    statsCollect(after);
+    benchReport(&run, BENCH_WORKLOADS[index].name, seconds, after[STAT_PAGES_READ] - before[STAT_PAGES_READ],
+                after[STAT_PAGES_WRITTEN] - before[STAT_PAGES_WRITTEN]);
+
+    dbClose(run.table);
+    unlink(options->fileName);
+    free(run.latencies);
+    free(keys);
+}
+
+void printUsage() {
+    printf("Usage: SQLCloneBench [--workload=NAME|all] [--rows=N] [--operations=N] [--page-size=N]\n"
+           "                     [--distribution=uniform|zipfian] [--read-percent=N] [--scan-length=N]\n"
+           "                     [--seed=N] [--format=text|json] [file]\n"
+           "Workloads: seqinsert, randinsert, lookup, scan, mixed, bulkload\n");
+}
+
+bool parseCount(const char *argument, const char *prefix, uint64_t minimum, uint64_t maximum, uint64_t *value) {
+    size_t prefixLength = strlen(prefix);
+    if (strncmp(argument, prefix, prefixLength) != 0) {
+        return false;
+    }
+    char *end;
+    unsigned long long parsed = strtoull(argument + prefixLength, &end, 10);
+    if (argument[prefixLength] == 0 || *end != 0 || parsed < minimum || parsed > maximum) {
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+    *value = parsed;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options = {"bench.db", 100000, 100000, PAGER_DEFAULT_PAGE_SIZE, KEYS_UNIFORM, 95, 100, 1, false};
+    uint64_t pageSize = PAGER_DEFAULT_PAGE_SIZE;
+    bool selected[BENCH_NUM_WORKLOADS] = {false};
+    bool anySelected = false;
+    bool fileNamed = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *argument = argv[i];
+        if (parseCount(argument, "--rows=", 1, UINT32_MAX / 2, &(options.rows)) ||
+            parseCount(argument, "--operations=", 1, UINT32_MAX / 2, &(options.operations)) ||
+            parseCount(argument, "--page-size=", PAGER_MIN_PAGE_SIZE, PAGER_MAX_PAGE_SIZE, &pageSize) ||
+            parseCount(argument, "--read-percent=", 0, 100, &(options.readPercent)) ||
+            parseCount(argument, "--scan-length=", 1, UINT32_MAX, &(options.scanLength)) ||
+            parseCount(argument, "--seed=", 0, UINT64_MAX, &(options.seed))) {
+            continue;
+        } else if (strcmp(argument, "--distribution=uniform") == 0) {
+            options.distribution = KEYS_UNIFORM;
+        } else if (strcmp(argument, "--distribution=zipfian") == 0) {
+            options.distribution = KEYS_ZIPFIAN;
+        } else if (strcmp(argument, "--format=text") == 0) {
+            options.json = false;
+        } else if (strcmp(argument, "--format=json") == 0) {
+            options.json = true;
+        } else if (strncmp(argument, "--workload=", 11) == 0) {
+            const char *name = argument + 11;
+            bool known = false;
+            for (uint32_t j = 0; j < BENCH_NUM_WORKLOADS; j++) {
+                if (strcmp(name, "all") == 0 || strcmp(name, BENCH_WORKLOADS[j].name) == 0) {
+                    selected[j] = true;
+                    known = true;
+                }
+            }
+            if (!known) {
+                printUsage();
+                exit(EXIT_FAILURE);
+            }
+            anySelected = true;
+        } else if (argument[0] != '-' && !fileNamed) {
+            options.fileName = argument;
+            fileNamed = true;
+        } else {
+            printUsage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (!pagerValidPageSize((uint32_t) pageSize)) {
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+    options.pageSize = (uint32_t) pageSize;
+
+    for (uint32_t i = 0; i < BENCH_NUM_WORKLOADS; i++) {
+        if (!anySelected || selected[i]) {
+            benchRunWorkload(&options, i);
+        }
+    }
+    return EXIT_SUCCESS;
+}
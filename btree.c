@@ -0,0 +1,1192 @@
+#include "btree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dictionary.h"
+#include "pax.h"
+#include "predicate.h"
+#include "stats.h"
+
+#define size_of_attribute(Struct, Attribute) sizeof(((Struct*)0)->Attribute)
+
+const uint32_t ID_SIZE = size_of_attribute(Row, id);
+const uint32_t USERNAME_SIZE = size_of_attribute(Row, username);
+const uint32_t EMAIL_SIZE = size_of_attribute(Row, email);
+const uint32_t ID_OFFSET = 0;
+const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
+const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
+const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
+
+/*
+ * Common node header layout
+ */
+const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t);
+const uint32_t NODE_TYPE_OFFSET = 0;
+const uint32_t IS_ROOT_SIZE = sizeof(uint8_t);
+const uint32_t IS_ROOT_OFFSET = NODE_TYPE_SIZE;
+const uint32_t PARENT_POINTER_SIZE = sizeof(uint32_t);
+const uint32_t PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
+const uint32_t COMMON_NODE_HEADER_SIZE =
+        NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
+
+/*
+ * Leaf node header layout
+ */
+const uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
+const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE;
+
+/*
+ * Leaf node body layout
+ */
+const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_KEY_OFFSET = 0;
+const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
+const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
+const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
+
+
+/*
+ * Internal Node Header Layout
+ */
+const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
+const uint32_t INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
+const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t);
+const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
+const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
+                                           INTERNAL_NODE_NUM_KEYS_SIZE +
+                                           INTERNAL_NODE_RIGHT_CHILD_SIZE;
+
+/*
+ * Internal Node Header Layout
+ */
+const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
+const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
+const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE;
+
+/*
+ * Everything that depends on the page size
+ */
+void nodeLayoutInit(NodeLayout *layout, uint32_t pageSize) {
+    layout->pageSize = pageSize;
+    layout->leafNodeSpaceForCells = pageSize - LEAF_NODE_HEADER_SIZE;
+    layout->leafNodeMaxCells = layout->leafNodeSpaceForCells / LEAF_NODE_CELL_SIZE;
+    layout->leafNodeRightSplitCount = (layout->leafNodeMaxCells + 1) / 2;
+    layout->leafNodeLeftSplitCount = (layout->leafNodeMaxCells + 1) - layout->leafNodeRightSplitCount;
+    layout->internalNodeMaxCells = (pageSize - INTERNAL_NODE_HEADER_SIZE) / INTERNAL_NODE_CELL_SIZE;
+}
+
+void serializeRow(RowView *source, void *destination) {
+    memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
+    memcpy(destination + USERNAME_OFFSET, source->username, source->usernameLength);
+    memset(destination + USERNAME_OFFSET + source->usernameLength, 0, USERNAME_SIZE - source->usernameLength);
+    memcpy(destination + EMAIL_OFFSET, source->email, source->emailLength);
+    memset(destination + EMAIL_OFFSET + source->emailLength, 0, EMAIL_SIZE - source->emailLength);
+}
+
+void deserializeRow(void *source, Row *destination) {
+    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
+    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
+    memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
+    STATS_ADD(STAT_BYTES_DESERIALIZED, ROW_SIZE);
+}
+
+NodeType getNodeType(void *node) {
+    uint8_t value = *((uint8_t *) (node + NODE_TYPE_OFFSET));
+    return (NodeType) (value > 0);
+}
+
+void setNodeType(void *node, NodeType nodeType) {
+    uint8_t value = nodeType;
+    *((uint8_t *) (node + NODE_TYPE_OFFSET)) = value;
+}
+
+bool isNodeRoot(void* node){
+    uint8_t value = *((uint8_t*)(node + IS_ROOT_OFFSET));
+    return (bool)value;
+}
+
+void setNodeRoot(void* node, bool isRoot){
+    uint8_t value = isRoot;
+    *((uint8_t*)(node + IS_ROOT_OFFSET)) = value;
+}
+
+uint32_t* nodeParent(void* node){
+    return node + PARENT_POINTER_OFFSET;
+}
+
+uint32_t *leafNodeNumCells(void *node) {
+    return node + LEAF_NODE_NUM_CELLS_OFFSET;
+}
+
+void *leafNodeCell(void *node, uint32_t cellNum) {
+    return node + LEAF_NODE_HEADER_SIZE + cellNum * LEAF_NODE_CELL_SIZE;
+}
+
+uint32_t *leafNodeKey(void *node, uint32_t cellNum) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            return dictionaryLeafKey(node, cellNum);
+        case LEAF_FORMAT_PAX:
+            return paxLeafKey(node, cellNum);
+        default:
+            return leafNodeCell(node, cellNum);
+    }
+}
+
+void *leafNodeValue(void *node, uint32_t cellNum) {
+    return leafNodeCell(node, cellNum) + LEAF_NODE_KEY_SIZE;
+}
+
+LeafFormat leafNodeFormat(void *node) {
+    return (LeafFormat) *((uint8_t *) (node + NODE_TYPE_OFFSET));
+}
+
+void leafNodeSelectRows(void *node, const RowFilter *filter, uint64_t *selection) {
+    bool email = filter->column == COLUMN_EMAIL;
+    const void *strings = leafNodeValue(node, 0) + (email ? EMAIL_OFFSET : USERNAME_OFFSET);
+    uint32_t size = email ? COLUMN_EMAIL_SIZE : COLUMN_USERNAME_SIZE;
+    uint32_t numCells = *leafNodeNumCells(node);
+    if (filter->op == FILTER_SUFFIX) {
+        predicateSuffixFixed(strings, LEAF_NODE_CELL_SIZE, numCells, size, filter->value, filter->length, selection);
+        return;
+    }
+    /*
+     * Strings are padded with zeroes past their end, so the value and a
+     * zero after it pick out the rows that hold it. A username is compared
+     * whole, which is a single compare in the widest kernels.
+     */
+    char pattern[COLUMN_EMAIL_SIZE + 1] = {0};
+    memcpy(pattern, filter->value, filter->length);
+    uint32_t width = !email || filter->length == size ? size : filter->length + 1;
+    predicateEqualFixed(strings, LEAF_NODE_CELL_SIZE, numCells, pattern, width, selection);
+}
+
+/*
+ * Set the bit of each cell that passes the filter. scratch is as big as
+ * the selection of a page of single byte cells would be.
+ */
+void leafNodeSelect(Table *table, void *node, const RowFilter *filter, uint64_t *selection, uint64_t *scratch) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            dictionaryLeafSelect(node, table->layout.pageSize, filter, selection, scratch);
+            break;
+        case LEAF_FORMAT_PAX:
+            paxLeafSelect(node, filter, selection);
+            break;
+        default:
+            leafNodeSelectRows(node, filter, selection);
+    }
+}
+
+void initializeLeafNode(void *node, LeafFormat format, uint32_t pageSize) {
+    *((uint8_t *) (node + NODE_TYPE_OFFSET)) = format;
+    setNodeRoot(node, false);
+    *leafNodeNumCells(node) = 0;
+    if (format == LEAF_FORMAT_DICTIONARY) {
+        dictionaryLeafInit(node, pageSize);
+    } else if (format == LEAF_FORMAT_PAX) {
+        paxLeafInit(node, pageSize);
+    }
+}
+
+void leafNodeView(void *node, uint32_t cellNum, RowView *row) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            dictionaryLeafView(node, cellNum, row);
+            return;
+        case LEAF_FORMAT_PAX:
+            paxLeafView(node, cellNum, row);
+            return;
+        default:
+            break;
+    }
+    void *value = leafNodeValue(node, cellNum);
+    memcpy(&(row->id), value + ID_OFFSET, ID_SIZE);
+    row->username = value + USERNAME_OFFSET;
+    row->usernameLength = strnlen(row->username, COLUMN_USERNAME_SIZE);
+    row->email = value + EMAIL_OFFSET;
+    row->emailLength = strnlen(row->email, COLUMN_EMAIL_SIZE);
+}
+
+void leafNodeRead(void *node, uint32_t cellNum, Row *row) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            dictionaryLeafRead(node, cellNum, row);
+            break;
+        case LEAF_FORMAT_PAX:
+            paxLeafRead(node, cellNum, row);
+            break;
+        default:
+            deserializeRow(leafNodeValue(node, cellNum), row);
+    }
+}
+
+bool leafNodeHasRoom(Table *table, void *node, RowView *row) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            return dictionaryLeafHasRoom(node, table->layout.pageSize, row);
+        case LEAF_FORMAT_PAX:
+            return paxLeafHasRoom(node, row);
+        default:
+            return *leafNodeNumCells(node) < table->layout.leafNodeMaxCells;
+    }
+}
+
+uint32_t leafNodeCellLimit(Table *table, void *node) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            return dictionaryLeafMaxCells(table->layout.pageSize);
+        case LEAF_FORMAT_PAX:
+            return paxLeafMaxCells(table->layout.pageSize);
+        default:
+            return table->layout.leafNodeMaxCells;
+    }
+}
+
+uint32_t leafNodeCapacity(Table *table, void *node) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            return dictionaryLeafCapacity(node, table->layout.pageSize);
+        case LEAF_FORMAT_PAX:
+            return paxLeafCapacity(node, table->layout.pageSize);
+        default:
+            return table->layout.leafNodeMaxCells;
+    }
+}
+
+/* Add a row at cellNum, which the leaf must have room for. */
+void leafNodeInsertCell(Table *table, void *node, uint32_t cellNum, uint32_t key, RowView *value) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            dictionaryLeafInsert(node, table->layout.pageSize, cellNum, key, value);
+            return;
+        case LEAF_FORMAT_PAX:
+            paxLeafInsert(node, cellNum, key, value);
+            return;
+        default:
+            break;
+    }
+    uint32_t numCells = *leafNodeNumCells(node);
+    if (cellNum < numCells) {
+        //make room for new cell
+        for (uint32_t i = numCells; i > cellNum; i--) {
+            memcpy(leafNodeCell(node, i), leafNodeCell(node, i - 1), LEAF_NODE_CELL_SIZE);
+        }
+    }
+
+    *(leafNodeNumCells(node)) += 1;
+    *(leafNodeKey(node, cellNum)) = key;
+    serializeRow(value, leafNodeValue(node, cellNum));
+}
+
+uint32_t* internalNodeNumKeys(void* node){
+    return node + INTERNAL_NODE_NUM_KEYS_OFFSET;
+}
+
+uint32_t* internalNodeRightChild(void* node){
+    return node + INTERNAL_NODE_RIGHT_CHILD_OFFSET;
+}
+
+uint32_t* internalNodeCell(void* node, uint32_t cellNum){
+    return node + INTERNAL_NODE_HEADER_SIZE + cellNum * INTERNAL_NODE_CELL_SIZE;
+}
+
+uint32_t* internalNodeChild(void* node, uint32_t childNum){
+    uint32_t numKeys = *internalNodeNumKeys(node);
+
+    if(childNum > numKeys){
+        printf("Tried to access childNum %d > numKeys %d\n", childNum, numKeys);
+        exit(EXIT_FAILURE);
+    } else if(childNum == numKeys){
+        return internalNodeRightChild(node);
+    } else {
+        return internalNodeCell(node, childNum);
+    }
+}
+
+uint32_t* internalNodeKey(void* node, uint32_t keyNum){
+    return (void*) internalNodeCell(node, keyNum) + INTERNAL_NODE_CHILD_SIZE;
+}
+
+void initializeInternalNode(void* node){
+    setNodeType(node, NODE_INTERNAL);
+    setNodeRoot(node, false);
+    *internalNodeNumKeys(node) = 0;
+}
+
+/*
+ * Internal keys only cover the children to their left, so the
+ * maximum of an internal node lives in its rightmost leaf.
+ */
+uint32_t getNodeMaxKey(Pager* pager, void* node){
+    while (getNodeType(node) == NODE_INTERNAL) {
+        node = getPage(pager, *internalNodeRightChild(node));
+    }
+    return *leafNodeKey(node, *leafNodeNumCells(node) - 1);
+}
+
+/*
+ * Return the index of the child which should contain the given key
+ */
+uint32_t internalNodeFindChild(void* node, uint32_t key){
+    uint32_t numKeys = *internalNodeNumKeys(node);
+
+    /* There is one more child than key */
+    uint32_t minIndex = 0;
+    uint32_t maxIndex = numKeys;
+    while (minIndex != maxIndex) {
+        uint32_t index = (minIndex + maxIndex) / 2;
+        uint32_t keyToRight = *internalNodeKey(node, index);
+        if (keyToRight >= key) {
+            maxIndex = index;
+        } else {
+            minIndex = index + 1;
+        }
+    }
+    return minIndex;
+}
+
+void updateInternalNodeKey(void* node, uint32_t oldKey, uint32_t newKey){
+    uint32_t oldChildIndex = internalNodeFindChild(node, oldKey);
+    if (oldChildIndex < *internalNodeNumKeys(node)) {
+        *internalNodeKey(node, oldChildIndex) = newKey;
+    }
+}
+
+void createNewRoot(Table* table, uint32_t rightChildPageNum){
+    /*
+     * Handle splitting the root.
+     * Old root copied to new page, becomes left child.
+     * Address of right child passed in.
+     * Re-initialize root page to contain the new root node.
+     * New root node points to two children.
+     */
+
+    void* root = getPage(table->pager, table->rootPageNum);
+    void* rightChild = getPageForWrite(table->pager, rightChildPageNum);
+    uint32_t leftChildPageNum = getUnusedPageNum(table->pager);
+    void* leftChild = getPageForWrite(table->pager, leftChildPageNum);
+
+    /* Left child has data copied from old root */
+    memcpy(leftChild, root, table->layout.pageSize);
+    setNodeRoot(leftChild, false);
+
+    /* Children of a copied internal node now have a new parent */
+    if (getNodeType(leftChild) == NODE_INTERNAL) {
+        for (uint32_t i = 0; i <= *internalNodeNumKeys(leftChild); i++) {
+            void* child = getPageForWrite(table->pager, *internalNodeChild(leftChild, i));
+            *nodeParent(child) = leftChildPageNum;
+        }
+    }
+
+    /* Root node is a new internal node with one key and two children */
+    initializeInternalNode(root);
+    setNodeRoot(root, true);
+    *internalNodeNumKeys(root) = 1;
+    *internalNodeChild(root, 0) = leftChildPageNum;
+    uint32_t leftChildMaxKey = getNodeMaxKey(table->pager, leftChild);
+    *internalNodeKey(root, 0) = leftChildMaxKey;
+    *internalNodeRightChild(root) = rightChildPageNum;
+    *nodeParent(leftChild) = table->rootPageNum;
+    *nodeParent(rightChild) = table->rootPageNum;
+}
+
+void internalNodeSplitAndInsert(Table* table, uint32_t parentPageNum, uint32_t childPageNum){
+    /*
+     * Lay out every child of the full node plus the new one in key order,
+     * keep the lower half in the old node and move the upper half to a
+     * new node. Then update the parent, or create a new root.
+     */
+    STATS_ADD(STAT_INTERNAL_SPLITS, 1);
+    Pager* pager = table->pager;
+    void* oldNode = getPage(pager, parentPageNum);
+    uint32_t oldMax = getNodeMaxKey(pager, oldNode);
+    uint32_t numKeys = *internalNodeNumKeys(oldNode);
+    uint32_t childMaxKey = getNodeMaxKey(pager, getPage(pager, childPageNum));
+
+    uint32_t numChildren = numKeys + 2;
+    uint32_t children[table->layout.internalNodeMaxCells + 2];
+    uint32_t keys[table->layout.internalNodeMaxCells + 2];
+    uint32_t j = 0;
+    bool inserted = false;
+    for (uint32_t i = 0; i <= numKeys; i++) {
+        uint32_t key = (i < numKeys) ? *internalNodeKey(oldNode, i) : oldMax;
+        if (!inserted && childMaxKey < key) {
+            children[j] = childPageNum;
+            keys[j++] = childMaxKey;
+            inserted = true;
+        }
+        children[j] = *internalNodeChild(oldNode, i);
+        keys[j++] = key;
+    }
+    if (!inserted) {
+        children[j] = childPageNum;
+        keys[j] = childMaxKey;
+    }
+
+    uint32_t newPageNum = getUnusedPageNum(pager);
+    void* newNode = getPageForWrite(pager, newPageNum);
+    initializeInternalNode(newNode);
+
+    uint32_t leftCount = numChildren / 2;
+    *internalNodeNumKeys(oldNode) = leftCount - 1;
+    for (uint32_t i = 0; i < leftCount - 1; i++) {
+        *internalNodeChild(oldNode, i) = children[i];
+        *internalNodeKey(oldNode, i) = keys[i];
+    }
+    *internalNodeRightChild(oldNode) = children[leftCount - 1];
+    *nodeParent(getPageForWrite(pager, childPageNum)) = parentPageNum;
+
+    *internalNodeNumKeys(newNode) = numChildren - leftCount - 1;
+    for (uint32_t i = leftCount; i < numChildren; i++) {
+        if (i < numChildren - 1) {
+            *internalNodeChild(newNode, i - leftCount) = children[i];
+            *internalNodeKey(newNode, i - leftCount) = keys[i];
+        } else {
+            *internalNodeRightChild(newNode) = children[i];
+        }
+        *nodeParent(getPageForWrite(pager, children[i])) = newPageNum;
+    }
+
+    if (isNodeRoot(oldNode)) {
+        createNewRoot(table, newPageNum);
+    } else {
+        uint32_t grandparentPageNum = *nodeParent(oldNode);
+        void* grandparent = getPage(pager, grandparentPageNum);
+        updateInternalNodeKey(grandparent, oldMax, keys[leftCount - 1]);
+        internalNodeInsert(table, grandparentPageNum, newPageNum);
+    }
+}
+
+/*
+ * Add a new child/key pair to parent that corresponds to child
+ */
+void internalNodeInsert(Table* table, uint32_t parentPageNum, uint32_t childPageNum){
+    void* parent = getPage(table->pager, parentPageNum);
+    void* child = getPageForWrite(table->pager, childPageNum);
+    uint32_t childMaxKey = getNodeMaxKey(table->pager, child);
+    uint32_t index = internalNodeFindChild(parent, childMaxKey);
+
+    uint32_t originalNumKeys = *internalNodeNumKeys(parent);
+    if (originalNumKeys >= table->layout.internalNodeMaxCells) {
+        internalNodeSplitAndInsert(table, parentPageNum, childPageNum);
+        return;
+    }
+
+    uint32_t rightChildPageNum = *internalNodeRightChild(parent);
+    void* rightChild = getPage(table->pager, rightChildPageNum);
+    uint32_t rightChildMaxKey = getNodeMaxKey(table->pager, rightChild);
+
+    *internalNodeNumKeys(parent) = originalNumKeys + 1;
+
+    if (childMaxKey > rightChildMaxKey) {
+        /* Replace right child */
+        *internalNodeChild(parent, originalNumKeys) = rightChildPageNum;
+        *internalNodeKey(parent, originalNumKeys) = rightChildMaxKey;
+        *internalNodeRightChild(parent) = childPageNum;
+    } else {
+        /* Make room for the new cell */
+        for (uint32_t i = originalNumKeys; i > index; i--) {
+            memcpy(internalNodeCell(parent, i), internalNodeCell(parent, i - 1), INTERNAL_NODE_CELL_SIZE);
+        }
+        *internalNodeChild(parent, index) = childPageNum;
+        *internalNodeKey(parent, index) = childMaxKey;
+    }
+    *nodeParent(child) = parentPageNum;
+}
+
+/*
+ * All existing keys plus new key should be divided
+ * evenly between old(left) and new (right) nodes.
+ * Starting from the right, move each key to correct position.
+ */
+void leafNodeSplitRows(Cursor *cursor, void *oldNode, void *newNode, uint32_t key, RowView *value) {
+    NodeLayout *layout = &(cursor->table->layout);
+    for (uint32_t i = layout->leafNodeMaxCells; i <= layout->leafNodeMaxCells && i >= 0; i--) {
+        void* destinationNode;
+        if(i >= layout->leafNodeLeftSplitCount){
+            destinationNode = newNode;
+        } else {
+            destinationNode = oldNode;
+        }
+        uint32_t indexWithinNode = i % layout->leafNodeLeftSplitCount;
+        void* destination = leafNodeCell(destinationNode, indexWithinNode);
+
+        if(i == cursor->cellNum){
+            *leafNodeKey(destinationNode, indexWithinNode) = key;
+            serializeRow(value, leafNodeValue(destinationNode, indexWithinNode));
+        } else if(i > cursor->cellNum){
+            memcpy(destination, leafNodeCell(oldNode, i - 1), LEAF_NODE_CELL_SIZE);
+        } else {
+            memcpy(destination, leafNodeCell(oldNode, i), LEAF_NODE_CELL_SIZE);
+        }
+    }
+
+    /*Update cell count on both leaf nodes*/
+    *(leafNodeNumCells(oldNode)) = layout->leafNodeLeftSplitCount;
+    *(leafNodeNumCells(newNode)) = layout->leafNodeRightSplitCount;
+}
+
+void leafNodeSplitAndInsert(Cursor* cursor, uint32_t key, RowView* value){
+    /*
+     * Create a new node and move half the cells over.
+     * Insert the new value in one of the two nodes.
+     * Update parent or create a new parent.
+     */
+    STATS_ADD(STAT_LEAF_SPLITS, 1);
+    uint32_t pageSize = cursor->table->layout.pageSize;
+    void* oldNode = getPage(cursor->table->pager, cursor->pageNum);
+    uint32_t oldMax = getNodeMaxKey(cursor->table->pager, oldNode);
+    uint32_t newPageNum = getUnusedPageNum(cursor->table->pager);
+    void* newNode = getPageForWrite(cursor->table->pager, newPageNum);
+    initializeLeafNode(newNode, leafNodeFormat(oldNode), pageSize);
+
+    // Halves by size rather than by count, except for rows leaves
+    void *scratch = cursor->table->scratchPage;
+    switch (leafNodeFormat(oldNode)) {
+        case LEAF_FORMAT_DICTIONARY:
+            dictionaryLeafSplit(oldNode, newNode, scratch, pageSize, cursor->cellNum, key, value);
+            break;
+        case LEAF_FORMAT_PAX:
+            paxLeafSplit(oldNode, newNode, scratch, pageSize, cursor->cellNum, key, value);
+            break;
+        default:
+            leafNodeSplitRows(cursor, oldNode, newNode, key, value);
+    }
+
+    if(isNodeRoot(oldNode)){
+        return createNewRoot(cursor->table, newPageNum);
+    } else {
+        uint32_t parentPageNum = *nodeParent(oldNode);
+        uint32_t newMax = getNodeMaxKey(cursor->table->pager, oldNode);
+        void* parent = getPage(cursor->table->pager, parentPageNum);
+
+        updateInternalNodeKey(parent, oldMax, newMax);
+        internalNodeInsert(cursor->table, parentPageNum, newPageNum);
+    }
+}
+
+void leafNodeInsert(Cursor *cursor, uint32_t key, RowView *value) {
+    void *node = getPage(cursor->table->pager, cursor->pageNum);
+
+    if (!leafNodeHasRoom(cursor->table, node, value)) {
+        // Node full
+        leafNodeSplitAndInsert(cursor, key, value);
+        return;
+    }
+    leafNodeInsertCell(cursor->table, node, cursor->cellNum, key, value);
+}
+
+uint32_t leafNodeAppendCells(Table *table, void *node, void *source) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t sourceCells = *leafNodeNumCells(source);
+    if (leafNodeFormat(node) == LEAF_FORMAT_ROWS && leafNodeFormat(source) == LEAF_FORMAT_ROWS) {
+        uint32_t room = table->layout.leafNodeMaxCells - numCells;
+        uint32_t moved = room < sourceCells ? room : sourceCells;
+        memcpy(leafNodeCell(node, numCells), leafNodeCell(source, 0), moved * LEAF_NODE_CELL_SIZE);
+        *leafNodeNumCells(node) = numCells + moved;
+        return moved;
+    }
+
+    uint32_t moved = 0;
+    RowView row;
+    while (moved < sourceCells) {
+        leafNodeView(source, moved, &row);
+        if (!leafNodeHasRoom(table, node, &row)) {
+            break;
+        }
+        leafNodeInsertCell(table, node, numCells + moved, *leafNodeKey(source, moved), &row);
+        moved++;
+    }
+    return moved;
+}
+
+void leafNodeRemoveFirstCells(Table *table, void *node, uint32_t count) {
+    switch (leafNodeFormat(node)) {
+        case LEAF_FORMAT_DICTIONARY:
+            dictionaryLeafRemoveFirst(node, table->scratchPage, table->layout.pageSize, count);
+            return;
+        case LEAF_FORMAT_PAX:
+            paxLeafRemoveFirst(node, table->scratchPage, table->layout.pageSize, count);
+            return;
+        default:
+            break;
+    }
+    uint32_t numCells = *leafNodeNumCells(node);
+    memmove(leafNodeCell(node, 0), leafNodeCell(node, count), (numCells - count) * LEAF_NODE_CELL_SIZE);
+    *leafNodeNumCells(node) = numCells - count;
+}
+
+/*
+ * Binary search for the key within a leaf. If the key is not
+ * present, return the index where it should be inserted.
+ */
+uint32_t leafNodeFindIndex(void *node, uint32_t key) {
+    uint32_t minIndex = 0;
+    uint32_t onePastMaxIndex = *leafNodeNumCells(node);
+    while (onePastMaxIndex != minIndex) {
+        uint32_t index = (minIndex + onePastMaxIndex) / 2;
+        uint32_t keyAtIndex = *leafNodeKey(node, index);
+
+        if (key == keyAtIndex) {
+            return index;
+        }
+
+        if (key < keyAtIndex) {
+            onePastMaxIndex = index;
+        } else {
+            minIndex = index + 1;
+        }
+    }
+    return minIndex;
+}
+
+/*
+ * Walk from the root to the leaf that should contain the key
+ */
+uint32_t tableFindLeaf(Table *table, uint32_t key) {
+    STATS_ADD(STAT_TREE_DESCENTS, 1);
+    uint32_t pageNum = table->rootPageNum;
+    void *node = getPage(table->pager, pageNum);
+
+    while (getNodeType(node) == NODE_INTERNAL) {
+        uint32_t childIndex = internalNodeFindChild(node, key);
+        pageNum = *internalNodeChild(node, childIndex);
+        node = getPage(table->pager, pageNum);
+    }
+    return pageNum;
+}
+
+uint32_t tableRightmostLeaf(Table *table) {
+    STATS_ADD(STAT_TREE_DESCENTS, 1);
+    uint32_t pageNum = table->rootPageNum;
+    void *node = getPage(table->pager, pageNum);
+
+    while (getNodeType(node) == NODE_INTERNAL) {
+        pageNum = *internalNodeRightChild(node);
+        node = getPage(table->pager, pageNum);
+    }
+    return pageNum;
+}
+
+void tableBeginWrite(Table *table) {
+    pthread_mutex_lock(&(table->writerLock));
+}
+
+void tableEndWrite(Table *table) {
+    pthread_mutex_unlock(&(table->writerLock));
+}
+
+/* Whether adding the row below the node could split it */
+bool nodeIsFull(Table *table, void *node, RowView *row) {
+    if (getNodeType(node) == NODE_LEAF) {
+        return !leafNodeHasRoom(table, node, row);
+    }
+    return *internalNodeNumKeys(node) >= table->layout.internalNodeMaxCells;
+}
+
+/*
+ * Adjust the row count in the header, inside the same commit as the
+ * rows themselves.
+ */
+void tableCountRows(Table *table, int64_t delta) {
+    DbHeader *header = pagerLatchExclusive(table->pager, 0);
+    header->roots[TABLE_ROOT_SLOT].rowCount += delta;
+    pagerUnlatchExclusive(table->pager, 0);
+}
+
+/* Read from the header without walking the tree. */
+uint64_t tableRowCount(Table *table) {
+    Frame *frame = pagerGetFrame(table->pager, 0);
+    while (true) {
+        uint64_t version = pagerReadBegin(frame);
+        uint64_t rowCount = ((DbHeader *) frame->data)->roots[TABLE_ROOT_SLOT].rowCount;
+        if (pagerReadValidate(frame, version)) {
+            return rowCount;
+        }
+    }
+}
+
+/* Deep enough for TABLE_MAX_PAGES pages of half full nodes */
+#define TABLE_MAX_DEPTH 32
+
+TableInsertResult tableInsert(Table *table, RowView *row) {
+    Pager *pager = table->pager;
+    uint32_t path[TABLE_MAX_DEPTH];
+    uint32_t depth = 0;
+
+    STATS_ADD(STAT_TREE_DESCENTS, 1);
+    uint32_t pageNum = table->rootPageNum;
+    void *node = getPage(pager, pageNum);
+    path[depth++] = pageNum;
+    while (getNodeType(node) == NODE_INTERNAL) {
+        pageNum = *internalNodeChild(node, internalNodeFindChild(node, row->id));
+        node = getPage(pager, pageNum);
+        path[depth++] = pageNum;
+    }
+
+    uint32_t cellNum = leafNodeFindIndex(node, row->id);
+    if (cellNum < *leafNodeNumCells(node) && *leafNodeKey(node, cellNum) == row->id) {
+        return TABLE_INSERT_DUPLICATE_KEY;
+    }
+
+    /*
+     * A split climbs through full nodes and stops at the first one with
+     * room, or makes a new root. That node and everything below it on
+     * the path will change. Each split takes a new page, and a new root
+     * one more, so refuse the insert up front rather than running out
+     * of pages half way through.
+     */
+    uint32_t top = depth - 1;
+    while (top > 0 && nodeIsFull(table, getPage(pager, path[top]), row)) {
+        top--;
+    }
+    if (nodeIsFull(table, getPage(pager, path[depth - 1]), row) &&
+        pager->numPages + (depth - top) + 1 > TABLE_MAX_PAGES) {
+        return TABLE_INSERT_FULL;
+    }
+
+    pagerWriteBegin(pager);
+    for (uint32_t i = top; i < depth; i++) {
+        pagerLatchExclusive(pager, path[i]);
+    }
+    Cursor cursor = {.table = table, .pageNum = pageNum, .cellNum = cellNum};
+    leafNodeInsert(&cursor, row->id, row);
+    for (uint32_t i = top; i < depth; i++) {
+        pagerUnlatchExclusive(pager, path[i]);
+    }
+    tableCountRows(table, 1);
+    pagerWriteCommit(pager);
+    return TABLE_INSERT_SUCCESS;
+}
+
+/*
+ * Fast path for rows that arrive in key order: add the row after the
+ * last cell of the rightmost leaf without searching from the root. The
+ * caller guarantees the key is larger than any already in the table.
+ */
+TableInsertResult tableAppend(Table *table, uint32_t rightmostPageNum, RowView *row) {
+    void *node = getPage(table->pager, rightmostPageNum);
+    uint32_t numCells = *leafNodeNumCells(node);
+    if (!leafNodeHasRoom(table, node, row)) {
+        return tableInsert(table, row);
+    }
+
+    pagerWriteBegin(table->pager);
+    pagerLatchExclusive(table->pager, rightmostPageNum);
+    Cursor cursor = {.table = table, .pageNum = rightmostPageNum, .cellNum = numCells};
+    leafNodeInsert(&cursor, row->id, row);
+    pagerUnlatchExclusive(table->pager, rightmostPageNum);
+    tableCountRows(table, 1);
+    pagerWriteCommit(table->pager);
+    return TABLE_INSERT_SUCCESS;
+}
+
+Table *dbOpen(const char *fileName, uint32_t pageSize, const FlushOptions *flushOptions) {
+    Pager *pager = pagerOpen(fileName, pageSize);
+    if (pager == NULL) {
+        return NULL;
+    }
+
+    Table *table = malloc(sizeof(Table));
+    table->pager = pager;
+    nodeLayoutInit(&(table->layout), pager->pageSize);
+    pthread_mutex_init(&(table->writerLock), NULL);
+    table->scratchPage = malloc(pager->pageSize);
+    atomic_init(&(table->readAheadWindow), CURSOR_READ_AHEAD_MIN_PAGES);
+    table->vacuumRunning = false;
+
+    DbHeader *header = pagerHeader(pager);
+    if (header->numRoots == 0) {
+        // New database file. Page 1, right after the header, is the root leaf.
+        header = getPageForWrite(pager, 0);
+        header->numRoots = 1;
+        header->roots[TABLE_ROOT_SLOT].rootPageNum = getUnusedPageNum(pager);
+        header->roots[TABLE_ROOT_SLOT].rowCount = 0;
+        void *rootNode = getPageForWrite(pager, header->roots[TABLE_ROOT_SLOT].rootPageNum);
+        const char *formatName = getenv("SQLCLONE_LEAF_FORMAT");
+        LeafFormat format = LEAF_FORMAT_ROWS;
+        if (formatName != NULL && strcmp(formatName, "dictionary") == 0) {
+            format = LEAF_FORMAT_DICTIONARY;
+        } else if (formatName != NULL && strcmp(formatName, "pax") == 0) {
+            format = LEAF_FORMAT_PAX;
+        }
+        initializeLeafNode(rootNode, format, pager->pageSize);
+        setNodeRoot(rootNode, true);
+    }
+    table->rootPageNum = header->roots[TABLE_ROOT_SLOT].rootPageNum;
+    if (header->numRoots > DB_HEADER_MAX_ROOTS || table->rootPageNum >= pager->numPages) {
+        printf("Db file header points past the end of the file. Corrupt file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (flushOptions != NULL) {
+        pagerStartFlusher(pager, flushOptions);
+    }
+    return table;
+}
+
+void dbClose(Table *table) {
+    pagerClose(table->pager);
+    pthread_mutex_destroy(&(table->writerLock));
+    free(table->scratchPage);
+    free(table);
+}
+
+/*
+ * Copy the cell count and the cells in use of a leaf into the cursor;
+ * the rest of the header belongs to the writer. A torn read may see any
+ * cell count, so clamp it to stay inside the page.
+ */
+uint32_t cursorCopyLeaf(Cursor *cursor, void *node) {
+    LeafFormat format = leafNodeFormat(node);
+    *((uint8_t *) (cursor->leaf + NODE_TYPE_OFFSET)) = format;
+    if (format == LEAF_FORMAT_DICTIONARY) {
+        return dictionaryLeafCopy(cursor->leaf, node, cursor->table->layout.pageSize);
+    } else if (format == LEAF_FORMAT_PAX) {
+        return paxLeafCopy(cursor->leaf, node, cursor->table->layout.pageSize);
+    }
+    uint32_t numCells = *leafNodeNumCells(node);
+    if (numCells > cursor->table->layout.leafNodeMaxCells) {
+        numCells = cursor->table->layout.leafNodeMaxCells;
+    }
+    *leafNodeNumCells(cursor->leaf) = numCells;
+    memcpy(leafNodeCell(cursor->leaf, 0), leafNodeCell(node, 0), numCells * LEAF_NODE_CELL_SIZE);
+    return numCells;
+}
+
+/*
+ * Note the children after childIndex. The first sibling noted at the
+ * level above is this node's successor. numKeys has already been
+ * checked, since on an unlatched page it may be torn.
+ */
+void cursorNoteSiblings(Cursor *cursor, void *node, uint32_t numKeys, uint32_t childIndex) {
+    cursor->nextParent = cursor->numReadAhead > 0 ? cursor->readAhead[0] : CURSOR_NO_PAGE;
+    uint32_t count = 0;
+    for (uint32_t i = childIndex + 1; i <= numKeys && count < CURSOR_READ_AHEAD_MAX_PAGES; i++) {
+        cursor->readAhead[count++] = (i < numKeys) ? *internalNodeCell(node, i) : *internalNodeRightChild(node);
+    }
+    cursor->numReadAhead = count;
+}
+
+/*
+ * Optimistic descent: no latches, no writes to shared memory. Each node
+ * is validated after reading from it and before following the child
+ * pointer, so a torn read is never acted on. Older images of a page
+ * never change and need no validation. Returns false if a concurrent
+ * change got in the way and the descent must restart.
+ */
+bool cursorLoadLeafOptimistic(Cursor *cursor, uint32_t key) {
+    Pager *pager = cursor->table->pager;
+    uint32_t pageNum = cursor->table->rootPageNum;
+    cursor->numReadAhead = 0;
+    cursor->nextParent = CURSOR_NO_PAGE;
+    Frame *frame = pagerGetFrame(pager, pageNum);
+    uint64_t version = pagerReadBegin(frame);
+    void *node = pagerPageAt(frame, cursor->snapshot);
+    if (node == NULL) {
+        return false;
+    }
+
+    while (getNodeType(node) == NODE_INTERNAL) {
+        bool live = (node == frame->data);
+        uint32_t numKeys = *internalNodeNumKeys(node);
+        if (numKeys > cursor->table->layout.internalNodeMaxCells) {
+            return false;
+        }
+        uint32_t childIndex = internalNodeFindChild(node, key);
+        uint32_t childPageNum = *internalNodeChild(node, childIndex);
+        cursorNoteSiblings(cursor, node, numKeys, childIndex);
+        if (live && !pagerReadValidate(frame, version)) {
+            return false;
+        }
+
+        Frame *child = pagerGetFrame(pager, childPageNum);
+        uint64_t childVersion = pagerReadBegin(child);
+        // The parent must not have changed while we waited on the child.
+        if (live && !pagerReadValidate(frame, version)) {
+            return false;
+        }
+        pageNum = childPageNum;
+        frame = child;
+        version = childVersion;
+        node = pagerPageAt(frame, cursor->snapshot);
+        if (node == NULL) {
+            return false;
+        }
+    }
+
+    cursorCopyLeaf(cursor, node);
+    if (node == frame->data && !pagerReadValidate(frame, version)) {
+        return false;
+    }
+    cursor->pageNum = pageNum;
+    return true;
+}
+
+/*
+ * Pessimistic descent with shared latches, for readers that keep being
+ * overtaken by the writer. Each node is read as of the snapshot, whose
+ * images never change, so the parent is let go before the child is
+ * latched: holding on to it would take the two in the opposite order
+ * to the writer once a vacuum has swapped their pages.
+ */
+void cursorLoadLeafLatched(Cursor *cursor, uint32_t key) {
+    Pager *pager = cursor->table->pager;
+    uint32_t pageNum = cursor->table->rootPageNum;
+    cursor->numReadAhead = 0;
+    cursor->nextParent = CURSOR_NO_PAGE;
+    pagerLatchShared(pager, pageNum);
+    void *node = pagerPageAt(pagerGetFrame(pager, pageNum), cursor->snapshot);
+
+    while (getNodeType(node) == NODE_INTERNAL) {
+        uint32_t childIndex = internalNodeFindChild(node, key);
+        uint32_t childPageNum = *internalNodeChild(node, childIndex);
+        cursorNoteSiblings(cursor, node, *internalNodeNumKeys(node), childIndex);
+        pagerUnlatchShared(pager, pageNum);
+        pagerLatchShared(pager, childPageNum);
+        pageNum = childPageNum;
+        node = pagerPageAt(pagerGetFrame(pager, pageNum), cursor->snapshot);
+    }
+
+    cursorCopyLeaf(cursor, node);
+    pagerUnlatchShared(pager, pageNum);
+    cursor->pageNum = pageNum;
+}
+
+#define CURSOR_OPTIMISTIC_ATTEMPTS 8
+
+/* Test every row of the leaf just copied against the filter, if there is one */
+void cursorSelectRows(Cursor *cursor) {
+    if (cursor->filter != NULL) {
+        leafNodeSelect(cursor->table, cursor->leaf, cursor->filter, cursor->selection, cursor->selectionScratch);
+    }
+}
+
+/*
+ * Copy the leaf for the key into the cursor and position on the key.
+ * Returns false if every key in that leaf is smaller than the one sought.
+ */
+bool cursorLoadLeaf(Cursor *cursor, uint32_t key) {
+    STATS_ADD(STAT_TREE_DESCENTS, 1);
+    uint32_t attempt = 0;
+    while (!cursorLoadLeafOptimistic(cursor, key)) {
+        if (++attempt == CURSOR_OPTIMISTIC_ATTEMPTS) {
+            cursorLoadLeafLatched(cursor, key);
+            break;
+        }
+    }
+
+    cursorSelectRows(cursor);
+    cursor->cellNum = leafNodeFindIndex(cursor->leaf, key);
+    return cursor->cellNum < *leafNodeNumCells(cursor->leaf);
+}
+
+Cursor *tableStart(Table *table) {
+    return tableFind(table, 0);
+}
+
+Cursor *tableStartInArena(Table *table, Arena *arena) {
+    return tableFindInArena(table, 0, arena);
+}
+
+Cursor* tableFind(Table* table, uint32_t key) {
+    return tableFindInArena(table, key, NULL);
+}
+
+/*
+ * Position a cursor on the first row whose key is at least the given key
+ */
+Cursor *tableFindInArena(Table *table, uint32_t key, Arena *arena) {
+    // The leaf copy, then a bit for each byte of it to select its rows with
+    uint32_t pageSize = table->layout.pageSize;
+    uint32_t selectionSize = PREDICATE_WORDS(pageSize) * sizeof(uint64_t);
+    Cursor *cursor;
+    if (arena != NULL) {
+        cursor = arenaAlloc(arena, sizeof(Cursor));
+        cursor->leaf = arenaAlloc(arena, pageSize + 2 * selectionSize);
+    } else {
+        cursor = malloc(sizeof(Cursor));
+        cursor->leaf = malloc(pageSize + 2 * selectionSize);
+    }
+    cursor->selection = cursor->leaf + pageSize;
+    cursor->selectionScratch = cursor->leaf + pageSize + selectionSize;
+    cursor->inArena = (arena != NULL);
+    STATS_ADD(STAT_CURSORS_OPENED, 1);
+    cursor->table = table;
+    cursor->snapshot = pagerSnapshotBegin(table->pager, &(cursor->snapshotSlot));
+    cursor->filter = NULL;
+    cursor->numPrefetched = 0;
+    cursor->nextPrefetched = 0;
+    cursor->readAheadWindow = atomic_load_explicit(&(table->readAheadWindow), memory_order_relaxed);
+    cursor->pagesPrefetched = 0;
+    cursor->prefetchedPagesUsed = 0;
+    cursor->endOfTable = !cursorLoadLeaf(cursor, key);
+    return cursor;
+}
+
+/*
+ * Carry the read-ahead list on into the children of the next parent,
+ * up to the window. Only a hint, so a torn read is simply dropped.
+ */
+uint32_t cursorReadAheadNextParent(Cursor *cursor, uint32_t count, uint32_t window) {
+    if (cursor->nextParent == CURSOR_NO_PAGE) {
+        return count;
+    }
+    // The scan needs this node next in any case.
+    Frame *frame = pagerGetFrame(cursor->table->pager, cursor->nextParent);
+    uint64_t version = pagerReadBegin(frame);
+    void *node = pagerPageAt(frame, cursor->snapshot);
+    if (node == NULL || getNodeType(node) != NODE_INTERNAL) {
+        return count;
+    }
+    uint32_t numKeys = *internalNodeNumKeys(node);
+    if (numKeys > cursor->table->layout.internalNodeMaxCells) {
+        return count;
+    }
+    uint32_t extended = count;
+    for (uint32_t i = 0; i <= numKeys && extended < window; i++) {
+        cursor->readAhead[extended++] = (i < numKeys) ? *internalNodeCell(node, i) : *internalNodeRightChild(node);
+    }
+    if (node == frame->data && !pagerReadValidate(frame, version)) {
+        return count;
+    }
+    return extended;
+}
+
+/*
+ * The scan has just moved onto a new leaf. Count it if read-ahead
+ * brought it in, and if the next leaf is not cached, read ahead again.
+ */
+void cursorReadAhead(Cursor *cursor) {
+    for (uint32_t i = cursor->nextPrefetched; i < cursor->numPrefetched; i++) {
+        if (cursor->prefetched[i] == cursor->pageNum) {
+            cursor->prefetchedPagesUsed++;
+            cursor->nextPrefetched = i + 1;
+            break;
+        }
+    }
+
+    // On the last child of its parent, the next leaf is the next parent's first.
+    if (cursor->numReadAhead == 0) {
+        cursor->numReadAhead = cursorReadAheadNextParent(cursor, 0, CURSOR_READ_AHEAD_MAX_PAGES);
+        cursor->nextParent = CURSOR_NO_PAGE;
+    }
+    Pager *pager = cursor->table->pager;
+    if (cursor->numReadAhead == 0 || pagerIsCached(pager, cursor->readAhead[0])) {
+        return;
+    }
+    // All of the last batch was used: the scan is streaming, so widen the window.
+    if (cursor->numPrefetched > 0 && cursor->nextPrefetched == cursor->numPrefetched &&
+        cursor->readAheadWindow < CURSOR_READ_AHEAD_MAX_PAGES) {
+        cursor->readAheadWindow *= 2;
+    }
+
+    uint32_t window = cursor->readAheadWindow;
+    uint32_t count = cursor->numReadAhead < window ? cursor->numReadAhead : window;
+    if (count < window) {
+        count = cursorReadAheadNextParent(cursor, count, window);
+    }
+    cursor->numPrefetched = pagerPrefetch(pager, cursor->readAhead, count, cursor->prefetched);
+    cursor->nextPrefetched = 0;
+    cursor->pagesPrefetched += cursor->numPrefetched;
+}
+
+/*
+ * Start the next scan with a wider window if most of what this one read
+ * ahead was used, or a narrower one if little of it was.
+ */
+void cursorLearnReadAhead(Cursor *cursor) {
+    uint32_t issued = cursor->pagesPrefetched;
+    uint32_t used = cursor->prefetchedPagesUsed;
+    _Atomic uint32_t *tableWindow = &(cursor->table->readAheadWindow);
+    uint32_t window = atomic_load_explicit(tableWindow, memory_order_relaxed);
+    if (used * 4 >= issued * 3 && window < CURSOR_READ_AHEAD_MAX_PAGES) {
+        atomic_store_explicit(tableWindow, window * 2, memory_order_relaxed);
+    } else if (used * 2 < issued && window > CURSOR_READ_AHEAD_MIN_PAGES) {
+        atomic_store_explicit(tableWindow, window / 2, memory_order_relaxed);
+    }
+}
+
+/* On to the next cell, and past the end of the leaf copy, the next leaf */
+void cursorStep(Cursor *cursor) {
+    void *leaf = cursor->leaf;
+    uint32_t numCells = *leafNodeNumCells(leaf);
+
+    cursor->cellNum += 1;
+    if (cursor->cellNum < numCells) {
+        return;
+    }
+
+    /*
+     * Leaves have no sibling pointers. Step to the next leaf by
+     * searching from the root for the successor of this leaf's last key.
+     */
+    uint32_t lastKey = *leafNodeKey(leaf, numCells - 1);
+    if (lastKey == UINT32_MAX || !cursorLoadLeaf(cursor, lastKey + 1)) {
+        cursor->endOfTable = true;
+        return;
+    }
+
+    cursorReadAhead(cursor);
+}
+
+/*
+ * Move on to the next row that passes the filter: the next selected
+ * cell of the leaf copy, or failing that of the leaves after it.
+ */
+void cursorSkipFiltered(Cursor *cursor) {
+    while (cursor->filter != NULL && !cursor->endOfTable) {
+        uint32_t numCells = *leafNodeNumCells(cursor->leaf);
+        cursor->cellNum = predicateNext(cursor->selection, cursor->cellNum, numCells);
+        if (cursor->cellNum < numCells) {
+            return;
+        }
+        cursor->cellNum = numCells - 1;
+        cursorStep(cursor);
+    }
+}
+
+void cursorSetFilter(Cursor *cursor, const RowFilter *filter) {
+    cursor->filter = filter;
+    cursorSelectRows(cursor);
+    cursorSkipFiltered(cursor);
+}
+
+uint64_t cursorCountFiltered(Cursor *cursor) {
+    uint64_t count = 0;
+    while (!cursor->endOfTable) {
+        uint32_t numCells = *leafNodeNumCells(cursor->leaf);
+        count += predicateCount(cursor->selection, cursor->cellNum, numCells);
+        cursor->cellNum = numCells - 1;
+        cursorStep(cursor);
+    }
+    return count;
+}
+
+void cursorAdvance(Cursor *cursor) {
+    cursorStep(cursor);
+    cursorSkipFiltered(cursor);
+}
+
+void cursorRow(Cursor *cursor, Row *row) {
+    leafNodeRead(cursor->leaf, cursor->cellNum, row);
+}
+
+void cursorClose(Cursor *cursor) {
+    if (cursor == NULL) {
+        return;
+    }
+    pagerSnapshotEnd(cursor->table->pager, cursor->snapshotSlot);
+    if (cursor->pagesPrefetched > 0) {
+        cursorLearnReadAhead(cursor);
+    }
+    if (!cursor->inArena) {
+        free(cursor->leaf);
+        free(cursor);
+    }
+}
@@ -0,0 +1,292 @@
+#ifndef SQLCLONE_BTREE_H
+#define SQLCLONE_BTREE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "pager.h"
+
+typedef enum {
+    NODE_INTERNAL, NODE_LEAF
+} NodeType;
+
+/*
+ * Leaves come in formats, kept in the node type byte, so every page
+ * says how to read it. A rows leaf holds fixed size cells of a key and
+ * a serialized row; a dictionary leaf holds each distinct string once
+ * and cells of codes for them (see dictionary.h); a PAX leaf keeps each
+ * column in a minipage of its own (see pax.h). A new table's format is
+ * taken from SQLCLONE_LEAF_FORMAT, and a split keeps the format of the
+ * leaf it splits.
+ */
+typedef enum {
+    LEAF_FORMAT_ROWS = 1,
+    LEAF_FORMAT_DICTIONARY = 2,
+    LEAF_FORMAT_PAX = 3
+} LeafFormat;
+
+#define COLUMN_USERNAME_SIZE 32
+#define COLUMN_EMAIL_SIZE 255
+
+typedef struct {
+    uint32_t id;
+    char username[COLUMN_USERNAME_SIZE + 1];
+    char email[COLUMN_EMAIL_SIZE + 1];
+} Row;
+
+typedef enum {
+    COLUMN_ID,
+    COLUMN_USERNAME,
+    COLUMN_EMAIL
+} Column;
+
+/*
+ * Column values that still live in the caller's buffer. They are copied
+ * exactly once, straight into the leaf cell, when the row is inserted.
+ */
+typedef struct {
+    uint32_t id;
+    const char *username;
+    uint32_t usernameLength;
+    const char *email;
+    uint32_t emailLength;
+} RowView;
+
+typedef enum {
+    FILTER_EQUALS,
+    FILTER_SUFFIX
+} FilterOperator;
+
+/*
+ * Rows whose username or email equals the value, or ends in it. A leaf
+ * is tested whole when the cursor copies it, by the kernels in
+ * predicate.h: rows and PAX leaves compare the strings, dictionary
+ * leaves test each distinct string once and then compare codes.
+ */
+typedef struct {
+    Column column;
+    FilterOperator op;
+    const char *value;
+    uint32_t length;
+} RowFilter;
+
+/*
+ * Node capacities depend on the page size of the database, so they are
+ * worked out when it is opened.
+ */
+typedef struct {
+    uint32_t pageSize;
+    uint32_t leafNodeSpaceForCells;
+    uint32_t leafNodeMaxCells;
+    uint32_t leafNodeRightSplitCount;
+    uint32_t leafNodeLeftSplitCount;
+    uint32_t internalNodeMaxCells;
+} NodeLayout;
+
+/* The table's slot in the header; there are no indexes yet. */
+#define TABLE_ROOT_SLOT 0
+
+/*
+ * Any number of threads may read a table while one thread writes it.
+ * Readers descend optimistically, or failing that holding one shared
+ * latch at a time. Writers take writerLock, so only one thread ever
+ * changes the tree structure; it reads nodes without latching and
+ * latches exclusively, top down, just the nodes an insert will change.
+ * Parent pointers are the writer's alone and are never latched.
+ */
+typedef struct {
+    Pager *pager;
+    NodeLayout layout;
+    uint32_t rootPageNum;
+    pthread_mutex_t writerLock;
+    // Writer only: a page to rebuild dictionary leaves from
+    void *scratchPage;
+    // Read-ahead window new scans start with, learned from earlier ones
+    _Atomic uint32_t readAheadWindow;
+    // Writer only: where the current vacuum pass has got to
+    bool vacuumRunning;
+    uint32_t vacuumNextKey;
+    uint32_t vacuumNextPage;
+} Table;
+
+/*
+ * Read cursors work on a private copy of the current leaf, so they hold
+ * no latch between rows. Moving past the end of the copy searches again
+ * from the root for the next key. Every cursor reads the tree as of the
+ * snapshot taken when it was opened, however long it stays open.
+ *
+ * A scan that reaches a leaf whose successor is not cached reads the
+ * next window of leaves in one batch. The window doubles each time a
+ * scan uses up a whole batch, and the table remembers from the hit rate
+ * of finished scans where the next one should start.
+ */
+#define CURSOR_READ_AHEAD_MIN_PAGES 4
+#define CURSOR_READ_AHEAD_MAX_PAGES PAGE_IO_QUEUE_DEPTH
+#define CURSOR_NO_PAGE UINT32_MAX
+
+typedef struct {
+    Table *table;
+    uint32_t pageNum;
+    uint32_t cellNum;
+    bool endOfTable;
+    void *leaf;
+    uint64_t snapshot;
+    uint32_t snapshotSlot;
+    // Only rows that pass the filter are stopped on: those selected in the leaf copy
+    const RowFilter *filter;
+    uint64_t *selection;
+    uint64_t *selectionScratch;
+
+    // The leaves after this one under its parent, and the parent's successor
+    uint32_t readAhead[CURSOR_READ_AHEAD_MAX_PAGES];
+    uint32_t numReadAhead;
+    uint32_t nextParent;
+    // The last batch read ahead, and how far the scan has got through it
+    uint32_t prefetched[CURSOR_READ_AHEAD_MAX_PAGES];
+    uint32_t numPrefetched;
+    uint32_t nextPrefetched;
+    uint32_t readAheadWindow;
+    uint32_t pagesPrefetched;
+    uint32_t prefetchedPagesUsed;
+    // Released with its arena rather than by cursorClose
+    bool inArena;
+} Cursor;
+
+typedef enum {
+    TABLE_INSERT_SUCCESS,
+    TABLE_INSERT_DUPLICATE_KEY,
+    TABLE_INSERT_FULL
+} TableInsertResult;
+
+extern const uint32_t ROW_SIZE;
+extern const uint32_t COMMON_NODE_HEADER_SIZE;
+extern const uint32_t LEAF_NODE_HEADER_SIZE;
+extern const uint32_t LEAF_NODE_CELL_SIZE;
+
+void nodeLayoutInit(NodeLayout *layout, uint32_t pageSize);
+
+void serializeRow(RowView *source, void *destination);
+
+void deserializeRow(void *source, Row *destination);
+
+/*
+ * Node accessors
+ */
+NodeType getNodeType(void *node);
+
+void setNodeType(void *node, NodeType nodeType);
+
+bool isNodeRoot(void* node);
+
+void setNodeRoot(void* node, bool isRoot);
+
+uint32_t* nodeParent(void* node);
+
+uint32_t *leafNodeNumCells(void *node);
+
+void *leafNodeCell(void *node, uint32_t cellNum);
+
+uint32_t *leafNodeKey(void *node, uint32_t cellNum);
+
+void *leafNodeValue(void *node, uint32_t cellNum);
+
+LeafFormat leafNodeFormat(void *node);
+
+void initializeLeafNode(void *node, LeafFormat format, uint32_t pageSize);
+
+/* Leaf cells in any format */
+void leafNodeView(void *node, uint32_t cellNum, RowView *row);
+
+void leafNodeRead(void *node, uint32_t cellNum, Row *row);
+
+bool leafNodeHasRoom(Table *table, void *node, RowView *row);
+
+/* Most cells the leaf's format allows on a page */
+uint32_t leafNodeCellLimit(Table *table, void *node);
+
+/* How many rows like the ones there the leaf could hold */
+uint32_t leafNodeCapacity(Table *table, void *node);
+
+uint32_t* internalNodeNumKeys(void* node);
+
+uint32_t* internalNodeRightChild(void* node);
+
+uint32_t* internalNodeCell(void* node, uint32_t cellNum);
+
+uint32_t* internalNodeChild(void* node, uint32_t childNum);
+
+uint32_t* internalNodeKey(void* node, uint32_t keyNum);
+
+void initializeInternalNode(void* node);
+
+uint32_t getNodeMaxKey(Pager* pager, void* node);
+
+uint32_t internalNodeFindChild(void* node, uint32_t key);
+
+/*
+ * Tree modification. Everything here requires the writer lock.
+ */
+void internalNodeInsert(Table* table, uint32_t parentPageNum, uint32_t childPageNum);
+
+void leafNodeInsert(Cursor *cursor, uint32_t key, RowView *value);
+
+/* Move as many of the source's first cells as fit onto the end of the leaf. Returns how many. */
+uint32_t leafNodeAppendCells(Table *table, void *node, void *source);
+
+void leafNodeRemoveFirstCells(Table *table, void *node, uint32_t count);
+
+uint32_t leafNodeFindIndex(void *node, uint32_t key);
+
+uint32_t tableFindLeaf(Table *table, uint32_t key);
+
+uint32_t tableRightmostLeaf(Table *table);
+
+void tableBeginWrite(Table *table);
+
+void tableEndWrite(Table *table);
+
+TableInsertResult tableInsert(Table *table, RowView *row);
+
+TableInsertResult tableAppend(Table *table, uint32_t rightmostPageNum, RowView *row);
+
+void tableCountRows(Table *table, int64_t delta);
+
+/*
+ * Tables and cursors. Cursors are safe to use alongside a writer.
+ * Without flush options, pages are only written back at close.
+ */
+Table *dbOpen(const char *fileName, uint32_t pageSize, const FlushOptions *flushOptions);
+
+void dbClose(Table *table);
+
+/* Instant: the count is kept in the header. Safe alongside a writer. */
+uint64_t tableRowCount(Table *table);
+
+Cursor *tableStart(Table *table);
+
+Cursor* tableFind(Table* table, uint32_t key);
+
+/*
+ * As above, but the cursor lives in the arena. cursorClose still has to
+ * be called, before the arena is reset.
+ */
+Cursor *tableStartInArena(Table *table, Arena *arena);
+
+Cursor *tableFindInArena(Table *table, uint32_t key, Arena *arena);
+
+/* From here on, stop only on rows that pass the filter, which must outlive the cursor. */
+void cursorSetFilter(Cursor *cursor, const RowFilter *filter);
+
+/* Count the rows from here to the end that pass the filter, without reading them */
+uint64_t cursorCountFiltered(Cursor *cursor);
+
+void cursorAdvance(Cursor *cursor);
+
+void cursorRow(Cursor *cursor, Row *row);
+
+void cursorClose(Cursor *cursor);
+
+#endif //SQLCLONE_BTREE_H
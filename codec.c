@@ -0,0 +1,149 @@
+#include "codec.h"
+
+#include <string.h>
+
+uint32_t codecRead32(const uint8_t *bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/* The extra bytes of a length that did not fit in its nibble */
+uint32_t codecPutLength(uint8_t *output, uint32_t length) {
+    uint32_t size = 0;
+    while (length >= 255) {
+        output[size++] = 255;
+        length -= 255;
+    }
+    output[size++] = (uint8_t) length;
+    return size;
+}
+
+/*
+ * Append a sequence to the output: the literals, then a match unless
+ * matchLength is 0. Returns false if it does not fit.
+ */
+bool codecEmit(uint8_t *output, uint32_t capacity, uint32_t *size,
+               const uint8_t *literals, uint32_t literalLength, uint32_t offset, uint32_t matchLength) {
+    // Token, offset, and the most the two lengths can take
+    uint64_t worstCase = 3 + (uint64_t) literalLength + literalLength / 255 + 1 + matchLength / 255 + 1;
+    if (*size + worstCase > capacity) {
+        return false;
+    }
+    uint8_t *token = &output[(*size)++];
+    uint32_t matchCode = matchLength == 0 ? 0 : matchLength - CODEC_MIN_MATCH;
+    *token = (uint8_t) ((literalLength < 15 ? literalLength : 15) << 4 | (matchCode < 15 ? matchCode : 15));
+    if (literalLength >= 15) {
+        *size += codecPutLength(output + *size, literalLength - 15);
+    }
+    memcpy(output + *size, literals, literalLength);
+    *size += literalLength;
+    if (matchLength == 0) {
+        return true;
+    }
+    output[(*size)++] = (uint8_t) offset;
+    output[(*size)++] = (uint8_t) (offset >> 8);
+    if (matchCode >= 15) {
+        *size += codecPutLength(output + *size, matchCode - 15);
+    }
+    return true;
+}
+
+uint32_t codecCompress(const void *source, uint32_t length, void *destination, uint32_t capacity) {
+    const uint8_t *input = source;
+    uint8_t *output = destination;
+    // Last position each hash of four bytes was seen at
+    uint32_t table[1 << CODEC_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint32_t size = 0;
+    uint32_t anchor = 0;
+    uint32_t position = 0;
+    while (position + CODEC_MIN_MATCH <= length) {
+        uint32_t sequence = codecRead32(input + position);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - CODEC_HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = position;
+        if (candidate >= position || position - candidate > CODEC_MAX_OFFSET ||
+            codecRead32(input + candidate) != sequence) {
+            position++;
+            continue;
+        }
+
+        uint32_t matchLength = CODEC_MIN_MATCH;
+        while (position + matchLength < length && input[candidate + matchLength] == input[position + matchLength]) {
+            matchLength++;
+        }
+        if (!codecEmit(output, capacity, &size, input + anchor, position - anchor, position - candidate,
+                       matchLength)) {
+            return 0;
+        }
+        position += matchLength;
+        anchor = position;
+    }
+    if (!codecEmit(output, capacity, &size, input + anchor, length - anchor, 0, 0)) {
+        return 0;
+    }
+    return size;
+}
+
+/* Read the extra bytes of a length onto length; false if the input runs out. */
+bool codecGetLength(const uint8_t *input, uint32_t length, uint32_t *position, uint32_t *value) {
+    uint8_t byte;
+    do {
+        if (*position >= length) {
+            return false;
+        }
+        byte = input[(*position)++];
+        *value += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool codecDecompress(const void *source, uint32_t length, void *destination, uint32_t size) {
+    const uint8_t *input = source;
+    uint8_t *output = destination;
+    uint32_t in = 0;
+    uint32_t out = 0;
+    while (in < length) {
+        uint8_t token = input[in++];
+        uint32_t literalLength = token >> 4;
+        if (literalLength == 15 && !codecGetLength(input, length, &in, &literalLength)) {
+            return false;
+        }
+        if (literalLength > length - in || literalLength > size - out) {
+            return false;
+        }
+        memcpy(output + out, input + in, literalLength);
+        in += literalLength;
+        out += literalLength;
+        if (in == length) {
+            break;
+        }
+
+        if (length - in < 2) {
+            return false;
+        }
+        uint32_t offset = input[in] | (uint32_t) input[in + 1] << 8;
+        in += 2;
+        uint32_t matchLength = (token & 15) + CODEC_MIN_MATCH;
+        if ((token & 15) == 15 && !codecGetLength(input, length, &in, &matchLength)) {
+            return false;
+        }
+        if (offset == 0 || offset > out || matchLength > size - out) {
+            return false;
+        }
+        if (offset == 1) {
+            // A run of one byte, which is what padding comes out as
+            memset(output + out, output[out - 1], matchLength);
+        } else if (offset >= matchLength) {
+            memcpy(output + out, output + out - offset, matchLength);
+        } else {
+            for (uint32_t i = 0; i < matchLength; i++) {
+                output[out + i] = output[out + i - offset];
+            }
+        }
+        out += matchLength;
+    }
+    return out == size;
+}
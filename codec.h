@@ -0,0 +1,34 @@
+#ifndef SQLCLONE_CODEC_H
+#define SQLCLONE_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A small LZ77 codec for pages, in the style of LZ4 blocks. The input is
+ * a run of sequences, each a token byte with the literal length in the
+ * high nibble and the match length less CODEC_MIN_MATCH in the low one,
+ * longer lengths carried on in extra bytes of up to 255 each, then the
+ * literals, then a two byte little endian offset back to the match. The
+ * last sequence is literals only.
+ *
+ * Rows are mostly zero padding, which comes out as matches at offset 1,
+ * and the repeated parts of keys and emails as matches further back.
+ */
+#define CODEC_MIN_MATCH 4
+#define CODEC_MAX_OFFSET 65535
+#define CODEC_HASH_BITS 12
+
+/*
+ * Compress length bytes of source into destination. Returns the size of
+ * the result, or 0 if it would not fit in capacity bytes.
+ */
+uint32_t codecCompress(const void *source, uint32_t length, void *destination, uint32_t capacity);
+
+/*
+ * Undo codecCompress. Returns false unless the input decodes cleanly to
+ * exactly size bytes, so a damaged page is caught rather than read.
+ */
+bool codecDecompress(const void *source, uint32_t length, void *destination, uint32_t size);
+
+#endif //SQLCLONE_CODEC_H
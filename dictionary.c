@@ -0,0 +1,257 @@
+#include "dictionary.h"
+
+#include <string.h>
+
+#include "predicate.h"
+#include "stats.h"
+
+uint32_t *dictionaryLeafHeapStart(void *node) {
+    return node + LEAF_NODE_HEADER_SIZE;
+}
+
+uint32_t *dictionaryLeafRowBytes(void *node) {
+    return node + LEAF_NODE_HEADER_SIZE + sizeof(uint32_t);
+}
+
+void *dictionaryLeafCell(void *node, uint32_t cellNum) {
+    return node + LEAF_NODE_HEADER_SIZE + DICTIONARY_HEADER_EXTRA + cellNum * DICTIONARY_CELL_SIZE;
+}
+
+uint32_t dictionaryLeafSpace(uint32_t pageSize) {
+    return pageSize - LEAF_NODE_HEADER_SIZE - DICTIONARY_HEADER_EXTRA;
+}
+
+/* What the row takes with none of its strings shared */
+uint32_t dictionaryRowSize(RowView *row) {
+    return DICTIONARY_CELL_SIZE + 2 + row->usernameLength + row->emailLength;
+}
+
+uint32_t dictionaryLeafMaxRowBytes(uint32_t pageSize) {
+    return 2 * (dictionaryLeafSpace(pageSize) - DICTIONARY_MAX_ROW_SIZE);
+}
+
+void dictionaryLeafInit(void *node, uint32_t pageSize) {
+    *leafNodeNumCells(node) = 0;
+    *dictionaryLeafHeapStart(node) = pageSize;
+    *dictionaryLeafRowBytes(node) = 0;
+}
+
+uint32_t dictionaryLeafMaxCells(uint32_t pageSize) {
+    return dictionaryLeafSpace(pageSize) / DICTIONARY_CELL_SIZE;
+}
+
+uint32_t *dictionaryLeafKey(void *node, uint32_t cellNum) {
+    return dictionaryLeafCell(node, cellNum);
+}
+
+uint16_t dictionaryLeafCode(void *node, uint32_t cellNum, Column column) {
+    uint16_t *codes = dictionaryLeafCell(node, cellNum) + sizeof(uint32_t);
+    return column == COLUMN_EMAIL ? codes[1] : codes[0];
+}
+
+/* The string a code points at, cut short rather than read past the column or the page */
+void dictionaryLeafString(void *node, uint32_t code, uint32_t maxLength, const char **text, uint32_t *length) {
+    uint8_t *entry = node + code;
+    *text = (const char *) entry + 1;
+    *length = entry[0] < maxLength ? entry[0] : maxLength;
+}
+
+void dictionaryLeafView(void *node, uint32_t cellNum, RowView *row) {
+    row->id = *dictionaryLeafKey(node, cellNum);
+    dictionaryLeafString(node, dictionaryLeafCode(node, cellNum, COLUMN_USERNAME), COLUMN_USERNAME_SIZE,
+                         &(row->username), &(row->usernameLength));
+    dictionaryLeafString(node, dictionaryLeafCode(node, cellNum, COLUMN_EMAIL), COLUMN_EMAIL_SIZE,
+                         &(row->email), &(row->emailLength));
+}
+
+void dictionaryLeafRead(void *node, uint32_t cellNum, Row *row) {
+    RowView view;
+    dictionaryLeafView(node, cellNum, &view);
+    row->id = view.id;
+    memcpy(row->username, view.username, view.usernameLength);
+    row->username[view.usernameLength] = '\0';
+    memcpy(row->email, view.email, view.emailLength);
+    row->email[view.emailLength] = '\0';
+    STATS_ADD(STAT_BYTES_DESERIALIZED, sizeof(uint32_t) + view.usernameLength + view.emailLength);
+}
+
+uint32_t dictionaryLeafFind(void *node, uint32_t pageSize, const char *value, uint32_t length) {
+    uint8_t *bytes = node;
+    uint32_t position = *dictionaryLeafHeapStart(node);
+    while (position < pageSize) {
+        uint32_t entryLength = bytes[position];
+        if (entryLength == length && position + 1 + length <= pageSize &&
+            memcmp(bytes + position + 1, value, length) == 0) {
+            return position;
+        }
+        position += 1 + entryLength;
+    }
+    return 0;
+}
+
+/* The code of the value, adding it to the heap if it is not there yet */
+uint16_t dictionaryLeafIntern(void *node, uint32_t pageSize, const char *value, uint32_t length) {
+    uint32_t code = dictionaryLeafFind(node, pageSize, value, length);
+    if (code != 0) {
+        return code;
+    }
+    uint32_t *heapStart = dictionaryLeafHeapStart(node);
+    *heapStart -= 1 + length;
+    uint8_t *entry = node + *heapStart;
+    entry[0] = (uint8_t) length;
+    memcpy(entry + 1, value, length);
+    return *heapStart;
+}
+
+void dictionaryLeafSelect(void *node, uint32_t pageSize, const RowFilter *filter, uint64_t *selection,
+                          uint64_t *scratch) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t codeOffset = sizeof(uint32_t) + (filter->column == COLUMN_EMAIL ? sizeof(uint16_t) : 0);
+    if (filter->op == FILTER_EQUALS) {
+        uint32_t code = dictionaryLeafFind(node, pageSize, filter->value, filter->length);
+        if (code == 0) {
+            STATS_ADD(STAT_LEAVES_SKIPPED, 1);
+            memset(selection, 0, PREDICATE_WORDS(numCells) * sizeof(uint64_t));
+            return;
+        }
+        predicateEqualCodes(dictionaryLeafCell(node, 0), numCells, codeOffset, code, selection);
+        return;
+    }
+
+    // Mark the code of each string in the heap with the suffix
+    memset(scratch, 0, PREDICATE_WORDS(pageSize) * sizeof(uint64_t));
+    memset(selection, 0, PREDICATE_WORDS(numCells) * sizeof(uint64_t));
+    uint8_t *bytes = node;
+    bool found = false;
+    for (uint32_t position = *dictionaryLeafHeapStart(node); position < pageSize; position += 1 + bytes[position]) {
+        uint32_t length = bytes[position];
+        if (length >= filter->length && position + 1 + length <= pageSize &&
+            memcmp(bytes + position + 1 + length - filter->length, filter->value, filter->length) == 0) {
+            predicateSet(scratch, position);
+            found = true;
+        }
+    }
+    if (!found) {
+        STATS_ADD(STAT_LEAVES_SKIPPED, 1);
+        return;
+    }
+    for (uint32_t i = 0; i < numCells; i++) {
+        if (predicateTest(scratch, dictionaryLeafCode(node, i, filter->column))) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+bool dictionaryLeafHasRoom(void *node, uint32_t pageSize, RowView *row) {
+    if (*dictionaryLeafRowBytes(node) + dictionaryRowSize(row) > dictionaryLeafMaxRowBytes(pageSize)) {
+        return false;
+    }
+    uint32_t needed = DICTIONARY_CELL_SIZE;
+    bool newUsername = dictionaryLeafFind(node, pageSize, row->username, row->usernameLength) == 0;
+    if (newUsername) {
+        needed += 1 + row->usernameLength;
+    }
+    bool sameAsUsername = row->emailLength == row->usernameLength &&
+                          memcmp(row->email, row->username, row->emailLength) == 0;
+    if (!(newUsername && sameAsUsername) && dictionaryLeafFind(node, pageSize, row->email, row->emailLength) == 0) {
+        needed += 1 + row->emailLength;
+    }
+    uint32_t cellsEnd = (char *) dictionaryLeafCell(node, *leafNodeNumCells(node)) - (char *) node;
+    return cellsEnd + needed <= *dictionaryLeafHeapStart(node);
+}
+
+void dictionaryLeafInsert(void *node, uint32_t pageSize, uint32_t cellNum, uint32_t key, RowView *row) {
+    uint16_t usernameCode = dictionaryLeafIntern(node, pageSize, row->username, row->usernameLength);
+    uint16_t emailCode = dictionaryLeafIntern(node, pageSize, row->email, row->emailLength);
+
+    uint32_t numCells = *leafNodeNumCells(node);
+    if (cellNum < numCells) {
+        memmove(dictionaryLeafCell(node, cellNum + 1), dictionaryLeafCell(node, cellNum),
+                (numCells - cellNum) * DICTIONARY_CELL_SIZE);
+    }
+    void *cell = dictionaryLeafCell(node, cellNum);
+    uint16_t codes[2] = {usernameCode, emailCode};
+    memcpy(cell, &key, sizeof(key));
+    memcpy(cell + sizeof(key), codes, sizeof(codes));
+    *leafNodeNumCells(node) = numCells + 1;
+    *dictionaryLeafRowBytes(node) += dictionaryRowSize(row);
+}
+
+/* Row i of the cells of the old leaf with the new row placed at cellNum */
+uint32_t dictionarySplitRow(void *old, uint32_t cellNum, uint32_t key, RowView *row, uint32_t i, RowView *view) {
+    if (i == cellNum) {
+        *view = *row;
+        return key;
+    }
+    uint32_t oldCell = i < cellNum ? i : i - 1;
+    dictionaryLeafView(old, oldCell, view);
+    return *dictionaryLeafKey(old, oldCell);
+}
+
+void dictionaryLeafSplit(void *oldNode, void *newNode, void *scratch, uint32_t pageSize,
+                         uint32_t cellNum, uint32_t key, RowView *row) {
+    memcpy(scratch, oldNode, pageSize);
+    uint32_t numRows = *leafNodeNumCells(scratch) + 1;
+    uint32_t total = *dictionaryLeafRowBytes(scratch) + dictionaryRowSize(row);
+
+    RowView view;
+    uint32_t leftCount = 1;
+    uint32_t leftBytes = 0;
+    uint32_t smallestLarger = UINT32_MAX;
+    for (uint32_t i = 0; i + 1 < numRows; i++) {
+        dictionarySplitRow(scratch, cellNum, key, row, i, &view);
+        leftBytes += dictionaryRowSize(&view);
+        uint32_t larger = leftBytes > total - leftBytes ? leftBytes : total - leftBytes;
+        if (larger < smallestLarger) {
+            smallestLarger = larger;
+            leftCount = i + 1;
+        }
+    }
+
+    dictionaryLeafInit(oldNode, pageSize);
+    for (uint32_t i = 0; i < numRows; i++) {
+        uint32_t rowKey = dictionarySplitRow(scratch, cellNum, key, row, i, &view);
+        void *node = i < leftCount ? oldNode : newNode;
+        dictionaryLeafInsert(node, pageSize, *leafNodeNumCells(node), rowKey, &view);
+    }
+}
+
+void dictionaryLeafRemoveFirst(void *node, void *scratch, uint32_t pageSize, uint32_t count) {
+    memcpy(scratch, node, pageSize);
+    uint32_t numCells = *leafNodeNumCells(scratch);
+    dictionaryLeafInit(node, pageSize);
+    RowView view;
+    for (uint32_t i = count; i < numCells; i++) {
+        dictionaryLeafView(scratch, i, &view);
+        dictionaryLeafInsert(node, pageSize, i - count, *dictionaryLeafKey(scratch, i), &view);
+    }
+}
+
+uint32_t dictionaryLeafCopy(void *destination, void *source, uint32_t pageSize) {
+    uint32_t numCells = *leafNodeNumCells(source);
+    if (numCells > dictionaryLeafMaxCells(pageSize)) {
+        numCells = dictionaryLeafMaxCells(pageSize);
+    }
+    uint32_t cellsEnd = (char *) dictionaryLeafCell(source, numCells) - (char *) source;
+    uint32_t heapStart = *dictionaryLeafHeapStart(source);
+    if (heapStart < cellsEnd || heapStart > pageSize) {
+        heapStart = pageSize;
+    }
+    memcpy(destination, source, cellsEnd);
+    memcpy(destination + heapStart, source + heapStart, pageSize - heapStart);
+    *leafNodeNumCells(destination) = numCells;
+    *dictionaryLeafHeapStart(destination) = heapStart;
+    return numCells;
+}
+
+uint32_t dictionaryLeafCapacity(void *node, uint32_t pageSize) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t rowBytes = *dictionaryLeafRowBytes(node);
+    uint32_t used = numCells * DICTIONARY_CELL_SIZE + (pageSize - *dictionaryLeafHeapStart(node));
+    if (numCells == 0 || rowBytes == 0 || used == 0) {
+        return dictionaryLeafMaxCells(pageSize);
+    }
+    uint64_t bySpace = (uint64_t) numCells * dictionaryLeafSpace(pageSize) / used;
+    uint64_t byRowBytes = (uint64_t) numCells * dictionaryLeafMaxRowBytes(pageSize) / rowBytes;
+    return (uint32_t) (bySpace < byRowBytes ? bySpace : byRowBytes);
+}
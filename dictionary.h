@@ -0,0 +1,86 @@
+#ifndef SQLCLONE_DICTIONARY_H
+#define SQLCLONE_DICTIONARY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+/*
+ * A dictionary leaf keeps every distinct username and email of its rows
+ * once, so a string that repeats from row to row, a name shared across
+ * tenants or an address at one of a few domains, takes its space once
+ * and each row only a small fixed cell:
+ *
+ *   leaf header, heap start, bytes the rows would take unshared
+ *   cells in key order: key, username code, email code
+ *   free space
+ *   heap, from heap start to the end of the page: length byte and text
+ *
+ * A string's code is its offset in the page. Cells hold the same value
+ * exactly when they hold the same code, so an equality test looks the
+ * value up in the heap once and then compares two byte codes; a leaf
+ * whose heap lacks the value has no match at all. The row id is the key.
+ *
+ * However much a split's halves share, neither can take more than the
+ * rows at their unshared size. A row is only added while those come to
+ * at most twice the space less a largest row, so that any full leaf
+ * splits into two halves that fit.
+ */
+#define DICTIONARY_CELL_SIZE 8
+// The heap start and the unshared size follow the common leaf header.
+#define DICTIONARY_HEADER_EXTRA 8
+#define DICTIONARY_MAX_ROW_SIZE (DICTIONARY_CELL_SIZE + 2 + COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE)
+
+/* Empty the leaf. The common header is left as it is. */
+void dictionaryLeafInit(void *node, uint32_t pageSize);
+
+uint32_t dictionaryLeafMaxCells(uint32_t pageSize);
+
+uint32_t *dictionaryLeafKey(void *node, uint32_t cellNum);
+
+uint16_t dictionaryLeafCode(void *node, uint32_t cellNum, Column column);
+
+/* The row, with its strings left in the page. */
+void dictionaryLeafView(void *node, uint32_t cellNum, RowView *row);
+
+void dictionaryLeafRead(void *node, uint32_t cellNum, Row *row);
+
+/* The code of the value in this leaf, or 0 if no row here has it. */
+uint32_t dictionaryLeafFind(void *node, uint32_t pageSize, const char *value, uint32_t length);
+
+/*
+ * Set the bit of each cell that passes the filter. Each distinct string
+ * is tested once, and the cells by their codes; scratch holds a bit for
+ * each byte of the page. A leaf with no string that passes has none of
+ * its cells read.
+ */
+void dictionaryLeafSelect(void *node, uint32_t pageSize, const RowFilter *filter, uint64_t *selection,
+                          uint64_t *scratch);
+
+bool dictionaryLeafHasRoom(void *node, uint32_t pageSize, RowView *row);
+
+/* Add a row at cellNum, which the leaf must have room for. */
+void dictionaryLeafInsert(void *node, uint32_t pageSize, uint32_t cellNum, uint32_t key, RowView *row);
+
+/*
+ * Share the cells of a full leaf and the new row between it and an
+ * empty dictionary leaf, at the point that leaves the larger half
+ * smallest. scratch is a page to work from.
+ */
+void dictionaryLeafSplit(void *oldNode, void *newNode, void *scratch, uint32_t pageSize,
+                         uint32_t cellNum, uint32_t key, RowView *row);
+
+/* Drop the first count cells and the strings only they used. */
+void dictionaryLeafRemoveFirst(void *node, void *scratch, uint32_t pageSize, uint32_t count);
+
+/*
+ * Copy the cells and the heap of a leaf that may be torn; the result
+ * stays inside the page whatever was read. Returns the cell count.
+ */
+uint32_t dictionaryLeafCopy(void *destination, void *source, uint32_t pageSize);
+
+/* How many rows like the ones there the leaf could hold. */
+uint32_t dictionaryLeafCapacity(void *node, uint32_t pageSize);
+
+#endif //SQLCLONE_DICTIONARY_H
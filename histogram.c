@@ -0,0 +1,64 @@
+#include "histogram.h"
+
+void histogramInit(Histogram *histogram) {
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        atomic_init(&(histogram->counts[i]), 0);
+    }
+    atomic_init(&(histogram->total), 0);
+    atomic_init(&(histogram->sum), 0);
+}
+
+/*
+ * Values below twice the number of sub-buckets get a bucket each. Above
+ * that, a value whose top bit is b is shifted right by
+ * b - HISTOGRAM_SUB_BUCKET_BITS, leaving HISTOGRAM_SUB_BUCKET_BITS + 1
+ * significant bits.
+ */
+uint32_t histogramIndex(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (uint32_t) value;
+    }
+    uint32_t shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BUCKET_BITS;
+    return shift * HISTOGRAM_SUB_BUCKETS + (uint32_t) (value >> shift);
+}
+
+uint64_t histogramHighestEquivalent(uint32_t index) {
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    uint32_t shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t mantissa = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void histogramRecord(Histogram *histogram, uint64_t value) {
+    atomic_fetch_add_explicit(&(histogram->counts[histogramIndex(value)]), 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&(histogram->total), 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&(histogram->sum), value, memory_order_relaxed);
+}
+
+uint64_t histogramPercentile(Histogram *histogram, double percentile) {
+    uint64_t total = atomic_load_explicit(&(histogram->total), memory_order_relaxed);
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t wanted = (uint64_t) (percentile / 100 * total + 0.5);
+    if (wanted == 0) {
+        wanted = 1;
+    }
+
+    uint64_t seen = 0;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        uint64_t count = atomic_load_explicit(&(histogram->counts[i]), memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        seen += count;
+        last = i;
+        if (seen >= wanted) {
+            break;
+        }
+    }
+    return histogramHighestEquivalent(last);
+}
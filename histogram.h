@@ -0,0 +1,34 @@
+#ifndef SQLCLONE_HISTOGRAM_H
+#define SQLCLONE_HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Log-linear histogram in the style of HdrHistogram: each power of two
+ * is split into HISTOGRAM_SUB_BUCKETS equal buckets, so any value is
+ * recorded to within about 3% over the whole 64 bit range, in a fixed
+ * amount of memory. Recording is one relaxed atomic add, and readers
+ * may look at it while it is being recorded into.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+    _Atomic uint64_t counts[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t total;
+    _Atomic uint64_t sum;
+} Histogram;
+
+void histogramInit(Histogram *histogram);
+
+void histogramRecord(Histogram *histogram, uint64_t value);
+
+/*
+ * The largest value that would be recorded in the same bucket as the
+ * value at this percentile, or 0 if nothing has been recorded.
+ */
+uint64_t histogramPercentile(Histogram *histogram, double percentile);
+
+#endif //SQLCLONE_HISTOGRAM_H
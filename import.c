@@ -0,0 +1,169 @@
+#include "import.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "input.h"
+#include "statement.h"
+
+#define IMPORT_SCRATCH_SIZE 512
+
+/*
+ * Split one CSV record into its three fields. Quoted fields are
+ * unescaped into `scratch`; unquoted fields point into the line.
+ */
+bool csvParseRecord(const char *line, size_t length, Token fields[3], char *scratch) {
+    const char *position = line;
+    const char *end = line + length;
+    size_t used = 0;
+
+    for (uint32_t field = 0; field < 3; field++) {
+        if (position < end && *position == '"') {
+            char *start = scratch + used;
+            position++;
+            while (true) {
+                if (position == end || used == IMPORT_SCRATCH_SIZE) {
+                    return false;
+                }
+                if (*position == '"') {
+                    if (position + 1 < end && position[1] == '"') {
+                        scratch[used++] = '"';
+                        position += 2;
+                        continue;
+                    }
+                    position++;
+                    break;
+                }
+                scratch[used++] = *position++;
+            }
+            fields[field].start = start;
+            fields[field].length = scratch + used - start;
+        } else {
+            const char *start = position;
+            while (position < end && *position != ',') {
+                position++;
+            }
+            fields[field].start = start;
+            fields[field].length = position - start;
+        }
+
+        if (field < 2) {
+            if (position == end || *position != ',') {
+                return false;
+            }
+            position++;
+        }
+    }
+    return position == end;
+}
+
+void importSkip(ImportStats *stats) {
+    stats->rowsSkipped++;
+    if (stats->firstSkippedLine == 0) {
+        stats->firstSkippedLine = stats->lines;
+    }
+}
+
+double secondsSince(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Stream id,username,email records from a CSV file into the table.
+ * A first line that does not parse is taken to be a header. While keys
+ * arrive in increasing order rows are appended straight to the rightmost
+ * leaf, skipping the descent and binary search of tableInsert. The
+ * import holds the writer lock throughout; readers carry on meanwhile.
+ */
+bool importCsv(Table *table, const char *fileName, ImportStats *stats) {
+    int fileDescriptor = open(fileName, O_RDONLY);
+    if (fileDescriptor == -1) {
+        return false;
+    }
+
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    BatchInput input;
+    batchInputOpen(&input, fileDescriptor);
+    InputBuffer line;
+    char scratch[IMPORT_SCRATCH_SIZE];
+
+    memset(stats, 0, sizeof(ImportStats));
+
+    tableBeginWrite(table);
+    uint32_t appendPageNum = tableRightmostLeaf(table);
+    void *appendNode = getPage(table->pager, appendPageNum);
+    bool tableEmpty = (*leafNodeNumCells(appendNode) == 0);
+    uint32_t maxKey = tableEmpty ? 0 : getNodeMaxKey(table->pager, appendNode);
+
+    while (batchReadInput(&input, &line)) {
+        stats->lines++;
+        stats->bytesRead += line.inputLength + 1;
+
+        size_t length = line.inputLength;
+        if (length > 0 && line.buffer[length - 1] == '\r') {
+            length--;
+        }
+        if (length == 0) {
+            continue;
+        }
+
+        Token fields[3];
+        RowView row;
+        bool valid = csvParseRecord(line.buffer, length, fields, scratch) &&
+                     parseId(&fields[0], &row.id) == PREPARE_SUCCESS &&
+                     fields[1].length <= COLUMN_USERNAME_SIZE &&
+                     fields[2].length <= COLUMN_EMAIL_SIZE;
+        if (!valid) {
+            if (stats->lines > 1) {
+                importSkip(stats);
+            }
+            continue;
+        }
+        row.username = fields[1].start;
+        row.usernameLength = fields[1].length;
+        row.email = fields[2].start;
+        row.emailLength = fields[2].length;
+
+        uint32_t numPagesBefore = table->pager->numPages;
+        TableInsertResult result;
+        bool append = tableEmpty || row.id > maxKey;
+        if (append) {
+            result = tableAppend(table, appendPageNum, &row);
+        } else {
+            result = tableInsert(table, &row);
+        }
+        if (result == TABLE_INSERT_FULL) {
+            stats->tableFull = true;
+            break;
+        }
+        if (result == TABLE_INSERT_DUPLICATE_KEY) {
+            importSkip(stats);
+            continue;
+        }
+        if (append) {
+            maxKey = row.id;
+            tableEmpty = false;
+            stats->rowsAppended++;
+        }
+        stats->rowsImported++;
+
+        /* A split may have moved the end of the table to a new leaf */
+        if (table->pager->numPages != numPagesBefore) {
+            appendPageNum = tableRightmostLeaf(table);
+        }
+    }
+
+    tableEndWrite(table);
+    batchInputClose(&input);
+    close(fileDescriptor);
+
+    stats->seconds = secondsSince(&startTime);
+    return true;
+}
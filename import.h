@@ -0,0 +1,27 @@
+#ifndef SQLCLONE_IMPORT_H
+#define SQLCLONE_IMPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+typedef struct {
+    uint64_t lines;
+    uint64_t bytesRead;
+    uint64_t rowsImported;
+    uint64_t rowsAppended;
+    uint64_t rowsSkipped;
+    uint64_t firstSkippedLine;
+    bool tableFull;
+    double seconds;
+} ImportStats;
+
+/*
+ * Returns false if the file cannot be opened. When the table fills up
+ * the import stops early with stats->tableFull set and stats->lines
+ * holding the line it stopped at.
+ */
+bool importCsv(Table *table, const char *fileName, ImportStats *stats);
+
+#endif //SQLCLONE_IMPORT_H
@@ -0,0 +1,119 @@
+#include "input.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+InputBuffer* newInputBuffer() {
+    InputBuffer *inputBuffer = (InputBuffer *) malloc(sizeof(InputBuffer));
+    inputBuffer->buffer = NULL;
+    inputBuffer->bufferLength = 0;
+    inputBuffer->inputLength = 0;
+
+    return inputBuffer;
+}
+
+void readInput(InputBuffer *inputBuffer) {
+    ssize_t bytesRead = getline(&(inputBuffer->buffer), &(inputBuffer->bufferLength), stdin);
+
+    if (bytesRead <= 0) {
+        printf("Error reading input\n");
+        exit(EXIT_FAILURE);
+    }
+
+    //Ignore trailing newline
+
+    inputBuffer->inputLength = bytesRead - 1;
+    inputBuffer->buffer[bytesRead - 1] = 0;
+}
+
+void batchInputOpen(BatchInput *input, int fileDescriptor) {
+    input->fileDescriptor = fileDescriptor;
+    input->start = 0;
+    input->end = 0;
+    input->endOfInput = false;
+
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && fileStat.st_size > 0) {
+        void *mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, fileStat.st_size, MADV_SEQUENTIAL);
+            input->data = mapping;
+            input->capacity = fileStat.st_size;
+            input->end = fileStat.st_size;
+            input->mapped = true;
+            input->endOfInput = true;
+            return;
+        }
+    }
+
+    input->data = malloc(BATCH_READ_SIZE);
+    input->capacity = BATCH_READ_SIZE;
+    input->mapped = false;
+}
+
+/*
+ * Refill the chunk buffer, keeping the unconsumed tail of the
+ * previous chunk. The buffer doubles when a single line fills it.
+ */
+void batchInputFill(BatchInput *input) {
+    if (input->start > 0) {
+        memmove(input->data, input->data + input->start, input->end - input->start);
+        input->end -= input->start;
+        input->start = 0;
+    }
+    if (input->end == input->capacity) {
+        input->capacity *= 2;
+        input->data = realloc(input->data, input->capacity);
+    }
+
+    ssize_t bytesRead;
+    do {
+        bytesRead = read(input->fileDescriptor, input->data + input->end, input->capacity - input->end);
+    } while (bytesRead == -1 && errno == EINTR);
+
+    if (bytesRead == -1) {
+        printf("Error reading input: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    if (bytesRead == 0) {
+        input->endOfInput = true;
+    }
+    input->end += bytesRead;
+}
+
+bool batchReadInput(BatchInput *input, InputBuffer *inputBuffer) {
+    while (true) {
+        char *lineStart = input->data + input->start;
+        char *newline = memchr(lineStart, '\n', input->end - input->start);
+
+        if (newline != NULL || (input->endOfInput && input->start < input->end)) {
+            size_t lineLength = (newline != NULL) ? (size_t) (newline - lineStart) : input->end - input->start;
+            inputBuffer->buffer = lineStart;
+            inputBuffer->inputLength = lineLength;
+            input->start += lineLength + (newline != NULL);
+            return true;
+        }
+        if (input->endOfInput) {
+            return false;
+        }
+        batchInputFill(input);
+    }
+}
+
+void batchInputClose(BatchInput *input) {
+    if (input->mapped) {
+        munmap(input->data, input->capacity);
+    } else {
+        free(input->data);
+    }
+}
+
+bool inputEquals(InputBuffer *inputBuffer, const char *text) {
+    size_t length = strlen(text);
+    return (size_t) inputBuffer->inputLength == length && memcmp(inputBuffer->buffer, text, length) == 0;
+}
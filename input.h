@@ -0,0 +1,43 @@
+#ifndef SQLCLONE_INPUT_H
+#define SQLCLONE_INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct {
+    char *buffer;
+    size_t bufferLength;
+    ssize_t inputLength;
+} InputBuffer;
+
+/*
+ * Statements read in batch mode. Scripts and redirected files are mapped
+ * whole; pipes are read in large chunks. Lines are handed out in place,
+ * so they are not NUL terminated and callers must honour inputLength.
+ */
+#define BATCH_READ_SIZE (1 << 20)
+
+typedef struct {
+    int fileDescriptor;
+    char *data;
+    size_t capacity;
+    size_t start;
+    size_t end;
+    bool mapped;
+    bool endOfInput;
+} BatchInput;
+
+InputBuffer* newInputBuffer();
+
+void readInput(InputBuffer *inputBuffer);
+
+void batchInputOpen(BatchInput *input, int fileDescriptor);
+
+bool batchReadInput(BatchInput *input, InputBuffer *inputBuffer);
+
+void batchInputClose(BatchInput *input);
+
+bool inputEquals(InputBuffer *inputBuffer, const char *text);
+
+#endif //SQLCLONE_INPUT_H
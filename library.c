@@ -1,7 +1,233 @@
 #include "library.h"
 
-#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-void hello(void) {
-    printf("Hello, World!\n");
-}
\ No newline at end of file
+#include "btree.h"
+#include "statement.h"
+#include "stats.h"
+
+struct SQLCloneDb {
+    Table *table;
+};
+
+struct SQLCloneStmt {
+    SQLCloneDb *db;
+    Statement statement;
+    /* Private copy of the statement text that the plan points into */
+    char *text;
+    // Holds the cursor of a select while it runs
+    Arena arena;
+    bool selectRunning;
+    Row row;
+    SQLCloneRow current;
+};
+
+struct SQLCloneCursor {
+    Cursor *cursor;
+    Row row;
+};
+
+void setRow(SQLCloneRow *row, Row *source) {
+    row->id = source->id;
+    row->username = source->username;
+    row->email = source->email;
+}
+
+SQLCloneResult sqlcloneOpen(const char *fileName, SQLCloneDb **db) {
+    return sqlcloneOpenWithPageSize(fileName, PAGER_DEFAULT_PAGE_SIZE, db);
+}
+
+SQLCloneResult sqlcloneOpenWithPageSize(const char *fileName, uint32_t pageSize, SQLCloneDb **db) {
+    if (!pagerValidPageSize(pageSize)) {
+        *db = NULL;
+        return SQLCLONE_CANT_OPEN;
+    }
+    Table *table = dbOpen(fileName, pageSize, &DEFAULT_FLUSH_OPTIONS);
+    if (table == NULL) {
+        *db = NULL;
+        return SQLCLONE_CANT_OPEN;
+    }
+
+    *db = malloc(sizeof(SQLCloneDb));
+    (*db)->table = table;
+    return SQLCLONE_OK;
+}
+
+void sqlcloneClose(SQLCloneDb *db) {
+    dbClose(db->table);
+    free(db);
+}
+
+uint64_t sqlcloneRowCount(SQLCloneDb *db) {
+    return tableRowCount(db->table);
+}
+
+SQLCloneResult sqlclonePrepare(SQLCloneDb *db, const char *text, size_t length, SQLCloneStmt **statement) {
+    SQLCloneStmt *prepared = malloc(sizeof(SQLCloneStmt));
+    prepared->db = db;
+    prepared->text = malloc(length + 1);
+    memcpy(prepared->text, text, length);
+    prepared->text[length] = 0;
+    prepared->selectRunning = false;
+    arenaInit(&(prepared->arena));
+
+    InputBuffer input = {prepared->text, 0, (ssize_t) length};
+    PrepareResult result = prepareStatement(&input, &(prepared->statement), &(prepared->arena));
+    if (result != PREPARE_SUCCESS) {
+        free(prepared->text);
+        free(prepared);
+        *statement = NULL;
+        return prepareResultCode(result);
+    }
+
+    *statement = prepared;
+    return SQLCLONE_OK;
+}
+
+SQLCloneResult sqlcloneBindInt(SQLCloneStmt *statement, uint32_t index, int64_t value) {
+    return bindResultCode(statementBindInt(&(statement->statement), index, value));
+}
+
+SQLCloneResult sqlcloneBindText(SQLCloneStmt *statement, uint32_t index, const char *text, size_t length) {
+    return bindResultCode(statementBindText(&(statement->statement), index, text, length));
+}
+
+void sqlcloneClearBindings(SQLCloneStmt *statement) {
+    statementClearBindings(&(statement->statement));
+}
+
+SQLCloneResult sqlcloneStep(SQLCloneStmt *statement) {
+    if (!statement->selectRunning) {
+        ExecuteResult result = executeStatement(&(statement->statement), statement->db->table);
+        if (result != EXECUTE_SUCCESS || statement->statement.type != STATEMENT_SELECT) {
+            return executeResultCode(result);
+        }
+        statement->selectRunning = true;
+    }
+
+    if (!statementNextRow(&(statement->statement), &(statement->row))) {
+        statement->selectRunning = false;
+        return SQLCLONE_DONE;
+    }
+    setRow(&(statement->current), &(statement->row));
+    return SQLCLONE_ROW;
+}
+
+const SQLCloneRow *sqlcloneStatementRow(SQLCloneStmt *statement) {
+    return &(statement->current);
+}
+
+uint64_t sqlcloneStatementCount(SQLCloneStmt *statement) {
+    return statement->statement.count;
+}
+
+void sqlcloneStatementVacuum(SQLCloneStmt *statement, SQLCloneVacuumStats *stats) {
+    VacuumStats *vacuum = &(statement->statement.vacuum);
+    stats->leavesVisited = vacuum->leavesVisited;
+    stats->pagesMoved = vacuum->pagesMoved;
+    stats->pagesFreed = vacuum->pagesFreed;
+    stats->passComplete = vacuum->passComplete;
+}
+
+void sqlcloneReset(SQLCloneStmt *statement) {
+    statementReset(&(statement->statement));
+    statement->selectRunning = false;
+}
+
+void sqlcloneFinalize(SQLCloneStmt *statement) {
+    if (statement == NULL) {
+        return;
+    }
+    statementReset(&(statement->statement));
+    arenaFree(&(statement->arena));
+    free(statement->text);
+    free(statement);
+}
+
+SQLCloneResult sqlcloneCursorOpen(SQLCloneDb *db, uint32_t startKey, SQLCloneCursor **cursor) {
+    uint64_t start = statsNanoseconds();
+    *cursor = malloc(sizeof(SQLCloneCursor));
+    (*cursor)->cursor = tableFind(db->table, startKey);
+    statsRecordLatency(LATENCY_POINT_SELECT, statsNanoseconds() - start);
+    return SQLCLONE_OK;
+}
+
+bool sqlcloneCursorNext(SQLCloneCursor *cursor, SQLCloneRow *row) {
+    if (cursor->cursor->endOfTable) {
+        return false;
+    }
+    cursorRow(cursor->cursor, &(cursor->row));
+    cursorAdvance(cursor->cursor);
+    setRow(row, &(cursor->row));
+    return true;
+}
+
+void sqlcloneCursorClose(SQLCloneCursor *cursor) {
+    cursorClose(cursor->cursor);
+    free(cursor);
+}
+
+void sqlcloneStats(SQLCloneStats *stats) {
+    uint64_t totals[STAT_COUNT];
+    statsCollect(totals);
+    stats->cacheHits = totals[STAT_CACHE_HITS];
+    stats->cacheMisses = totals[STAT_CACHE_MISSES];
+    stats->pagesRead = totals[STAT_PAGES_READ];
+    stats->pagesWritten = totals[STAT_PAGES_WRITTEN];
+    stats->bytesRead = totals[STAT_BYTES_READ];
+    stats->bytesWritten = totals[STAT_BYTES_WRITTEN];
+    stats->leafSplits = totals[STAT_LEAF_SPLITS];
+    stats->internalSplits = totals[STAT_INTERNAL_SPLITS];
+    stats->treeDescents = totals[STAT_TREE_DESCENTS];
+    stats->bytesDeserialized = totals[STAT_BYTES_DESERIALIZED];
+    stats->cursorsOpened = totals[STAT_CURSORS_OPENED];
+    stats->leavesSkipped = totals[STAT_LEAVES_SKIPPED];
+}
+
+void sqlcloneLatency(SQLCloneLatencyKind kind, SQLCloneLatency *latency) {
+    // The public kinds are in the same order as the engine's.
+    Histogram *histogram = statsLatency((LatencyKind) kind);
+    latency->count = atomic_load_explicit(&(histogram->total), memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&(histogram->sum), memory_order_relaxed);
+    latency->mean = latency->count == 0 ? 0 : sum / latency->count;
+    latency->p50 = histogramPercentile(histogram, 50);
+    latency->p90 = histogramPercentile(histogram, 90);
+    latency->p99 = histogramPercentile(histogram, 99);
+    latency->p999 = histogramPercentile(histogram, 99.9);
+    latency->max = histogramPercentile(histogram, 100);
+}
+
+const char *sqlcloneResultString(SQLCloneResult result) {
+    switch (result) {
+        case SQLCLONE_OK:
+            return "OK";
+        case SQLCLONE_ROW:
+            return "Row available";
+        case SQLCLONE_DONE:
+            return "Executed";
+        case SQLCLONE_CANT_OPEN:
+            return "Unable to open file";
+        case SQLCLONE_SYNTAX_ERROR:
+            return "Syntax error. Could not parse statement";
+        case SQLCLONE_UNRECOGNIZED_STATEMENT:
+            return "Unrecognized statement";
+        case SQLCLONE_NEGATIVE_ID:
+            return "ID must be positive";
+        case SQLCLONE_ID_TOO_LARGE:
+            return "ID is too large";
+        case SQLCLONE_STRING_TOO_LONG:
+            return "String is too long";
+        case SQLCLONE_RANGE:
+            return "Parameter index or value out of range";
+        case SQLCLONE_TYPE_MISMATCH:
+            return "Parameter type mismatch";
+        case SQLCLONE_UNBOUND_PARAMETER:
+            return "Statement has unbound parameters";
+        case SQLCLONE_DUPLICATE_KEY:
+            return "Duplicate key";
+        case SQLCLONE_TABLE_FULL:
+            return "Table full";
+    }
+    return "Unknown result";
+}
@@ -1,6 +1,163 @@
 #ifndef SQLCLONE_LIBRARY_H
 #define SQLCLONE_LIBRARY_H
 
-void hello(void);
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Embeddable interface to the SQLClone engine. A database is opened
+ * once per process; statements are prepared once and then bound and
+ * stepped as often as needed, and cursors iterate the table in key
+ * order without going through statement text at all.
+ *
+ * I/O errors on the database file are still fatal to the process.
+ */
+typedef struct SQLCloneDb SQLCloneDb;
+typedef struct SQLCloneStmt SQLCloneStmt;
+typedef struct SQLCloneCursor SQLCloneCursor;
+
+typedef enum {
+    SQLCLONE_OK,
+    SQLCLONE_ROW,
+    SQLCLONE_DONE,
+    SQLCLONE_CANT_OPEN,
+    SQLCLONE_SYNTAX_ERROR,
+    SQLCLONE_UNRECOGNIZED_STATEMENT,
+    SQLCLONE_NEGATIVE_ID,
+    SQLCLONE_ID_TOO_LARGE,
+    SQLCLONE_STRING_TOO_LONG,
+    SQLCLONE_RANGE,
+    SQLCLONE_TYPE_MISMATCH,
+    SQLCLONE_UNBOUND_PARAMETER,
+    SQLCLONE_DUPLICATE_KEY,
+    SQLCLONE_TABLE_FULL
+} SQLCloneResult;
+
+/*
+ * A row returned by a statement or cursor. The strings are owned by
+ * the statement or cursor and stay valid until its next step.
+ */
+typedef struct {
+    uint32_t id;
+    const char *username;
+    const char *email;
+} SQLCloneRow;
+
+/* Engine counters, summed over every thread since the process started */
+typedef struct {
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+    uint64_t pagesRead;
+    uint64_t pagesWritten;
+    // Bytes moved to and from the file, which is less than whole pages in a compressed one
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t leafSplits;
+    uint64_t internalSplits;
+    uint64_t treeDescents;
+    uint64_t bytesDeserialized;
+    uint64_t cursorsOpened;
+    // Leaves a filtered select passed over without looking at a row
+    uint64_t leavesSkipped;
+} SQLCloneStats;
+
+typedef enum {
+    SQLCLONE_LATENCY_INSERT,
+    SQLCLONE_LATENCY_POINT_SELECT,
+    SQLCLONE_LATENCY_SCAN,
+    SQLCLONE_LATENCY_COUNT,
+    SQLCLONE_LATENCY_VACUUM
+} SQLCloneLatencyKind;
+
+/* What a vacuum statement did, once it has been stepped to SQLCLONE_DONE */
+typedef struct {
+    uint32_t leavesVisited;
+    uint32_t pagesMoved;
+    uint32_t pagesFreed;
+    // The pass is over; a caller stepping "vacuum <n>" online can stop here
+    bool passComplete;
+} SQLCloneVacuumStats;
+
+/*
+ * Statement latencies in nanoseconds, since the process started. Each
+ * percentile is accurate to about 3%. Point selects are cursor opens.
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} SQLCloneLatency;
+
+SQLCloneResult sqlcloneOpen(const char *fileName, SQLCloneDb **db);
+
+/*
+ * As sqlcloneOpen, but a database created by this call gets the given
+ * page size: a power of two from 4096 to 65536. Existing databases keep
+ * the page size they were created with.
+ */
+SQLCloneResult sqlcloneOpenWithPageSize(const char *fileName, uint32_t pageSize, SQLCloneDb **db);
+
+/* Writes the pages still dirty back to the file and closes it. */
+void sqlcloneClose(SQLCloneDb *db);
+
+/* Instant: the row count is kept in the file header. */
+uint64_t sqlcloneRowCount(SQLCloneDb *db);
+
+/*
+ * Statements use the shell syntax: "insert <id> <username> <email>",
+ * "select" or "select count(*)", either optionally followed by
+ * "where <username|email> = <value>" or "where <username|email> like
+ * %<suffix>", and "vacuum [<leaves>]". Any insert field, and the value
+ * or suffix of a where clause, may be '?' and bound before stepping.
+ */
+SQLCloneResult sqlclonePrepare(SQLCloneDb *db, const char *text, size_t length, SQLCloneStmt **statement);
+
+/*
+ * Parameters are numbered from 1. Bound text is not copied: it must
+ * stay valid until the statement has been stepped.
+ */
+SQLCloneResult sqlcloneBindInt(SQLCloneStmt *statement, uint32_t index, int64_t value);
+
+SQLCloneResult sqlcloneBindText(SQLCloneStmt *statement, uint32_t index, const char *text, size_t length);
+
+void sqlcloneClearBindings(SQLCloneStmt *statement);
+
+/*
+ * Returns SQLCLONE_ROW for every row of a select and SQLCLONE_DONE once
+ * the statement has finished, after which it can be stepped again.
+ */
+SQLCloneResult sqlcloneStep(SQLCloneStmt *statement);
+
+const SQLCloneRow *sqlcloneStatementRow(SQLCloneStmt *statement);
+
+/* The result of a count, once it has been stepped to SQLCLONE_DONE. */
+uint64_t sqlcloneStatementCount(SQLCloneStmt *statement);
+
+void sqlcloneStatementVacuum(SQLCloneStmt *statement, SQLCloneVacuumStats *stats);
+
+/* Abandon a select part way through. Bindings are kept. */
+void sqlcloneReset(SQLCloneStmt *statement);
+
+void sqlcloneFinalize(SQLCloneStmt *statement);
+
+/*
+ * Iterate rows in key order starting from the first id >= startKey.
+ */
+SQLCloneResult sqlcloneCursorOpen(SQLCloneDb *db, uint32_t startKey, SQLCloneCursor **cursor);
+
+bool sqlcloneCursorNext(SQLCloneCursor *cursor, SQLCloneRow *row);
+
+void sqlcloneCursorClose(SQLCloneCursor *cursor);
+
+void sqlcloneStats(SQLCloneStats *stats);
+
+void sqlcloneLatency(SQLCloneLatencyKind kind, SQLCloneLatency *latency);
+
+const char *sqlcloneResultString(SQLCloneResult result);
 
 #endif //SQLCLONE_LIBRARY_H
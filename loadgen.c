@@ -0,0 +1,315 @@
+//
+// Load generator for SQLCloneExp --serve. Keeps a fixed number of
+// pipelined requests in flight on every connection and reports the
+// throughput and latency distribution of the replies.
+//
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "library.h"
+#include "output.h"
+#include "server.h"
+
+#define LOAD_READ_SIZE (64 * 1024)
+
+typedef enum {
+    WORKLOAD_INSERT,
+    WORKLOAD_SELECT
+} Workload;
+
+typedef struct {
+    int fileDescriptor;
+    OutputBuffer requests;
+    size_t requestsSent;
+    OutputBuffer replies;
+    // Send times of the requests in flight, oldest first, as a ring.
+    uint64_t *sendTimes;
+    uint32_t oldest;
+    uint32_t inFlight;
+    uint64_t issued;
+    uint64_t quota;
+    uint32_t nextId;
+    uint32_t events;
+} Client;
+
+typedef struct {
+    Workload workload;
+    uint32_t pipeline;
+    uint64_t completed;
+    uint64_t errors;
+    SQLCloneResult firstError;
+    uint64_t *latencies;
+} LoadRun;
+
+uint64_t nowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+int compareLatencies(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *) a, right = *(const uint64_t *) b;
+    return (left > right) - (left < right);
+}
+
+double percentileMicroseconds(uint64_t *sorted, uint64_t count, double percentile) {
+    uint64_t index = (uint64_t) (percentile / 100 * (count - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+void clientQueueRequests(LoadRun *run, Client *client) {
+    while (client->inFlight < run->pipeline && client->issued < client->quota) {
+        size_t frameStart = client->requests.length;
+        outputReserve(&(client->requests), SERVER_FRAME_HEADER_SIZE);
+        client->requests.length += SERVER_FRAME_HEADER_SIZE;
+        if (run->workload == WORKLOAD_INSERT) {
+            uint32_t id = client->nextId++;
+            outputFormat(&(client->requests), "insert %u user%u person%u@example.com", id, id, id);
+        } else {
+            outputString(&(client->requests), "select");
+        }
+        formatLittleEndian(client->requests.data + frameStart,
+                           client->requests.length - frameStart - SERVER_FRAME_HEADER_SIZE, SERVER_FRAME_HEADER_SIZE);
+
+        client->sendTimes[(client->oldest + client->inFlight) % run->pipeline] = nowNanoseconds();
+        client->inFlight++;
+        client->issued++;
+    }
+}
+
+/* Returns false if the connection failed. */
+bool clientSend(Client *client) {
+    OutputBuffer *requests = &(client->requests);
+    while (client->requestsSent < requests->length) {
+        ssize_t result = send(client->fileDescriptor, requests->data + client->requestsSent,
+                              requests->length - client->requestsSent, MSG_NOSIGNAL);
+        if (result >= 0) {
+            client->requestsSent += result;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+    requests->length = 0;
+    client->requestsSent = 0;
+    return true;
+}
+
+void clientCompleteReplies(LoadRun *run, Client *client) {
+    OutputBuffer *replies = &(client->replies);
+    size_t position = 0;
+    uint64_t now = nowNanoseconds();
+
+    while (replies->length - position >= SERVER_FRAME_HEADER_SIZE + 1) {
+        uint32_t length = parseLittleEndian(replies->data + position, SERVER_FRAME_HEADER_SIZE);
+        if (replies->length - position < SERVER_FRAME_HEADER_SIZE + length) {
+            break;
+        }
+        SQLCloneResult result = (SQLCloneResult) (unsigned char) replies->data[position + SERVER_FRAME_HEADER_SIZE];
+        if (result != SQLCLONE_DONE) {
+            if (run->errors++ == 0) {
+                run->firstError = result;
+            }
+        }
+
+        run->latencies[run->completed++] = now - client->sendTimes[client->oldest];
+        client->oldest = (client->oldest + 1) % run->pipeline;
+        client->inFlight--;
+        position += SERVER_FRAME_HEADER_SIZE + length;
+    }
+
+    memmove(replies->data, replies->data + position, replies->length - position);
+    replies->length -= position;
+}
+
+/* Returns false if the server closed the connection or it failed. */
+bool clientReceive(Client *client) {
+    while (true) {
+        char *destination = outputReserve(&(client->replies), LOAD_READ_SIZE);
+        ssize_t result = read(client->fileDescriptor, destination, LOAD_READ_SIZE);
+        if (result > 0) {
+            client->replies.length += result;
+        } else if (result == 0) {
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+int clientConnect(const char *address) {
+    struct sockaddr_storage socketAddress;
+    socklen_t length;
+    if (!serverParseAddress(address, &socketAddress, &length)) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fileDescriptor = socket(socketAddress.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fileDescriptor == -1) {
+        return -1;
+    }
+    if (connect(fileDescriptor, (struct sockaddr *) &socketAddress, length) == -1) {
+        int error = errno;
+        close(fileDescriptor);
+        errno = error;
+        return -1;
+    }
+    return fileDescriptor;
+}
+
+void printUsage() {
+    printf("Usage: SQLCloneLoad [--connections=N] [--requests=N] [--pipeline=N] [--workload=insert|select]\n"
+           "                    [--start-id=N] <unix:<path>|[host:]port>\n");
+}
+
+bool parseCount(const char *argument, const char *prefix, uint64_t *value) {
+    size_t prefixLength = strlen(prefix);
+    if (strncmp(argument, prefix, prefixLength) != 0) {
+        return false;
+    }
+    char *end;
+    unsigned long long parsed = strtoull(argument + prefixLength, &end, 10);
+    if (argument[prefixLength] == 0 || *end != 0 || parsed == 0 || parsed > UINT32_MAX) {
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+    *value = parsed;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t connections = 4, requests = 1000, pipeline = 16, startId = 1;
+    LoadRun run = {WORKLOAD_INSERT};
+    const char *address = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (parseCount(argv[i], "--connections=", &connections) ||
+            parseCount(argv[i], "--requests=", &requests) ||
+            parseCount(argv[i], "--pipeline=", &pipeline) ||
+            parseCount(argv[i], "--start-id=", &startId)) {
+            continue;
+        } else if (strcmp(argv[i], "--workload=insert") == 0) {
+            run.workload = WORKLOAD_INSERT;
+        } else if (strcmp(argv[i], "--workload=select") == 0) {
+            run.workload = WORKLOAD_SELECT;
+        } else if (address == NULL) {
+            address = argv[i];
+        } else {
+            printUsage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (address == NULL) {
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+    if (connections > requests) {
+        connections = requests;
+    }
+    run.pipeline = (uint32_t) pipeline;
+    run.latencies = malloc(requests * sizeof(uint64_t));
+
+    int epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    Client *clients = calloc(connections, sizeof(Client));
+    uint32_t nextId = (uint32_t) startId;
+
+    for (uint64_t i = 0; i < connections; i++) {
+        Client *client = &clients[i];
+        client->fileDescriptor = clientConnect(address);
+        if (client->fileDescriptor == -1) {
+            printf("Unable to connect to %s: %s\n", address, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        // Connect blocking, then switch so one slow client can't stall the rest.
+        fcntl(client->fileDescriptor, F_SETFL, fcntl(client->fileDescriptor, F_GETFL) | O_NONBLOCK);
+
+        outputInit(&(client->requests), -1, LOAD_READ_SIZE);
+        outputInit(&(client->replies), -1, LOAD_READ_SIZE);
+        client->sendTimes = malloc(pipeline * sizeof(uint64_t));
+        client->quota = requests / connections + (i < requests % connections);
+        client->nextId = nextId;
+        nextId += (uint32_t) client->quota;
+        client->events = EPOLLIN;
+
+        struct epoll_event event = {.events = client->events, .data.ptr = client};
+        epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, client->fileDescriptor, &event);
+    }
+
+    uint64_t startTime = nowNanoseconds();
+    for (uint64_t i = 0; i < connections; i++) {
+        clientQueueRequests(&run, &clients[i]);
+        clientSend(&clients[i]);
+    }
+
+    struct epoll_event events[64];
+    while (run.completed < requests) {
+        int count = epoll_wait(epollFileDescriptor, events, 64, -1);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("epoll_wait failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < count; i++) {
+            Client *client = events[i].data.ptr;
+            if ((events[i].events & EPOLLIN) && !clientReceive(client)) {
+                printf("Server closed the connection.\n");
+                exit(EXIT_FAILURE);
+            }
+            clientCompleteReplies(&run, client);
+            clientQueueRequests(&run, client);
+            if (!clientSend(client)) {
+                printf("Send failed: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+
+            uint32_t wanted = EPOLLIN | (client->requestsSent < client->requests.length ? EPOLLOUT : 0);
+            if (wanted != client->events) {
+                client->events = wanted;
+                struct epoll_event event = {.events = wanted, .data.ptr = client};
+                epoll_ctl(epollFileDescriptor, EPOLL_CTL_MOD, client->fileDescriptor, &event);
+            }
+        }
+    }
+    double seconds = (nowNanoseconds() - startTime) / 1e9;
+
+    qsort(run.latencies, run.completed, sizeof(uint64_t), compareLatencies);
+    printf("%llu requests over %llu connections (pipeline %u) in %.3f s: %.0f requests/s\n",
+           (unsigned long long) run.completed, (unsigned long long) connections, run.pipeline, seconds,
+           run.completed / seconds);
+    printf("Latency (us): p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           percentileMicroseconds(run.latencies, run.completed, 50),
+           percentileMicroseconds(run.latencies, run.completed, 90),
+           percentileMicroseconds(run.latencies, run.completed, 99),
+           percentileMicroseconds(run.latencies, run.completed, 99.9),
+           run.latencies[run.completed - 1] / 1000.0);
+    if (run.errors > 0) {
+        printf("%llu errors, first: %s\n", (unsigned long long) run.errors, sqlcloneResultString(run.firstError));
+    } else {
+        printf("0 errors\n");
+    }
+
+    for (uint64_t i = 0; i < connections; i++) {
+        close(clients[i].fileDescriptor);
+        free(clients[i].requests.data);
+        free(clients[i].replies.data);
+        free(clients[i].sendTimes);
+    }
+    free(clients);
+    free(run.latencies);
+    close(epollFileDescriptor);
+    return run.errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
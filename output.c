@@ -0,0 +1,347 @@
+#include "output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+
+void outputInit(OutputBuffer *output, int fileDescriptor, size_t capacity) {
+    output->fileDescriptor = fileDescriptor;
+    output->data = malloc(capacity);
+    output->capacity = capacity;
+    output->length = 0;
+}
+
+/* Write all of data, carrying on after short writes and interrupts. */
+void outputWriteAll(OutputBuffer *output, const char *data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = write(output->fileDescriptor, data + written, length - written);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nothing sensible left to report to; drop the output.
+            break;
+        }
+        written += result;
+    }
+}
+
+void outputFlush(OutputBuffer *output) {
+    outputWriteAll(output, output->data, output->length);
+    output->length = 0;
+}
+
+/*
+ * Buffers without a file descriptor collect a whole reply in memory,
+ * so they grow where a file buffer would flush.
+ */
+void outputGrow(OutputBuffer *output, size_t length) {
+    size_t capacity = output->capacity ? output->capacity : 4096;
+    while (capacity < output->length + length) {
+        capacity *= 2;
+    }
+    output->data = realloc(output->data, capacity);
+    output->capacity = capacity;
+}
+
+void outputWrite(OutputBuffer *output, const void *data, size_t length) {
+    if (output->length + length > output->capacity) {
+        if (output->fileDescriptor == -1) {
+            outputGrow(output, length);
+            memcpy(output->data + output->length, data, length);
+            output->length += length;
+            return;
+        }
+        outputFlush(output);
+        if (length > output->capacity) {
+            outputWriteAll(output, data, length);
+            return;
+        }
+    }
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+}
+
+void outputString(OutputBuffer *output, const char *string) {
+    outputWrite(output, string, strlen(string));
+}
+
+void outputFormat(OutputBuffer *output, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t available = output->capacity - output->length;
+    int length = vsnprintf(output->data + output->length, available, format, args);
+    va_end(args);
+
+    if (length < 0) {
+        return;
+    }
+    if ((size_t) length >= available && output->fileDescriptor == -1) {
+        outputGrow(output, length + 1);
+        va_start(args, format);
+        vsnprintf(output->data + output->length, output->capacity - output->length, format, args);
+        va_end(args);
+    } else if ((size_t) length >= available) {
+        outputFlush(output);
+        va_start(args, format);
+        length = vsnprintf(output->data, output->capacity, format, args);
+        va_end(args);
+        if ((size_t) length >= output->capacity) {
+            length = output->capacity - 1;
+        }
+    }
+    output->length += length;
+}
+
+/*
+ * Make sure at least `length` bytes can be appended without flushing
+ * and return where they go. `length` must not exceed the capacity
+ * of a file buffer.
+ */
+char *outputReserve(OutputBuffer *output, size_t length) {
+    if (output->length + length > output->capacity) {
+        if (output->fileDescriptor == -1) {
+            outputGrow(output, length);
+        } else {
+            outputFlush(output);
+        }
+    }
+    return output->data + output->length;
+}
+
+char *formatUint32(char *destination, uint32_t value) {
+    char digits[10];
+    uint32_t count = 0;
+    do {
+        digits[count++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0) {
+        *destination++ = digits[--count];
+    }
+    return destination;
+}
+
+char *formatUint64(char *destination, uint64_t value) {
+    char digits[20];
+    uint32_t count = 0;
+    do {
+        digits[count++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0) {
+        *destination++ = digits[--count];
+    }
+    return destination;
+}
+
+char *formatBytes(char *destination, const char *source, size_t length) {
+    memcpy(destination, source, length);
+    return destination + length;
+}
+
+char *formatCsvField(char *destination, const char *field, size_t length) {
+    bool needsQuotes = false;
+    for (size_t i = 0; i < length; i++) {
+        char c = field[i];
+        needsQuotes |= (c == ',' || c == '"' || c == '\r' || c == '\n');
+    }
+    if (!needsQuotes) {
+        return formatBytes(destination, field, length);
+    }
+    *destination++ = '"';
+    for (size_t i = 0; i < length; i++) {
+        if (field[i] == '"') {
+            *destination++ = '"';
+        }
+        *destination++ = field[i];
+    }
+    *destination++ = '"';
+    return destination;
+}
+
+char *formatTsvField(char *destination, const char *field, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        switch (field[i]) {
+            case '\t':
+                *destination++ = '\\';
+                *destination++ = 't';
+                break;
+            case '\n':
+                *destination++ = '\\';
+                *destination++ = 'n';
+                break;
+            case '\\':
+                *destination++ = '\\';
+                *destination++ = '\\';
+                break;
+            default:
+                *destination++ = field[i];
+        }
+    }
+    return destination;
+}
+
+char *formatJsonString(char *destination, const char *field, size_t length) {
+    static const char hexDigits[] = "0123456789abcdef";
+
+    *destination++ = '"';
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = field[i];
+        if (c == '"' || c == '\\') {
+            *destination++ = '\\';
+            *destination++ = (char) c;
+        } else if (c < 0x20) {
+            destination = formatBytes(destination, "\\u00", 4);
+            *destination++ = hexDigits[c >> 4];
+            *destination++ = hexDigits[c & 0xf];
+        } else {
+            *destination++ = (char) c;
+        }
+    }
+    *destination++ = '"';
+    return destination;
+}
+
+/*
+ * Binary rows are frames of a little-endian uint16 payload length
+ * followed by the payload: uint32 id, uint8 username length, username
+ * bytes, uint8 email length, email bytes. A zero-length frame ends
+ * each result set.
+ */
+char *formatLittleEndian(char *destination, uint32_t value, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        *destination++ = (char) (value >> (8 * i));
+    }
+    return destination;
+}
+
+uint32_t parseLittleEndian(const char *source, uint32_t size) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        value |= (uint32_t) (unsigned char) source[i] << (8 * i);
+    }
+    return value;
+}
+
+/* Worst case is JSON, where every string byte may expand to \u00XX */
+#define ROW_FORMAT_MAX_LENGTH (64 + 6 * (COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE))
+
+void formatRow(OutputBuffer *output, OutputFormat format, Row *row) {
+    size_t usernameLength = strnlen(row->username, COLUMN_USERNAME_SIZE);
+    size_t emailLength = strnlen(row->email, COLUMN_EMAIL_SIZE);
+    char *start = outputReserve(output, ROW_FORMAT_MAX_LENGTH);
+    char *end = start;
+
+    switch (format) {
+        case OUTPUT_TEXT:
+            *end++ = '(';
+            end = formatUint32(end, row->id);
+            end = formatBytes(end, ", ", 2);
+            end = formatBytes(end, row->username, usernameLength);
+            end = formatBytes(end, ", ", 2);
+            end = formatBytes(end, row->email, emailLength);
+            end = formatBytes(end, ")\n", 2);
+            break;
+        case OUTPUT_CSV:
+            end = formatUint32(end, row->id);
+            *end++ = ',';
+            end = formatCsvField(end, row->username, usernameLength);
+            *end++ = ',';
+            end = formatCsvField(end, row->email, emailLength);
+            *end++ = '\n';
+            break;
+        case OUTPUT_TSV:
+            end = formatUint32(end, row->id);
+            *end++ = '\t';
+            end = formatTsvField(end, row->username, usernameLength);
+            *end++ = '\t';
+            end = formatTsvField(end, row->email, emailLength);
+            *end++ = '\n';
+            break;
+        case OUTPUT_JSON:
+            end = formatBytes(end, "{\"id\":", 6);
+            end = formatUint32(end, row->id);
+            end = formatBytes(end, ",\"username\":", 12);
+            end = formatJsonString(end, row->username, usernameLength);
+            end = formatBytes(end, ",\"email\":", 9);
+            end = formatJsonString(end, row->email, emailLength);
+            end = formatBytes(end, "}\n", 2);
+            break;
+        case OUTPUT_BINARY:
+            end = formatLittleEndian(end, sizeof(row->id) + 2 + usernameLength + emailLength, 2);
+            end = formatLittleEndian(end, row->id, sizeof(row->id));
+            *end++ = (char) usernameLength;
+            end = formatBytes(end, row->username, usernameLength);
+            *end++ = (char) emailLength;
+            end = formatBytes(end, row->email, emailLength);
+            break;
+    }
+
+    output->length += end - start;
+}
+
+/* A count is a result of one row with one column. */
+void formatCount(OutputBuffer *output, OutputFormat format, uint64_t count) {
+    char *start = outputReserve(output, 64);
+    char *end = start;
+
+    switch (format) {
+        case OUTPUT_TEXT:
+            *end++ = '(';
+            end = formatUint64(end, count);
+            end = formatBytes(end, ")\n", 2);
+            break;
+        case OUTPUT_CSV:
+        case OUTPUT_TSV:
+            end = formatUint64(end, count);
+            *end++ = '\n';
+            break;
+        case OUTPUT_JSON:
+            end = formatBytes(end, "{\"count\":", 9);
+            end = formatUint64(end, count);
+            end = formatBytes(end, "}\n", 2);
+            break;
+        case OUTPUT_BINARY:
+            end = formatLittleEndian(end, sizeof(count), 2);
+            end = formatLittleEndian(end, (uint32_t) count, 4);
+            end = formatLittleEndian(end, (uint32_t) (count >> 32), 4);
+            break;
+    }
+
+    output->length += end - start;
+}
+
+void formatResultEnd(OutputBuffer *output, OutputFormat format) {
+    if (format == OUTPUT_BINARY) {
+        char *end = formatLittleEndian(outputReserve(output, 2), 0, 2);
+        output->length = end - output->data;
+    }
+}
+
+bool parseOutputFormat(const char *name, size_t length, OutputFormat *format) {
+    static const struct {
+        const char *name;
+        OutputFormat format;
+    } formats[] = {
+            {"text",   OUTPUT_TEXT},
+            {"csv",    OUTPUT_CSV},
+            {"tsv",    OUTPUT_TSV},
+            {"json",   OUTPUT_JSON},
+            {"binary", OUTPUT_BINARY},
+    };
+
+    for (uint32_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (strlen(formats[i].name) == length && memcmp(formats[i].name, name, length) == 0) {
+            *format = formats[i].format;
+            return true;
+        }
+    }
+    return false;
+}
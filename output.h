@@ -0,0 +1,68 @@
+#ifndef SQLCLONE_OUTPUT_H
+#define SQLCLONE_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+/*
+ * Results are collected here and written with one write() per buffer.
+ * Interactive sessions flush after every statement, batch sessions
+ * only when the buffer fills up or the program exits.
+ */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+    int fileDescriptor;
+    char *data;
+    size_t capacity;
+    size_t length;
+} OutputBuffer;
+
+typedef enum {
+    OUTPUT_TEXT,
+    OUTPUT_CSV,
+    OUTPUT_TSV,
+    OUTPUT_JSON,
+    OUTPUT_BINARY
+} OutputFormat;
+
+/* A fileDescriptor of -1 makes an in-memory buffer that grows as needed. */
+void outputInit(OutputBuffer *output, int fileDescriptor, size_t capacity);
+
+void outputFlush(OutputBuffer *output);
+
+void outputWrite(OutputBuffer *output, const void *data, size_t length);
+
+void outputString(OutputBuffer *output, const char *string);
+
+void outputFormat(OutputBuffer *output, const char *format, ...);
+
+char *outputReserve(OutputBuffer *output, size_t length);
+
+/*
+ * Formatters write at destination and return the new end. Callers
+ * reserve enough room in the output buffer first.
+ */
+char *formatUint32(char *destination, uint32_t value);
+
+char *formatUint64(char *destination, uint64_t value);
+
+char *formatBytes(char *destination, const char *source, size_t length);
+
+char *formatLittleEndian(char *destination, uint32_t value, uint32_t size);
+
+uint32_t parseLittleEndian(const char *source, uint32_t size);
+
+void formatRow(OutputBuffer *output, OutputFormat format, Row *row);
+
+/* In binary, the frame holds the count as 8 little-endian bytes. */
+void formatCount(OutputBuffer *output, OutputFormat format, uint64_t count);
+
+void formatResultEnd(OutputBuffer *output, OutputFormat format);
+
+bool parseOutputFormat(const char *name, size_t length, OutputFormat *format);
+
+#endif //SQLCLONE_OUTPUT_H
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+
+#include "pageio.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+ * There is no liburing here, so the rings are set up and driven with the
+ * raw system calls: the kernel shares a submission and a completion
+ * ring with us, we append entries at the submission tail and consume
+ * them at the completion head.
+ */
+bool pageIoRingOpen(PageIo *io) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring = (int) syscall(__NR_io_uring_setup, PAGE_IO_QUEUE_DEPTH, &params);
+    if (ring == -1) {
+        return false;
+    }
+    // IORING_OP_READ and IORING_OP_WRITE came with this feature (Linux 5.6).
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring);
+        return false;
+    }
+
+    io->entries = params.sq_entries;
+    io->submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    io->completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->completionRingSize > io->submissionRingSize) {
+            io->submissionRingSize = io->completionRingSize;
+        }
+        io->completionRingSize = io->submissionRingSize;
+    }
+
+    io->submissionRing = mmap(NULL, io->submissionRingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (io->submissionRing == MAP_FAILED) {
+        close(ring);
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        io->completionRing = io->submissionRing;
+    } else {
+        io->completionRing = mmap(NULL, io->completionRingSize, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+        if (io->completionRing == MAP_FAILED) {
+            munmap(io->submissionRing, io->submissionRingSize);
+            close(ring);
+            return false;
+        }
+    }
+    io->submissionEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    io->submissionEntries = mmap(NULL, io->submissionEntriesSize, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (io->submissionEntries == MAP_FAILED) {
+        if (io->completionRing != io->submissionRing) {
+            munmap(io->completionRing, io->completionRingSize);
+        }
+        munmap(io->submissionRing, io->submissionRingSize);
+        close(ring);
+        return false;
+    }
+
+    char *submission = io->submissionRing;
+    io->submissionTail = (uint32_t *) (submission + params.sq_off.tail);
+    io->submissionMask = (uint32_t *) (submission + params.sq_off.ring_mask);
+    io->submissionArray = (uint32_t *) (submission + params.sq_off.array);
+    char *completion = io->completionRing;
+    io->completionHead = (uint32_t *) (completion + params.cq_off.head);
+    io->completionTail = (uint32_t *) (completion + params.cq_off.tail);
+    io->completionMask = (uint32_t *) (completion + params.cq_off.ring_mask);
+    io->completionEntries = (struct io_uring_cqe *) (completion + params.cq_off.cqes);
+    io->ringFileDescriptor = ring;
+    return true;
+}
+
+void pageIoOpen(PageIo *io, int fileDescriptor) {
+    io->fileDescriptor = fileDescriptor;
+    pthread_mutex_init(&(io->lock), NULL);
+    io->ringFileDescriptor = -1;
+
+    const char *mode = getenv("SQLCLONE_IO");
+    io->uring = !(mode != NULL && strcmp(mode, "sync") == 0) && pageIoRingOpen(io);
+}
+
+void pageIoClose(PageIo *io) {
+    if (io->ringFileDescriptor != -1) {
+        munmap(io->submissionEntries, io->submissionEntriesSize);
+        if (io->completionRing != io->submissionRing) {
+            munmap(io->completionRing, io->completionRingSize);
+        }
+        munmap(io->submissionRing, io->submissionRingSize);
+        close(io->ringFileDescriptor);
+    }
+    pthread_mutex_destroy(&(io->lock));
+}
+
+/* Transfer whatever the request still needs with plain system calls. */
+void pageIoFinishSync(PageIo *io, PageIoRequest *request, bool write, size_t done) {
+    size_t length = request->length;
+    off_t offset = (off_t) request->offset;
+    while (done < length) {
+        ssize_t result = write
+                ? pwrite(io->fileDescriptor, (char *) request->buffer + done, length - done, offset + done)
+                : pread(io->fileDescriptor, (char *) request->buffer + done, length - done, offset + done);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            // A read past the end of the file comes back short.
+            request->result = result == -1 ? -errno : (ssize_t) done;
+            return;
+        }
+        done += result;
+    }
+    request->result = (ssize_t) length;
+}
+
+void pageIoSubmitRing(PageIo *io, PageIoRequest *requests, uint32_t count, bool write,
+                      PageIoCompletion complete, void *context) {
+    _Atomic uint32_t *submissionTail = (_Atomic uint32_t *) io->submissionTail;
+    _Atomic uint32_t *completionHead = (_Atomic uint32_t *) io->completionHead;
+    _Atomic uint32_t *completionTail = (_Atomic uint32_t *) io->completionTail;
+
+    uint32_t submitted = 0;
+    uint32_t inFlight = 0;
+    uint32_t completed = 0;
+    while (completed < count) {
+        if (!io->uring && inFlight == 0) {
+            // The ring went bad: finish the rest synchronously.
+            for (; submitted < count; submitted++, completed++) {
+                pageIoFinishSync(io, &requests[submitted], write, 0);
+                if (complete != NULL) {
+                    complete(&requests[submitted], context);
+                }
+            }
+            break;
+        }
+
+        // Fill the submission ring as far as the queue depth allows.
+        uint32_t toSubmit = 0;
+        uint32_t tail = atomic_load_explicit(submissionTail, memory_order_relaxed);
+        while (io->uring && submitted < count && inFlight + toSubmit < io->entries) {
+            PageIoRequest *request = &requests[submitted];
+            uint32_t index = tail & *io->submissionMask;
+            struct io_uring_sqe *entry = &(io->submissionEntries[index]);
+            memset(entry, 0, sizeof(*entry));
+            entry->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+            entry->fd = io->fileDescriptor;
+            entry->addr = (uint64_t) (uintptr_t) request->buffer;
+            entry->len = request->length;
+            entry->off = request->offset;
+            entry->user_data = submitted;
+            io->submissionArray[index] = index;
+            tail++;
+            submitted++;
+            toSubmit++;
+        }
+        atomic_store_explicit(submissionTail, tail, memory_order_release);
+
+        uint32_t waitFor = (inFlight + toSubmit > 0) ? 1 : 0;
+        int result = (int) syscall(__NR_io_uring_enter, io->ringFileDescriptor, toSubmit, waitFor,
+                                   IORING_ENTER_GETEVENTS, NULL, 0);
+        if (result == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            // Stop using the ring once what is already in flight is back.
+            io->uring = false;
+        }
+        // Take back whatever the kernel did not accept; it goes again next time.
+        uint32_t accepted = result > 0 ? (uint32_t) result : 0;
+        if (accepted < toSubmit) {
+            submitted -= toSubmit - accepted;
+            atomic_store_explicit(submissionTail, tail - (toSubmit - accepted), memory_order_release);
+        }
+        inFlight += accepted;
+
+        uint32_t head = atomic_load_explicit(completionHead, memory_order_relaxed);
+        uint32_t available = atomic_load_explicit(completionTail, memory_order_acquire);
+        while (head != available) {
+            struct io_uring_cqe *entry = &(io->completionEntries[head & *io->completionMask]);
+            PageIoRequest *request = &requests[entry->user_data];
+            int32_t transferred = entry->res;
+            head++;
+            atomic_store_explicit(completionHead, head, memory_order_release);
+            inFlight--;
+
+            if (transferred == -EINVAL || transferred == -EOPNOTSUPP || transferred == -EAGAIN) {
+                // The kernel can't do this one asynchronously after all.
+                pageIoFinishSync(io, request, write, 0);
+            } else if (transferred < 0) {
+                request->result = transferred;
+            } else {
+                pageIoFinishSync(io, request, write, (size_t) transferred);
+            }
+            completed++;
+            if (complete != NULL) {
+                complete(request, context);
+            }
+        }
+    }
+}
+
+void pageIoSubmit(PageIo *io, PageIoRequest *requests, uint32_t count, bool write,
+                  PageIoCompletion complete, void *context) {
+    pthread_mutex_lock(&(io->lock));
+    if (io->uring) {
+        pageIoSubmitRing(io, requests, count, write, complete, context);
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            pageIoFinishSync(io, &requests[i], write, 0);
+            if (complete != NULL) {
+                complete(&requests[i], context);
+            }
+        }
+    }
+    pthread_mutex_unlock(&(io->lock));
+}
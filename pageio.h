@@ -0,0 +1,69 @@
+#ifndef SQLCLONE_PAGEIO_H
+#define SQLCLONE_PAGEIO_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Batched page I/O. On kernels with io_uring a whole batch goes to the
+ * device in one system call and completes in any order; elsewhere, or
+ * with SQLCLONE_IO=sync in the environment, it falls back to one
+ * pread or pwrite per request.
+ */
+#define PAGE_IO_QUEUE_DEPTH 64
+
+/* length bytes at offset in the file: a run of whole pages, or a compressed page */
+typedef struct {
+    void *buffer;
+    uint64_t offset;
+    uint32_t length;
+    // The first page it holds, for the caller
+    uint32_t pageNum;
+    // Bytes transferred, or -errno
+    ssize_t result;
+    // For the caller
+    void *context;
+} PageIoRequest;
+
+typedef void (*PageIoCompletion)(PageIoRequest *request, void *context);
+
+typedef struct {
+    int fileDescriptor;
+    bool uring;
+    // Guards the rings: one batch at a time.
+    pthread_mutex_t lock;
+
+    int ringFileDescriptor;
+    uint32_t entries;
+    void *submissionRing;
+    size_t submissionRingSize;
+    uint32_t *submissionTail;
+    uint32_t *submissionMask;
+    uint32_t *submissionArray;
+    struct io_uring_sqe *submissionEntries;
+    size_t submissionEntriesSize;
+    void *completionRing;
+    size_t completionRingSize;
+    uint32_t *completionHead;
+    uint32_t *completionTail;
+    uint32_t *completionMask;
+    struct io_uring_cqe *completionEntries;
+} PageIo;
+
+/* Never fails: without io_uring the synchronous calls are used. */
+void pageIoOpen(PageIo *io, int fileDescriptor);
+
+void pageIoClose(PageIo *io);
+
+/*
+ * Read or write every request, with up to PAGE_IO_QUEUE_DEPTH in flight,
+ * and return once all are done. complete, if given, is called for each
+ * request as soon as it finishes, in completion order. Short transfers
+ * are finished synchronously, so result is the full length or -errno.
+ */
+void pageIoSubmit(PageIo *io, PageIoRequest *requests, uint32_t count, bool write,
+                  PageIoCompletion complete, void *context);
+
+#endif //SQLCLONE_PAGEIO_H
@@ -0,0 +1,1201 @@
+#define _GNU_SOURCE
+
+#include "pager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "codec.h"
+#include "stats.h"
+
+const FlushOptions DEFAULT_FLUSH_OPTIONS = {
+        .dirtyPageThreshold = 256,
+        .intervalMilliseconds = 1000,
+        .bytesPerSecond = 64 * 1024 * 1024,
+};
+
+bool pagerValidPageSize(uint32_t pageSize) {
+    return pageSize >= PAGER_MIN_PAGE_SIZE && pageSize <= PAGER_MAX_PAGE_SIZE && (pageSize & (pageSize - 1)) == 0;
+}
+
+PageChunk *newChunk(Pager *pager) {
+    PageChunk *chunk = malloc(sizeof(PageChunk));
+    size_t dataSize = (size_t) PAGER_CHUNK_PAGES * pager->pageSize;
+    void *data = mmap(NULL, dataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk == NULL || data == MAP_FAILED) {
+        printf("Out of memory for page cache\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pager->hugePages) {
+        // Only advice: without transparent huge pages it is ignored.
+        madvise(data, dataSize, MADV_HUGEPAGE);
+    }
+    chunk->data = data;
+    for (uint32_t i = 0; i < PAGER_CHUNK_PAGES; i++) {
+        atomic_init(&(chunk->frames[i]), NULL);
+        atomic_init(&(chunk->claimed[i]), false);
+    }
+    return chunk;
+}
+
+void freeChunk(Pager *pager, PageChunk *chunk) {
+    munmap(chunk->data, (size_t) PAGER_CHUNK_PAGES * pager->pageSize);
+    free(chunk);
+}
+
+/* The first block pages can go in: after the header page and the map */
+uint32_t pagerDataStart(Pager *pager) {
+    return (uint32_t) ((pager->pageSize + (uint64_t) TABLE_MAX_PAGES * sizeof(PageMapEntry)) / PAGER_BLOCK_SIZE);
+}
+
+uint32_t pagerBlocks(uint32_t length) {
+    return (length + PAGER_BLOCK_SIZE - 1) / PAGER_BLOCK_SIZE;
+}
+
+/* Put blocks up for reuse, in runs no longer than a page takes. */
+void pagerFreeBlocks(Pager *pager, uint32_t block, uint32_t count) {
+    uint32_t longest = pager->pageSize / PAGER_BLOCK_SIZE;
+    while (count > 0) {
+        uint32_t length = count < longest ? count : longest;
+        FreeRuns *runs = &(pager->freeRuns[length]);
+        if (runs->count == runs->capacity) {
+            runs->capacity = runs->capacity ? 2 * runs->capacity : 64;
+            runs->blocks = realloc(runs->blocks, runs->capacity * sizeof(uint32_t));
+            if (runs->blocks == NULL) {
+                printf("Out of memory for the page map\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        runs->blocks[runs->count++] = block;
+        block += length;
+        count -= length;
+    }
+}
+
+/* Hold blocks back from reuse until the map is synced, by pagerWriteMap. */
+void pagerHoldBlocks(Pager *pager, uint32_t block, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (pager->numPendingRuns == pager->pendingRunsCapacity) {
+        pager->pendingRunsCapacity = pager->pendingRunsCapacity ? 2 * pager->pendingRunsCapacity : 64;
+        pager->pendingRuns = realloc(pager->pendingRuns, pager->pendingRunsCapacity * sizeof(uint64_t));
+        if (pager->pendingRuns == NULL) {
+            printf("Out of memory for the page map\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pager->pendingRuns[pager->numPendingRuns++] = (uint64_t) block << 32 | count;
+}
+
+/* The shortest free run that fits, or failing that the end of the file */
+uint32_t pagerAllocateBlocks(Pager *pager, uint32_t count) {
+    uint32_t longest = pager->pageSize / PAGER_BLOCK_SIZE;
+    for (uint32_t length = count; length <= longest; length++) {
+        FreeRuns *runs = &(pager->freeRuns[length]);
+        if (runs->count > 0) {
+            uint32_t block = runs->blocks[--runs->count];
+            pagerFreeBlocks(pager, block + count, length - count);
+            return block;
+        }
+    }
+    uint32_t block = pager->dataEnd;
+    pager->dataEnd += count;
+    return block;
+}
+
+/* Find room for a new image of the page, length bytes long. */
+uint32_t pagerPlacePage(Pager *pager, uint32_t pageNum, uint32_t length) {
+    PageMapEntry *entry = &(pager->pageMap[pageNum]);
+    uint32_t count = pagerBlocks(length);
+    uint32_t current = pagerBlocks(entry->length);
+    if (current >= count) {
+        pagerHoldBlocks(pager, entry->block + count, current - count);
+        return entry->block;
+    }
+    pagerHoldBlocks(pager, entry->block, current);
+    return pagerAllocateBlocks(pager, count);
+}
+
+int compareBlockRuns(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *) a;
+    uint64_t right = *(const uint64_t *) b;
+    return (left > right) - (left < right);
+}
+
+/*
+ * Work out which blocks are free from the map, merging neighbouring free
+ * runs, and where the pages end. Checks the map on the way. With release,
+ * the disk behind the free runs is given back as well; the map on disk
+ * must not point there any more.
+ */
+void pagerRebuildFreeRuns(Pager *pager, bool release) {
+    for (uint32_t i = 0; i <= pager->pageSize / PAGER_BLOCK_SIZE; i++) {
+        pager->freeRuns[i].count = 0;
+    }
+    uint64_t *runs = malloc(((size_t) pager->mappedPages + 1) * sizeof(uint64_t));
+    if (runs == NULL) {
+        printf("Out of memory for the page map\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t dataStart = pagerDataStart(pager);
+    uint32_t numRuns = 0;
+    for (uint32_t i = 1; i < pager->mappedPages; i++) {
+        PageMapEntry *entry = &(pager->pageMap[i]);
+        if (entry->length == 0) {
+            continue;
+        }
+        if (entry->length > pager->pageSize || entry->block < dataStart ||
+            entry->block > UINT32_MAX - pagerBlocks(entry->length)) {
+            printf("Db file page map has a bad entry for page %d. Corrupt file.\n", i);
+            exit(EXIT_FAILURE);
+        }
+        runs[numRuns++] = (uint64_t) entry->block << 32 | pagerBlocks(entry->length);
+    }
+    qsort(runs, numRuns, sizeof(uint64_t), compareBlockRuns);
+
+    uint32_t end = dataStart;
+    for (uint32_t i = 0; i < numRuns; i++) {
+        uint32_t block = (uint32_t) (runs[i] >> 32);
+        if (block < end) {
+            printf("Db file page map has overlapping pages. Corrupt file.\n");
+            exit(EXIT_FAILURE);
+        }
+        pagerFreeBlocks(pager, end, block - end);
+        if (release && block > end) {
+            // Only advice: where holes are not supported the space stays taken.
+            fallocate(pager->fileDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      (off_t) end * PAGER_BLOCK_SIZE, (off_t) (block - end) * PAGER_BLOCK_SIZE);
+        }
+        end = block + (uint32_t) runs[i];
+    }
+    pager->dataEnd = end;
+    free(runs);
+}
+
+/* Load the map of a compressed file, or start an empty one for a new file. */
+void pagerOpenMap(Pager *pager, bool newFile) {
+    pager->pageMap = calloc(TABLE_MAX_PAGES, sizeof(PageMapEntry));
+    if (pager->pageMap == NULL) {
+        printf("Out of memory for the page map\n");
+        exit(EXIT_FAILURE);
+    }
+    pager->storedPages = 0;
+    if (!newFile) {
+        // A file that was never flushed has a header and nothing else.
+        PageMapEntry first = {0, 0};
+        if (pread(pager->fileDescriptor, &first, sizeof(first), pager->pageSize) == -1) {
+            printf("Error reading file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        pager->storedPages = first.block > 1 ? first.block : 1;
+        if (pager->storedPages > TABLE_MAX_PAGES) {
+            printf("Db file page map has %d pages. Corrupt file.\n", pager->storedPages);
+            exit(EXIT_FAILURE);
+        }
+        // Whatever of the map is past the end of the file reads as zeroes.
+        if (pread(pager->fileDescriptor, pager->pageMap, (size_t) pager->storedPages * sizeof(PageMapEntry),
+                  pager->pageSize) == -1) {
+            printf("Error reading file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+    }
+    pager->mappedPages = pager->storedPages;
+    pagerRebuildFreeRuns(pager, false);
+}
+
+Pager *pagerOpen(const char *fileName, uint32_t pageSize) {
+    int fd = open(fileName,
+                  O_RDWR |      // Read/Write mode
+                  O_CREAT,  // Create file if it does not exist
+                  S_IWUSR |     // User write permission
+                  S_IRUSR   // User read permission
+    );
+    if (fd == -1) {
+        return NULL;
+    }
+    off_t fileLength = lseek(fd, 0, SEEK_END);
+
+    bool newFile = (fileLength == 0);
+    bool compressed;
+    if (newFile) {
+        pageSize = (pageSize == 0) ? PAGER_DEFAULT_PAGE_SIZE : pageSize;
+        if (!pagerValidPageSize(pageSize)) {
+            printf("Page size must be a power of two from %d to %d.\n", PAGER_MIN_PAGE_SIZE, PAGER_MAX_PAGE_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        const char *compress = getenv("SQLCLONE_COMPRESS");
+        compressed = (compress != NULL && strcmp(compress, "1") == 0);
+    } else {
+        DbHeader header;
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            memcmp(header.magic, DB_HEADER_MAGIC, DB_HEADER_MAGIC_SIZE) != 0) {
+            printf("Not a SQLClone database, or one from before page sizes were recorded.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (header.formatVersion != DB_FORMAT_VERSION && header.formatVersion != DB_FORMAT_VERSION_COMPRESSED) {
+            printf("Db file is in format version %d; this build reads versions %d and %d.\n",
+                   header.formatVersion, DB_FORMAT_VERSION, DB_FORMAT_VERSION_COMPRESSED);
+            exit(EXIT_FAILURE);
+        }
+        compressed = (header.formatVersion == DB_FORMAT_VERSION_COMPRESSED);
+        pageSize = header.pageSize;
+        if (!pagerValidPageSize(pageSize)) {
+            printf("Db file header has an invalid page size %d. Corrupt file.\n", pageSize);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    Pager *pager = malloc(sizeof(Pager));
+    pager->fileDescriptor = fd;
+    pager->pageSize = pageSize;
+    pageIoOpen(&(pager->readIo), fd);
+    pageIoOpen(&(pager->writeIo), fd);
+
+    pager->compressed = compressed;
+    pager->pageMap = NULL;
+    pthread_mutex_init(&(pager->mapLock), NULL);
+    pager->mappedPages = 0;
+    pager->dataEnd = 0;
+    memset(pager->freeRuns, 0, sizeof(pager->freeRuns));
+    pager->pendingRuns = NULL;
+    pager->numPendingRuns = 0;
+    pager->pendingRunsCapacity = 0;
+    memset(pager->mapDirty, 0, sizeof(pager->mapDirty));
+    if (compressed) {
+        pagerOpenMap(pager, newFile);
+    } else {
+        if (fileLength % pageSize != 0) {
+            printf("Db file is not a whole number of pages. Corrupt file.\n");
+            exit(EXIT_FAILURE);
+        }
+        pager->storedPages = fileLength / pageSize;
+    }
+    // A new file starts out with its header page.
+    atomic_init(&(pager->numPages), pager->storedPages > 0 ? pager->storedPages : 1);
+
+    const char *hugePages = getenv("SQLCLONE_HUGE_PAGES");
+    pager->hugePages = (hugePages != NULL && strcmp(hugePages, "1") == 0);
+    for (uint32_t i = 0; i < PAGER_MAX_CHUNKS; i++) {
+        atomic_init(&(pager->chunks[i]), NULL);
+    }
+    // Slabs for the pages already in the file.
+    for (uint32_t i = 0; i * PAGER_CHUNK_PAGES < pager->storedPages; i++) {
+        atomic_init(&(pager->chunks[i]), newChunk(pager));
+    }
+
+    atomic_init(&(pager->lastCommitted), 0);
+    atomic_init(&(pager->unpreservedWrite), false);
+    for (uint32_t i = 0; i < PAGER_MAX_SNAPSHOTS; i++) {
+        atomic_init(&(pager->snapshots[i].timestamp), SNAPSHOT_FREE);
+    }
+    atomic_init(&(pager->snapshotSlotsUsed), 0);
+    pager->writeTimestamp = 0;
+    pager->preserveVersions = false;
+    pager->collectedUpTo = 0;
+    pager->versionedFrames = NULL;
+    pager->numVersionedFrames = 0;
+    pager->versionedFramesCapacity = 0;
+    pager->spareImages = NULL;
+    pager->numSpareImages = 0;
+
+    pthread_mutex_init(&(pager->commitLock), NULL);
+    pager->dirtyPages = NULL;
+    pager->numDirtyPages = 0;
+    pager->dirtyPagesCapacity = 0;
+    pager->truncatePending = false;
+
+    pager->flusherRunning = false;
+    pthread_mutex_init(&(pager->flushLock), NULL);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&(pager->flushCondition), &attributes);
+    pthread_condattr_destroy(&attributes);
+    pager->flushRequested = false;
+    atomic_init(&(pager->flusherStopping), false);
+
+    if (newFile) {
+        DbHeader *header = getPageForWrite(pager, 0);
+        memcpy(header->magic, DB_HEADER_MAGIC, DB_HEADER_MAGIC_SIZE);
+        header->pageSize = pageSize;
+        header->formatVersion = compressed ? DB_FORMAT_VERSION_COMPRESSED : DB_FORMAT_VERSION;
+        header->freelistHead = 0;
+        header->numRoots = 0;
+    }
+    return pager;
+}
+
+DbHeader *pagerHeader(Pager *pager) {
+    return getPage(pager, 0);
+}
+
+/*
+ * Put the frame on the dirty list. Called with the commit lock held, or
+ * before the flusher starts.
+ */
+void pagerMarkDirty(Pager *pager, Frame *frame, uint32_t pageNum) {
+    if (frame->dirty) {
+        return;
+    }
+    frame->dirty = true;
+    if (pager->numDirtyPages == pager->dirtyPagesCapacity) {
+        pager->dirtyPagesCapacity = pager->dirtyPagesCapacity ? 2 * pager->dirtyPagesCapacity : 256;
+        pager->dirtyPages = realloc(pager->dirtyPages, pager->dirtyPagesCapacity * sizeof(uint32_t));
+    }
+    pager->dirtyPages[pager->numDirtyPages++] = pageNum;
+
+    // Only wake the flusher on the way past the threshold, not on every page.
+    if (pager->flusherRunning && pager->numDirtyPages == pager->flushOptions.dirtyPageThreshold) {
+        pthread_mutex_lock(&(pager->flushLock));
+        pager->flushRequested = true;
+        pthread_cond_signal(&(pager->flushCondition));
+        pthread_mutex_unlock(&(pager->flushLock));
+    }
+}
+
+int comparePageNums(const void *a, const void *b) {
+    uint32_t left = *(const uint32_t *) a;
+    uint32_t right = *(const uint32_t *) b;
+    return (left > right) - (left < right);
+}
+
+double pagerSecondsSince(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void pagerSubmitWrites(Pager *pager, PageIoRequest *requests, uint32_t count) {
+    pageIoSubmit(&(pager->writeIo), requests, count, true, NULL, NULL);
+    for (uint32_t i = 0; i < count; i++) {
+        if (requests[i].result < 0) {
+            printf("Error writing: %d\n", (int) -requests[i].result);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*
+ * Write a batch of page images out where they belong. They are in page
+ * order, so neighbouring pages go out in one write. Returns the bytes
+ * written.
+ */
+uint64_t pagerWritePages(Pager *pager, void *batch, const uint32_t *pageNums, uint32_t count) {
+    PageIoRequest runs[PAGER_FLUSH_BATCH_PAGES];
+    uint32_t numRuns = 0;
+    for (uint32_t i = 0; i < count;) {
+        uint32_t j = i + 1;
+        while (j < count && pageNums[j] == pageNums[j - 1] + 1) {
+            j++;
+        }
+        runs[numRuns++] = (PageIoRequest) {(char *) batch + (size_t) i * pager->pageSize,
+                                           (uint64_t) pageNums[i] * pager->pageSize, (j - i) * pager->pageSize,
+                                           pageNums[i], 0, NULL};
+        i = j;
+    }
+    pagerSubmitWrites(pager, runs, numRuns);
+    return (uint64_t) count * pager->pageSize;
+}
+
+/*
+ * The same for a compressed file: compress each image into staging, find
+ * it room, and note where it went in the map. The header goes out as it
+ * is, in its own place.
+ */
+uint64_t pagerWriteCompressed(Pager *pager, void *batch, void *staging, const uint32_t *pageNums, uint32_t count) {
+    PageIoRequest requests[PAGER_FLUSH_BATCH_PAGES];
+    for (uint32_t i = 0; i < count; i++) {
+        char *image = (char *) batch + (size_t) i * pager->pageSize;
+        char *compressed = (char *) staging + (size_t) i * pager->pageSize;
+        uint32_t length = pageNums[i] == 0
+                ? 0
+                : codecCompress(image, pager->pageSize, compressed, pager->pageSize - PAGER_BLOCK_SIZE);
+        requests[i] = (PageIoRequest) {length != 0 ? compressed : image, 0, length != 0 ? length : pager->pageSize,
+                                       pageNums[i], 0, NULL};
+    }
+
+    uint64_t bytesWritten = 0;
+    pthread_mutex_lock(&(pager->mapLock));
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t pageNum = pageNums[i];
+        if (pageNum != 0) {
+            uint32_t block = pagerPlacePage(pager, pageNum, requests[i].length);
+            pager->pageMap[pageNum] = (PageMapEntry) {block, requests[i].length};
+            pager->mapDirty[pageNum / PAGE_MAP_WRITE_ENTRIES] = true;
+            if (pageNum >= pager->mappedPages) {
+                pager->mappedPages = pageNum + 1;
+            }
+            requests[i].offset = (uint64_t) block * PAGER_BLOCK_SIZE;
+        }
+        bytesWritten += requests[i].length;
+    }
+    pagerSubmitWrites(pager, requests, count);
+    pthread_mutex_unlock(&(pager->mapLock));
+    return bytesWritten;
+}
+
+/*
+ * End a round on a compressed file: give the blocks of pages cut off the
+ * end back, write the parts of the map that changed, with the number of
+ * pages, and cut the file after the last page. Blocks pages moved out of
+ * are reused only after the map is synced. Returns the bytes written.
+ */
+uint64_t pagerWriteMap(Pager *pager, uint32_t numPages, bool truncate) {
+    pthread_mutex_lock(&(pager->mapLock));
+    if (truncate) {
+        for (uint32_t i = numPages; i < pager->mappedPages; i++) {
+            if (pager->pageMap[i].length != 0) {
+                pager->pageMap[i] = (PageMapEntry) {0, 0};
+                pager->mapDirty[i / PAGE_MAP_WRITE_ENTRIES] = true;
+            }
+        }
+        if (numPages < pager->mappedPages) {
+            pager->mappedPages = numPages;
+        }
+    }
+    if (pager->pageMap[0].block != numPages) {
+        pager->pageMap[0].block = numPages;
+        pager->mapDirty[0] = true;
+    }
+
+    uint32_t numPieces = TABLE_MAX_PAGES / PAGE_MAP_WRITE_ENTRIES;
+    PageIoRequest *requests = malloc(numPieces * sizeof(PageIoRequest));
+    if (requests == NULL) {
+        printf("Out of memory for the page map\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < numPieces; i++) {
+        if (pager->mapDirty[i]) {
+            pager->mapDirty[i] = false;
+            requests[count++] = (PageIoRequest) {pager->pageMap + (size_t) i * PAGE_MAP_WRITE_ENTRIES,
+                                                 pager->pageSize + (uint64_t) i * PAGE_MAP_WRITE_ENTRIES *
+                                                                   sizeof(PageMapEntry),
+                                                 PAGE_MAP_WRITE_ENTRIES * sizeof(PageMapEntry), 0, 0, NULL};
+        }
+    }
+    pagerSubmitWrites(pager, requests, count);
+    free(requests);
+    uint64_t bytesWritten = (uint64_t) count * PAGE_MAP_WRITE_ENTRIES * sizeof(PageMapEntry);
+
+    // Only once the map no longer points there, on disk: the pages freed, and everything else free, go.
+    if ((truncate || pager->numPendingRuns > 0) && fdatasync(pager->fileDescriptor) == -1) {
+        printf("Error syncing db file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    if (truncate) {
+        pagerRebuildFreeRuns(pager, true);
+        if (ftruncate(pager->fileDescriptor, (off_t) pager->dataEnd * PAGER_BLOCK_SIZE) == -1) {
+            printf("Error truncating db file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        for (uint32_t i = 0; i < pager->numPendingRuns; i++) {
+            pagerFreeBlocks(pager, (uint32_t) (pager->pendingRuns[i] >> 32), (uint32_t) pager->pendingRuns[i]);
+        }
+    }
+    pager->numPendingRuns = 0;
+    pthread_mutex_unlock(&(pager->mapLock));
+    STATS_ADD(STAT_BYTES_WRITTEN, bytesWritten);
+    return bytesWritten;
+}
+
+void pagerFlushDirty(Pager *pager, bool background) {
+    void *batch;
+    void *staging = NULL;
+    if (posix_memalign(&batch, PAGER_MIN_PAGE_SIZE, PAGER_FLUSH_BATCH_PAGES * pager->pageSize) != 0 ||
+        (pager->compressed && (staging = malloc(PAGER_FLUSH_BATCH_PAGES * pager->pageSize)) == NULL)) {
+        printf("Out of memory for the flush buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t pageNums[PAGER_FLUSH_BATCH_PAGES];
+    uint64_t bytesWritten = 0;
+    // The number of pages once every dirty one is out, and whether that cut the file
+    uint32_t finalPages = 0;
+    bool truncate = false;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (true) {
+        /*
+         * Copy a batch out while the writer is between commits. A page
+         * changed after this is dirty again and goes out next time.
+         */
+        pthread_mutex_lock(&(pager->commitLock));
+        uint32_t count = pager->numDirtyPages;
+        if (count > PAGER_FLUSH_BATCH_PAGES) {
+            count = PAGER_FLUSH_BATCH_PAGES;
+        }
+        if (count == 0) {
+            finalPages = atomic_load(&(pager->numPages));
+            truncate = pager->truncatePending;
+            pager->truncatePending = false;
+            pthread_mutex_unlock(&(pager->commitLock));
+            break;
+        }
+        pager->numDirtyPages -= count;
+        memcpy(pageNums, pager->dirtyPages + pager->numDirtyPages, count * sizeof(uint32_t));
+        // In page order, so neighbouring pages go out in one write.
+        qsort(pageNums, count, sizeof(uint32_t), comparePageNums);
+        // Pages since cut off the end of the file are not written back.
+        uint32_t numPages = atomic_load(&(pager->numPages));
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            Frame *frame = pagerGetFrame(pager, pageNums[i]);
+            frame->dirty = false;
+            if (pageNums[i] < numPages) {
+                memcpy((char *) batch + (size_t) kept * pager->pageSize, frame->data, pager->pageSize);
+                pageNums[kept++] = pageNums[i];
+            }
+        }
+        count = kept;
+        pthread_mutex_unlock(&(pager->commitLock));
+
+        uint64_t written = pager->compressed
+                ? pagerWriteCompressed(pager, batch, staging, pageNums, count)
+                : pagerWritePages(pager, batch, pageNums, count);
+        bytesWritten += written;
+        STATS_ADD(STAT_PAGES_WRITTEN, count);
+        STATS_ADD(STAT_BYTES_WRITTEN, written);
+
+        // Keep to the rate limit, unless we are being stopped.
+        uint64_t rate = pager->flushOptions.bytesPerSecond;
+        if (background && rate != 0 && !atomic_load(&(pager->flusherStopping))) {
+            double ahead = (double) bytesWritten / (double) rate - pagerSecondsSince(&start);
+            if (ahead > 0) {
+                struct timespec pause = {(time_t) ahead, (long) ((ahead - (double) (time_t) ahead) * 1e9)};
+                nanosleep(&pause, NULL);
+            }
+        }
+    }
+    free(batch);
+    free(staging);
+
+    if (pager->compressed) {
+        bytesWritten += pagerWriteMap(pager, finalPages, truncate);
+    } else if (truncate && ftruncate(pager->fileDescriptor, (off_t) finalPages * pager->pageSize) == -1) {
+        printf("Error truncating db file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    // Checkpoint: everything dirty at the start of the round is now durable.
+    if (background && bytesWritten > 0 && fdatasync(pager->fileDescriptor) == -1) {
+        printf("Error syncing db file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void *flusherMain(void *argument) {
+    Pager *pager = argument;
+    pthread_mutex_lock(&(pager->flushLock));
+    while (!atomic_load(&(pager->flusherStopping))) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        uint64_t nanoseconds = deadline.tv_nsec + (uint64_t) pager->flushOptions.intervalMilliseconds * 1000000;
+        deadline.tv_sec += (time_t) (nanoseconds / 1000000000);
+        deadline.tv_nsec = (long) (nanoseconds % 1000000000);
+
+        while (!pager->flushRequested && !atomic_load(&(pager->flusherStopping))) {
+            if (pthread_cond_timedwait(&(pager->flushCondition), &(pager->flushLock), &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        if (atomic_load(&(pager->flusherStopping))) {
+            break;
+        }
+        pager->flushRequested = false;
+
+        pthread_mutex_unlock(&(pager->flushLock));
+        pagerFlushDirty(pager, true);
+        pthread_mutex_lock(&(pager->flushLock));
+    }
+    pthread_mutex_unlock(&(pager->flushLock));
+    return NULL;
+}
+
+void pagerStartFlusher(Pager *pager, const FlushOptions *options) {
+    pager->flushOptions = *options;
+    pager->flusherRunning = true;
+    if (pthread_create(&(pager->flusher), NULL, flusherMain, pager) != 0) {
+        // Not fatal: everything still gets written at close.
+        pager->flusherRunning = false;
+    }
+}
+
+PageChunk *pagerChunk(Pager *pager, uint32_t pageNum) {
+    _Atomic(PageChunk *) *chunkSlot = &(pager->chunks[pageNum / PAGER_CHUNK_PAGES]);
+    PageChunk *chunk = atomic_load_explicit(chunkSlot, memory_order_acquire);
+    if (chunk == NULL) {
+        PageChunk *created = newChunk(pager);
+        if (atomic_compare_exchange_strong_explicit(chunkSlot, &chunk, created,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            chunk = created;
+        } else {
+            freeChunk(pager, created);
+        }
+    }
+    return chunk;
+}
+
+/* Set up the slot's frame for a page about to be loaded into it. */
+Frame *pagerInitFrame(Pager *pager, PageChunk *chunk, uint32_t index) {
+    Frame *frame = &(chunk->slab[index]);
+    frame->data = (char *) chunk->data + (size_t) index * pager->pageSize;
+
+    // A steady stream of readers must not starve the writer.
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&(frame->latch), &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+    atomic_init(&(frame->version), 0);
+    // Whatever is on disk was committed before any snapshot began.
+    atomic_init(&(frame->validFrom), 0);
+    atomic_init(&(frame->versions), NULL);
+    frame->versioned = false;
+    frame->dirty = false;
+    return frame;
+}
+
+void freeVersions(PageVersion *version) {
+    while (version != NULL) {
+        PageVersion *older = atomic_load(&(version->older));
+        free(version->data);
+        free(version);
+        version = older;
+    }
+}
+
+void pagerClose(Pager *pager) {
+    if (pager->flusherRunning) {
+        pthread_mutex_lock(&(pager->flushLock));
+        atomic_store(&(pager->flusherStopping), true);
+        pthread_cond_signal(&(pager->flushCondition));
+        pthread_mutex_unlock(&(pager->flushLock));
+        pthread_join(pager->flusher, NULL);
+    }
+    pagerFlushDirty(pager, false);
+
+    for (uint32_t i = 0; i < PAGER_MAX_CHUNKS; i++) {
+        PageChunk *chunk = atomic_load(&(pager->chunks[i]));
+        if (chunk == NULL) {
+            continue;
+        }
+        for (uint32_t j = 0; j < PAGER_CHUNK_PAGES; j++) {
+            Frame *frame = atomic_load(&(chunk->frames[j]));
+            if (frame == NULL) {
+                continue;
+            }
+            freeVersions(atomic_load(&(frame->versions)));
+            pthread_rwlock_destroy(&(frame->latch));
+        }
+        freeChunk(pager, chunk);
+    }
+    freeVersions(pager->spareImages);
+    free(pager->versionedFrames);
+    free(pager->dirtyPages);
+    free(pager->pageMap);
+    for (uint32_t i = 0; i <= PAGER_MAX_PAGE_SIZE / PAGER_BLOCK_SIZE; i++) {
+        free(pager->freeRuns[i].blocks);
+    }
+    free(pager->pendingRuns);
+    pthread_mutex_destroy(&(pager->mapLock));
+    pthread_mutex_destroy(&(pager->commitLock));
+    pthread_mutex_destroy(&(pager->flushLock));
+    pthread_cond_destroy(&(pager->flushCondition));
+    pageIoClose(&(pager->readIo));
+    pageIoClose(&(pager->writeIo));
+
+    int result = close(pager->fileDescriptor);
+    if (result == -1) {
+        printf("Error closing db file.\n");
+        exit(EXIT_FAILURE);
+    }
+    free(pager);
+}
+
+/*
+ * Set up the read of a page into data. A compressed page has to land
+ * somewhere else first, so its buffer is left NULL for the caller to
+ * fill in. Returns false for a page that is not in the file.
+ */
+bool pagerReadRequest(Pager *pager, uint32_t pageNum, void *data, PageIoRequest *request) {
+    if (pageNum >= pager->storedPages) {
+        return false;
+    }
+    if (!pager->compressed || pageNum == 0) {
+        *request = (PageIoRequest) {data, (uint64_t) pageNum * pager->pageSize, pager->pageSize, pageNum, 0, NULL};
+        return true;
+    }
+    PageMapEntry entry = pager->pageMap[pageNum];
+    if (entry.length == 0) {
+        return false;
+    }
+    *request = (PageIoRequest) {entry.length == pager->pageSize ? data : NULL,
+                                (uint64_t) entry.block * PAGER_BLOCK_SIZE, entry.length, pageNum, 0, NULL};
+    return true;
+}
+
+/* Give the compressed pages of a batch room to land, all in one allocation, which is returned. */
+void *pagerReadScratch(PageIoRequest *requests, uint32_t count) {
+    size_t size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size += requests[i].buffer == NULL ? requests[i].length : 0;
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    char *scratch = malloc(size);
+    if (scratch == NULL) {
+        printf("Out of memory for reading\n");
+        exit(EXIT_FAILURE);
+    }
+    size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (requests[i].buffer == NULL) {
+            requests[i].buffer = scratch + size;
+            size += requests[i].length;
+        }
+    }
+    return scratch;
+}
+
+/*
+ * Turn what a read brought in into the page: decompress it, or zero what
+ * the file did not have. Returns false for a page that does not
+ * decompress.
+ */
+bool pagerFinishRead(Pager *pager, PageIoRequest *request, void *data) {
+    STATS_ADD(STAT_PAGES_READ, 1);
+    STATS_ADD(STAT_BYTES_READ, request->result);
+    if (request->buffer != data) {
+        return codecDecompress(request->buffer, (uint32_t) request->result, data, pager->pageSize);
+    }
+    memset((char *) data + request->result, 0, pager->pageSize - request->result);
+    return true;
+}
+
+/*
+ * A single page wanted right now gains nothing from the ring, so a miss
+ * is one plain pread.
+ */
+void pagerReadFrame(Pager *pager, Frame *frame, uint32_t pageNum) {
+    PageIoRequest request;
+    if (!pagerReadRequest(pager, pageNum, frame->data, &request)) {
+        // Pages past the end of the file start out zeroed.
+        memset(frame->data, 0, pager->pageSize);
+        return;
+    }
+    void *scratch = pagerReadScratch(&request, 1);
+    request.result = pread(pager->fileDescriptor, request.buffer, request.length, (off_t) request.offset);
+    if (request.result == -1) {
+        printf("Error reading file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    if (!pagerFinishRead(pager, &request, frame->data)) {
+        printf("Page %d does not decompress. Corrupt file.\n", pageNum);
+        exit(EXIT_FAILURE);
+    }
+    free(scratch);
+}
+
+Frame *pagerGetFrame(Pager *pager, uint32_t pageNum) {
+    if (pageNum >= TABLE_MAX_PAGES) {
+        printf("Tried to fetch page number out of bounds. %d > %d\n", pageNum, TABLE_MAX_PAGES);
+        exit(EXIT_FAILURE);
+    }
+
+    PageChunk *chunk = pagerChunk(pager, pageNum);
+    uint32_t index = pageNum % PAGER_CHUNK_PAGES;
+    Frame *frame = atomic_load_explicit(&(chunk->frames[index]), memory_order_acquire);
+    if (frame != NULL) {
+        STATS_ADD(STAT_CACHE_HITS, 1);
+        return frame;
+    }
+    STATS_ADD(STAT_CACHE_MISSES, 1);
+    while (frame == NULL) {
+        // Cache miss. Whoever claims the slot loads the page; the rest wait for it.
+        bool claimed = false;
+        if (atomic_compare_exchange_strong(&(chunk->claimed[index]), &claimed, true)) {
+            frame = pagerInitFrame(pager, chunk, index);
+            pagerReadFrame(pager, frame, pageNum);
+            atomic_store_explicit(&(chunk->frames[index]), frame, memory_order_release);
+            break;
+        }
+        sched_yield();
+        frame = atomic_load_explicit(&(chunk->frames[index]), memory_order_acquire);
+    }
+
+    return frame;
+}
+
+bool pagerIsCached(Pager *pager, uint32_t pageNum) {
+    if (pageNum >= TABLE_MAX_PAGES) {
+        return false;
+    }
+    PageChunk *chunk = atomic_load_explicit(&(pager->chunks[pageNum / PAGER_CHUNK_PAGES]), memory_order_acquire);
+    return chunk != NULL &&
+           atomic_load_explicit(&(chunk->frames[pageNum % PAGER_CHUNK_PAGES]), memory_order_acquire) != NULL;
+}
+
+void pagerInstallPrefetched(PageIoRequest *request, void *context) {
+    Pager *pager = context;
+    Frame *frame = request->context;
+    PageChunk *chunk = pagerChunk(pager, request->pageNum);
+    uint32_t index = request->pageNum % PAGER_CHUNK_PAGES;
+    if (request->result < 0 || !pagerFinishRead(pager, request, frame->data)) {
+        // Give the slot up; the page is read again when it is needed.
+        pthread_rwlock_destroy(&(frame->latch));
+        atomic_store(&(chunk->claimed[index]), false);
+        return;
+    }
+    atomic_store_explicit(&(chunk->frames[index]), frame, memory_order_release);
+}
+
+uint32_t pagerPrefetch(Pager *pager, const uint32_t *pageNums, uint32_t count, uint32_t *issued) {
+    PageIoRequest requests[PAGE_IO_QUEUE_DEPTH];
+    uint32_t numRequests = 0;
+    for (uint32_t i = 0; i < count && numRequests < PAGE_IO_QUEUE_DEPTH; i++) {
+        // Only pages that were in the file when it was opened can be missing.
+        if (pageNums[i] >= pager->storedPages) {
+            continue;
+        }
+        PageChunk *chunk = pagerChunk(pager, pageNums[i]);
+        uint32_t index = pageNums[i] % PAGER_CHUNK_PAGES;
+        bool claimed = false;
+        if (!atomic_compare_exchange_strong(&(chunk->claimed[index]), &claimed, true)) {
+            // Cached, or someone else is loading it.
+            continue;
+        }
+        Frame *frame = pagerInitFrame(pager, chunk, index);
+        if (!pagerReadRequest(pager, pageNums[i], frame->data, &requests[numRequests])) {
+            // Never written: there is nothing to read ahead.
+            pthread_rwlock_destroy(&(frame->latch));
+            atomic_store(&(chunk->claimed[index]), false);
+            continue;
+        }
+        requests[numRequests].context = frame;
+        if (issued != NULL) {
+            issued[numRequests] = pageNums[i];
+        }
+        numRequests++;
+    }
+    if (numRequests > 0) {
+        void *scratch = pagerReadScratch(requests, numRequests);
+        pageIoSubmit(&(pager->readIo), requests, numRequests, false, pagerInstallPrefetched, pager);
+        free(scratch);
+    }
+    return numRequests;
+}
+
+void pagerCopyPages(Pager *pager, const uint32_t *pageNums, uint32_t count, void *buffer) {
+    PageIoRequest requests[PAGE_IO_QUEUE_DEPTH];
+    uint32_t i = 0;
+    while (i < count) {
+        uint32_t numRequests = 0;
+        for (; i < count && numRequests < PAGE_IO_QUEUE_DEPTH; i++) {
+            char *destination = (char *) buffer + (size_t) i * pager->pageSize;
+            PageChunk *chunk = pageNums[i] < TABLE_MAX_PAGES
+                    ? atomic_load_explicit(&(pager->chunks[pageNums[i] / PAGER_CHUNK_PAGES]), memory_order_acquire)
+                    : NULL;
+            Frame *frame = chunk != NULL
+                    ? atomic_load_explicit(&(chunk->frames[pageNums[i] % PAGER_CHUNK_PAGES]), memory_order_acquire)
+                    : NULL;
+            if (frame != NULL) {
+                // Dirty pages are always cached, so the disk is only ever behind for these.
+                memcpy(destination, frame->data, pager->pageSize);
+            } else if (pagerReadRequest(pager, pageNums[i], destination, &requests[numRequests])) {
+                requests[numRequests++].context = destination;
+            } else {
+                memset(destination, 0, pager->pageSize);
+            }
+        }
+        if (numRequests == 0) {
+            continue;
+        }
+        void *scratch = pagerReadScratch(requests, numRequests);
+        pageIoSubmit(&(pager->readIo), requests, numRequests, false, NULL, NULL);
+        for (uint32_t j = 0; j < numRequests; j++) {
+            if (requests[j].result < 0) {
+                printf("Error reading file: %d\n", (int) -requests[j].result);
+                exit(EXIT_FAILURE);
+            }
+            if (!pagerFinishRead(pager, &requests[j], requests[j].context)) {
+                printf("Page %d does not decompress. Corrupt file.\n", requests[j].pageNum);
+                exit(EXIT_FAILURE);
+            }
+        }
+        free(scratch);
+    }
+}
+
+void* getPage(Pager *pager, uint32_t pageNum) {
+    return pagerGetFrame(pager, pageNum)->data;
+}
+
+void *getPageForWrite(Pager *pager, uint32_t pageNum) {
+    Frame *frame = pagerGetFrame(pager, pageNum);
+    pagerMarkDirty(pager, frame, pageNum);
+    return frame->data;
+}
+
+void *pagerLatchShared(Pager *pager, uint32_t pageNum) {
+    Frame *frame = pagerGetFrame(pager, pageNum);
+    pthread_rwlock_rdlock(&(frame->latch));
+    return frame->data;
+}
+
+void pagerUnlatchShared(Pager *pager, uint32_t pageNum) {
+    pthread_rwlock_unlock(&(pagerGetFrame(pager, pageNum)->latch));
+}
+
+/*
+ * Keep the page as it was before this write for the snapshots that
+ * still need it.
+ */
+void pagerPreserveVersion(Pager *pager, Frame *frame, uint64_t validFrom) {
+    PageVersion *image = pager->spareImages;
+    if (image != NULL) {
+        pager->spareImages = atomic_load_explicit(&(image->older), memory_order_relaxed);
+        pager->numSpareImages--;
+    } else {
+        image = malloc(sizeof(PageVersion));
+        image->data = malloc(pager->pageSize);
+    }
+    image->validFrom = validFrom;
+    image->validTo = pager->writeTimestamp;
+    memcpy(image->data, frame->data, pager->pageSize);
+    atomic_init(&(image->older), atomic_load_explicit(&(frame->versions), memory_order_relaxed));
+    atomic_store_explicit(&(frame->versions), image, memory_order_release);
+
+    if (!frame->versioned) {
+        if (pager->numVersionedFrames == pager->versionedFramesCapacity) {
+            pager->versionedFramesCapacity = pager->versionedFramesCapacity ? 2 * pager->versionedFramesCapacity : 64;
+            pager->versionedFrames = realloc(pager->versionedFrames,
+                                             pager->versionedFramesCapacity * sizeof(Frame *));
+        }
+        pager->versionedFrames[pager->numVersionedFrames++] = frame;
+        frame->versioned = true;
+    }
+}
+
+void *pagerLatchExclusive(Pager *pager, uint32_t pageNum) {
+    Frame *frame = pagerGetFrame(pager, pageNum);
+    pthread_rwlock_wrlock(&(frame->latch));
+    pagerMarkDirty(pager, frame, pageNum);
+
+    // Odd from here on: optimistic readers will not trust what they see.
+    uint64_t version = atomic_load_explicit(&(frame->version), memory_order_relaxed);
+    atomic_store_explicit(&(frame->version), version + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint64_t validFrom = atomic_load_explicit(&(frame->validFrom), memory_order_relaxed);
+    if (validFrom < pager->writeTimestamp) {
+        if (pager->preserveVersions) {
+            pagerPreserveVersion(pager, frame, validFrom);
+        }
+        // Release: a reader that sees the new timestamp also sees the image.
+        atomic_store_explicit(&(frame->validFrom), pager->writeTimestamp, memory_order_release);
+    }
+    return frame->data;
+}
+
+void pagerUnlatchExclusive(Pager *pager, uint32_t pageNum) {
+    Frame *frame = pagerGetFrame(pager, pageNum);
+    uint64_t version = atomic_load_explicit(&(frame->version), memory_order_relaxed);
+    atomic_store_explicit(&(frame->version), version + 1, memory_order_release);
+    pthread_rwlock_unlock(&(frame->latch));
+}
+
+uint64_t pagerReadBegin(Frame *frame) {
+    uint64_t version = atomic_load_explicit(&(frame->version), memory_order_acquire);
+    while (version & 1) {
+        sched_yield();
+        version = atomic_load_explicit(&(frame->version), memory_order_acquire);
+    }
+    return version;
+}
+
+bool pagerReadValidate(Frame *frame, uint64_t version) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&(frame->version), memory_order_relaxed) == version;
+}
+
+_Thread_local uint32_t snapshotSlotHint = UINT32_MAX;
+_Atomic uint32_t nextSnapshotSlotHint = 0;
+
+uint64_t pagerSnapshotBegin(Pager *pager, uint32_t *slot) {
+    // Threads spread out over the slots and keep coming back to their own.
+    if (snapshotSlotHint == UINT32_MAX) {
+        snapshotSlotHint = atomic_fetch_add(&nextSnapshotSlotHint, 1) % PAGER_MAX_SNAPSHOTS;
+    }
+
+    uint32_t index = snapshotSlotHint;
+    while (true) {
+        uint64_t expected = SNAPSHOT_FREE;
+        if (atomic_compare_exchange_strong(&(pager->snapshots[index].timestamp), &expected, SNAPSHOT_PENDING)) {
+            break;
+        }
+        index = (index + 1) % PAGER_MAX_SNAPSHOTS;
+        if (index == snapshotSlotHint) {
+            sched_yield();
+        }
+    }
+    snapshotSlotHint = index;
+
+    uint32_t used = atomic_load(&(pager->snapshotSlotsUsed));
+    while (index >= used && !atomic_compare_exchange_weak(&(pager->snapshotSlotsUsed), &used, index + 1)) {
+    }
+
+    /*
+     * Either the writer sees our pending slot and keeps old images, or
+     * we see that it is not keeping them and wait for it to commit.
+     */
+    while (atomic_load(&(pager->unpreservedWrite))) {
+        sched_yield();
+    }
+    uint64_t snapshot = atomic_load(&(pager->lastCommitted));
+    atomic_store(&(pager->snapshots[index].timestamp), snapshot);
+
+    *slot = index;
+    return snapshot;
+}
+
+void pagerSnapshotEnd(Pager *pager, uint32_t slot) {
+    atomic_store_explicit(&(pager->snapshots[slot].timestamp), SNAPSHOT_FREE, memory_order_release);
+}
+
+void *pagerPageAt(Frame *frame, uint64_t snapshot) {
+    if (atomic_load_explicit(&(frame->validFrom), memory_order_acquire) <= snapshot) {
+        return frame->data;
+    }
+    PageVersion *image = atomic_load_explicit(&(frame->versions), memory_order_acquire);
+    while (image != NULL && image->validFrom > snapshot) {
+        image = atomic_load_explicit(&(image->older), memory_order_acquire);
+    }
+    return image != NULL ? image->data : NULL;
+}
+
+void pagerWriteBegin(Pager *pager) {
+    pthread_mutex_lock(&(pager->commitLock));
+    pager->writeTimestamp = atomic_load(&(pager->lastCommitted)) + 1;
+
+    // Copying pages is only worth it while someone holds a snapshot.
+    atomic_store(&(pager->unpreservedWrite), true);
+    pager->preserveVersions = false;
+    uint32_t slotsUsed = atomic_load(&(pager->snapshotSlotsUsed));
+    for (uint32_t i = 0; i < slotsUsed; i++) {
+        if (atomic_load(&(pager->snapshots[i].timestamp)) != SNAPSHOT_FREE) {
+            pager->preserveVersions = true;
+            atomic_store(&(pager->unpreservedWrite), false);
+            break;
+        }
+    }
+}
+
+/*
+ * No reader can reach these images any more, so they can be reused
+ * straight away.
+ */
+void pagerRecycleVersions(Pager *pager, PageVersion *version) {
+    while (version != NULL && pager->numSpareImages < PAGER_MAX_SPARE_IMAGES) {
+        PageVersion *older = atomic_load_explicit(&(version->older), memory_order_relaxed);
+        atomic_store_explicit(&(version->older), pager->spareImages, memory_order_relaxed);
+        pager->spareImages = version;
+        pager->numSpareImages++;
+        version = older;
+    }
+    freeVersions(version);
+}
+
+/*
+ * Drop images no registered snapshot can see. Images of a chain end
+ * at decreasing timestamps, so everything from the first one that ends
+ * at or before the oldest snapshot onwards can go.
+ */
+void pagerCollectVersions(Pager *pager, uint64_t oldest) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < pager->numVersionedFrames; i++) {
+        Frame *frame = pager->versionedFrames[i];
+        _Atomic(PageVersion *) *link = &(frame->versions);
+        PageVersion *image = atomic_load(link);
+        while (image != NULL && image->validTo > oldest) {
+            link = &(image->older);
+            image = atomic_load(link);
+        }
+        atomic_store(link, NULL);
+        pagerRecycleVersions(pager, image);
+
+        if (atomic_load(&(frame->versions)) != NULL) {
+            pager->versionedFrames[kept++] = frame;
+        } else {
+            frame->versioned = false;
+        }
+    }
+    pager->numVersionedFrames = kept;
+    pager->collectedUpTo = oldest;
+}
+
+void pagerWriteCommit(Pager *pager) {
+    atomic_store(&(pager->lastCommitted), pager->writeTimestamp);
+    atomic_store(&(pager->unpreservedWrite), false);
+    pthread_mutex_unlock(&(pager->commitLock));
+
+    if (pager->numVersionedFrames == 0) {
+        return;
+    }
+    uint64_t oldest = pager->writeTimestamp;
+    uint32_t slotsUsed = atomic_load(&(pager->snapshotSlotsUsed));
+    for (uint32_t i = 0; i < slotsUsed; i++) {
+        uint64_t snapshot = atomic_load(&(pager->snapshots[i].timestamp));
+        if (snapshot == SNAPSHOT_PENDING) {
+            // Its timestamp may be older than anything else; try again next commit.
+            return;
+        }
+        if (snapshot < oldest) {
+            oldest = snapshot;
+        }
+    }
+    // Nothing can have become garbage unless the oldest snapshot moved on.
+    if (oldest > pager->collectedUpTo) {
+        pagerCollectVersions(pager, oldest);
+    }
+}
+
+/*
+ * The file never has holes: a vacuum fills the pages it frees from the
+ * end and cuts the end off. So new pages always go onto the end of the
+ * database file.
+ */
+uint32_t getUnusedPageNum(Pager* pager){
+    uint32_t pageNum = atomic_load(&(pager->numPages));
+    atomic_store(&(pager->numPages), pageNum + 1);
+    return pageNum;
+}
+
+void pagerTruncate(Pager *pager, uint32_t numPages) {
+    /*
+     * The pages keep their frames, and snapshots from before the cut may
+     * still be reading them. Latching keeps their images for those now,
+     * while the writer holds no other latch, so that reusing a page later
+     * needs no latch at all: a reader coupling down through an old image
+     * could be holding the very child the writer has latched by then.
+     */
+    for (uint32_t i = numPages; i < atomic_load(&(pager->numPages)); i++) {
+        if (pagerIsCached(pager, i)) {
+            pagerLatchExclusive(pager, i);
+            pagerUnlatchExclusive(pager, i);
+        }
+    }
+    atomic_store(&(pager->numPages), numPages);
+    pager->truncatePending = true;
+}
@@ -0,0 +1,365 @@
+#ifndef SQLCLONE_PAGER_H
+#define SQLCLONE_PAGER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pageio.h"
+
+/*
+ * The page size is chosen when a database is created and recorded in
+ * its header; it is a power of two in this range.
+ */
+#define PAGER_DEFAULT_PAGE_SIZE 4096
+#define PAGER_MIN_PAGE_SIZE 4096
+#define PAGER_MAX_PAGE_SIZE 65536
+
+/*
+ * Page 0 of every database file is a header. It starts with the same
+ * fields whatever the page size, so the page size can be read first.
+ * Everything needed to open the file is here, so opening never has to
+ * look at the tree, whatever its size.
+ *
+ * Each table and index has a root slot holding its root page and row
+ * count. The writer keeps them up to date in the same commit as the
+ * change they describe, so a snapshot of page 0 always matches the
+ * tree. Slots are numbered from 0 and numRoots of them are in use.
+ */
+#define DB_HEADER_MAGIC "SQLClone format1"
+#define DB_HEADER_MAGIC_SIZE 16
+#define DB_FORMAT_VERSION 2
+// Compressed files, which builds that cannot read them refuse
+#define DB_FORMAT_VERSION_COMPRESSED 3
+#define DB_HEADER_MAX_ROOTS 32
+
+typedef struct {
+    uint32_t rootPageNum;
+    uint32_t reserved;
+    uint64_t rowCount;
+} DbRoot;
+
+typedef struct {
+    char magic[DB_HEADER_MAGIC_SIZE];
+    uint32_t pageSize;
+    uint32_t formatVersion;
+    // First page of the chain of free pages, or 0 if there are none
+    uint32_t freelistHead;
+    uint32_t numRoots;
+    DbRoot roots[DB_HEADER_MAX_ROOTS];
+} DbHeader;
+
+/*
+ * The page table is a directory of fixed size chunks. Directory and
+ * chunk slots are filled once, with compare-and-swap, and never change
+ * until the pager is closed, so looking a page up takes no lock.
+ */
+#define PAGER_CHUNK_PAGES 1024
+#define PAGER_MAX_CHUNKS 1024
+#define TABLE_MAX_PAGES (PAGER_CHUNK_PAGES * PAGER_MAX_CHUNKS)
+
+/*
+ * An older image of a page, kept for snapshots taken while it was
+ * current: it is what a snapshot at timestamp t sees when
+ * validFrom <= t < validTo. Images never change once published.
+ */
+typedef struct PageVersion {
+    uint64_t validFrom;
+    uint64_t validTo;
+    _Atomic(struct PageVersion *) older;
+    void *data;
+} PageVersion;
+
+/*
+ * A cached page. The writer holds the latch exclusively while it changes
+ * the page, and bumps the version on the way in and out, so the version
+ * is odd exactly while a change is in progress. Readers normally take no
+ * latch at all: they note the version, read, and check that it has not
+ * moved. Readers that keep losing that race fall back to holding the
+ * latch shared.
+ *
+ * validFrom is the commit timestamp of the current contents, and
+ * versions the chain of older images, newest first.
+ */
+typedef struct {
+    pthread_rwlock_t latch;
+    _Atomic uint64_t version;
+    _Atomic uint64_t validFrom;
+    _Atomic(PageVersion *) versions;
+    // Writer only: the frame is on the pager's list of frames to collect.
+    bool versioned;
+    // Changed since it was last written out. Guarded by the commit lock.
+    bool dirty;
+    void *data;
+} Frame;
+
+/*
+ * Frames and page buffers come in slabs, one per chunk, allocated when
+ * the chunk is first needed: at open for the pages already in the file,
+ * and as the file grows after that. A page is loaded into its slot once
+ * and stays there until the pager is closed, so a miss costs a read and
+ * no allocation. The first thread to claim a slot loads it; others wait
+ * for it to be published.
+ *
+ * The buffers are one anonymous mapping, which the kernel only backs as
+ * pages are touched. SQLCLONE_HUGE_PAGES=1 in the environment asks for
+ * it to be backed with transparent huge pages.
+ */
+typedef struct {
+    _Atomic(Frame *) frames[PAGER_CHUNK_PAGES];
+    _Atomic bool claimed[PAGER_CHUNK_PAGES];
+    Frame slab[PAGER_CHUNK_PAGES];
+    void *data;
+} PageChunk;
+
+/*
+ * Compressed files. SQLCLONE_COMPRESS=1 in the environment creates new
+ * files compressed, and the format version records it, so a file is
+ * always opened the way it was made. The flusher compresses each page
+ * on its own and stores it in as many blocks as it takes, or as it is
+ * if compressing would not save a block; a miss decompresses it.
+ *
+ * The page map, one entry per page, says where each page is. It sits
+ * right after the header, sized for the largest table, and the rest of
+ * the file holds pages; the file is sparse, so only as much of the map
+ * as is in use takes up disk. The header page itself is never
+ * compressed, so its entry holds the number of pages instead.
+ *
+ * A page rewritten no bigger than before stays where it is; otherwise it
+ * moves, and its old blocks go to lists of free runs by length, which are
+ * rebuilt from the map at open and after the file is cut. Blocks let go
+ * of in a round are held back until the map that no longer points there
+ * is synced, so a crash never leaves the map naming blocks that hold
+ * another page's image.
+ */
+#define PAGER_BLOCK_SIZE 128
+// Map entries written back together, one 4 KB piece of the map
+#define PAGE_MAP_WRITE_ENTRIES 512
+
+typedef struct {
+    // First block, counted from the start of the file
+    uint32_t block;
+    // Bytes stored: the page size for a page stored as it is, 0 for none
+    uint32_t length;
+} PageMapEntry;
+
+typedef struct {
+    uint32_t *blocks;
+    uint32_t count;
+    uint32_t capacity;
+} FreeRuns;
+
+/*
+ * Registered snapshot timestamps, one cache line each so that threads
+ * opening snapshots don't disturb each other.
+ */
+#define PAGER_MAX_SNAPSHOTS 64
+#define SNAPSHOT_FREE UINT64_MAX
+#define SNAPSHOT_PENDING (UINT64_MAX - 1)
+
+typedef struct {
+    _Atomic uint64_t timestamp;
+    char padding[64 - sizeof(uint64_t)];
+} SnapshotSlot;
+
+/*
+ * When the background flusher writes dirty pages out: once this many
+ * are dirty, or this long after the last round, whichever comes first.
+ * Writes are paced to bytesPerSecond (0 for no limit), and each round
+ * ends with a checkpoint that makes it durable.
+ */
+typedef struct {
+    uint32_t dirtyPageThreshold;
+    uint32_t intervalMilliseconds;
+    uint64_t bytesPerSecond;
+} FlushOptions;
+
+extern const FlushOptions DEFAULT_FLUSH_OPTIONS;
+
+/* Images kept for reuse at most; the rest go back to malloc */
+#define PAGER_MAX_SPARE_IMAGES 256
+
+/* Pages copied out under the commit lock at a time */
+#define PAGER_FLUSH_BATCH_PAGES 64
+
+typedef struct {
+    int fileDescriptor;
+    // Pages in the file when it was opened: only these are ever read.
+    uint32_t storedPages;
+    uint32_t pageSize;
+    bool hugePages;
+    // Batched reads for read-ahead, and batched writes for the flusher
+    PageIo readIo;
+    PageIo writeIo;
+    // Only the writer adds pages; readers only look below this.
+    _Atomic uint32_t numPages;
+    _Atomic(PageChunk *) chunks[PAGER_MAX_CHUNKS];
+
+    _Atomic uint64_t lastCommitted;
+    // Set while a write that keeps no old images is in progress.
+    _Atomic bool unpreservedWrite;
+    SnapshotSlot snapshots[PAGER_MAX_SNAPSHOTS];
+    // One past the highest slot ever used, so the writer scans only those.
+    _Atomic uint32_t snapshotSlotsUsed;
+
+    // Writer only
+    uint64_t writeTimestamp;
+    bool preserveVersions;
+    uint64_t collectedUpTo;
+    Frame **versionedFrames;
+    uint32_t numVersionedFrames;
+    uint32_t versionedFramesCapacity;
+    // Collected images, kept for reuse
+    PageVersion *spareImages;
+    uint32_t numSpareImages;
+
+    /*
+     * Held by the writer from pagerWriteBegin to pagerWriteCommit and by
+     * the flusher while it copies dirty pages out, so the flusher only
+     * ever sees committed pages. Guards the dirty list and flags.
+     */
+    pthread_mutex_t commitLock;
+    uint32_t *dirtyPages;
+    uint32_t numDirtyPages;
+    uint32_t dirtyPagesCapacity;
+    // numPages has gone down since the file was last cut to it.
+    bool truncatePending;
+
+    /*
+     * Compressed files: the map, laid out as on disk, and the blocks free
+     * for pages. An entry only changes while its page is cached, so
+     * readers, who only look up pages that are not, need no lock. The
+     * rest is the flusher's, under the map lock.
+     */
+    bool compressed;
+    PageMapEntry *pageMap;
+    pthread_mutex_t mapLock;
+    // Entries that may be in use, and the block past the last page
+    uint32_t mappedPages;
+    uint32_t dataEnd;
+    FreeRuns freeRuns[PAGER_MAX_PAGE_SIZE / PAGER_BLOCK_SIZE + 1];
+    // Runs let go of since the map was last synced, as block << 32 | length
+    uint64_t *pendingRuns;
+    uint32_t numPendingRuns;
+    uint32_t pendingRunsCapacity;
+    bool mapDirty[TABLE_MAX_PAGES / PAGE_MAP_WRITE_ENTRIES];
+
+    // Background flusher
+    FlushOptions flushOptions;
+    bool flusherRunning;
+    pthread_t flusher;
+    pthread_mutex_t flushLock;
+    pthread_cond_t flushCondition;
+    bool flushRequested;
+    _Atomic bool flusherStopping;
+} Pager;
+
+/*
+ * pageSize only matters if the file is new; 0 picks the default. Files
+ * without a valid header, or in another format version, are refused.
+ */
+Pager *pagerOpen(const char *fileName, uint32_t pageSize);
+
+bool pagerValidPageSize(uint32_t pageSize);
+
+DbHeader *pagerHeader(Pager *pager);
+
+/* Write every dirty page back and release the pager. */
+void pagerClose(Pager *pager);
+
+/*
+ * Write dirty pages from a background thread, so that foreground writes
+ * never wait for the disk. Without it everything is written at close.
+ */
+void pagerStartFlusher(Pager *pager, const FlushOptions *options);
+
+/*
+ * Write out every page that is dirty when called. The writer is only
+ * held up while each batch is copied, never during the I/O. In the
+ * background the writes are paced and end with a checkpoint.
+ */
+void pagerFlushDirty(Pager *pager, bool background);
+
+Frame *pagerGetFrame(Pager *pager, uint32_t pageNum);
+
+bool pagerIsCached(Pager *pager, uint32_t pageNum);
+
+/*
+ * Read whichever of these pages are on disk but not cached in one batch,
+ * installing each as its read completes. Purely a hint: pages that fail
+ * to load are read again when they are needed. Returns how many reads
+ * went out, and if issued is given, stores their page numbers there.
+ */
+uint32_t pagerPrefetch(Pager *pager, const uint32_t *pageNums, uint32_t count, uint32_t *issued);
+
+/*
+ * Copy the current contents of these pages into consecutive page sized
+ * slots of buffer, reading those that are not cached in batches without
+ * caching them, so a walk over the whole file leaves the cache as it
+ * was. For the writer and single threaded tools, like getPage.
+ */
+void pagerCopyPages(Pager *pager, const uint32_t *pageNums, uint32_t count, void *buffer);
+
+/*
+ * Unlatched access, for the writer and for single threaded tools.
+ * Readers running alongside a writer must latch the page instead.
+ */
+void* getPage(Pager *pager, uint32_t pageNum);
+
+/*
+ * For the writer, between pagerWriteBegin and pagerWriteCommit: a page
+ * it is about to change without latching it, such as a new page or a
+ * parent pointer. Latching a page exclusively marks it dirty as well.
+ */
+void *getPageForWrite(Pager *pager, uint32_t pageNum);
+
+void *pagerLatchShared(Pager *pager, uint32_t pageNum);
+
+void pagerUnlatchShared(Pager *pager, uint32_t pageNum);
+
+void *pagerLatchExclusive(Pager *pager, uint32_t pageNum);
+
+void pagerUnlatchExclusive(Pager *pager, uint32_t pageNum);
+
+/*
+ * Optimistic reads: take the version before reading a page and validate
+ * it afterwards. Anything read from a page that fails validation may be
+ * torn and must be thrown away.
+ */
+uint64_t pagerReadBegin(Frame *frame);
+
+bool pagerReadValidate(Frame *frame, uint64_t version);
+
+/*
+ * Snapshots. A snapshot sees every write committed before it began and
+ * nothing after. While one is registered the writer keeps the images it
+ * needs; they are collected once no snapshot can see them.
+ */
+uint64_t pagerSnapshotBegin(Pager *pager, uint32_t *slot);
+
+void pagerSnapshotEnd(Pager *pager, uint32_t slot);
+
+/* The contents of the page as of the snapshot. */
+void *pagerPageAt(Frame *frame, uint64_t snapshot);
+
+/*
+ * The writer brackets each atomic change with these. Pages latched
+ * exclusively in between get the new commit timestamp.
+ */
+void pagerWriteBegin(Pager *pager);
+
+void pagerWriteCommit(Pager *pager);
+
+/* For the writer, between pagerWriteBegin and pagerWriteCommit */
+uint32_t getUnusedPageNum(Pager* pager);
+
+/*
+ * For the writer, holding no latches: drop the pages from numPages on,
+ * which nothing in the tree may point to any more. Their frames stay for
+ * the snapshots that can still see them, and the file is cut at the next
+ * flush.
+ */
+void pagerTruncate(Pager *pager, uint32_t numPages);
+
+#endif //SQLCLONE_PAGER_H
@@ -0,0 +1,246 @@
+#include "pax.h"
+
+#include <string.h>
+
+#include "predicate.h"
+#include "stats.h"
+
+uint32_t *paxLeafSlots(void *node) {
+    return node + LEAF_NODE_HEADER_SIZE;
+}
+
+uint32_t *paxLeafHeapStart(void *node) {
+    return node + LEAF_NODE_HEADER_SIZE + sizeof(uint32_t);
+}
+
+uint32_t paxLeafSpace(uint32_t pageSize) {
+    return pageSize - PAX_MINIPAGES_OFFSET;
+}
+
+/* Where the minipages of a leaf with this many slots end */
+uint32_t paxLeafMinipagesEnd(uint32_t slots) {
+    return PAX_MINIPAGES_OFFSET + slots * PAX_FIXED_ROW_SIZE;
+}
+
+/* The minipages of a leaf laid out for slots cells */
+uint32_t *paxLeafKeys(void *node) {
+    return node + PAX_MINIPAGES_OFFSET;
+}
+
+char *paxLeafUsernames(void *node, uint32_t slots) {
+    return node + PAX_MINIPAGES_OFFSET + slots * sizeof(uint32_t);
+}
+
+uint8_t *paxLeafEmailLengths(void *node, uint32_t slots) {
+    return node + PAX_MINIPAGES_OFFSET + slots * (sizeof(uint32_t) + COLUMN_USERNAME_SIZE);
+}
+
+uint16_t *paxLeafEmailOffsets(void *node, uint32_t slots) {
+    return node + PAX_MINIPAGES_OFFSET + slots * (sizeof(uint32_t) + COLUMN_USERNAME_SIZE + sizeof(uint8_t));
+}
+
+uint32_t paxRowSize(RowView *row) {
+    return PAX_FIXED_ROW_SIZE + row->emailLength;
+}
+
+void paxLeafInitSlots(void *node, uint32_t pageSize, uint32_t slots) {
+    *leafNodeNumCells(node) = 0;
+    *paxLeafSlots(node) = slots;
+    *paxLeafHeapStart(node) = pageSize;
+}
+
+void paxLeafInit(void *node, uint32_t pageSize) {
+    paxLeafInitSlots(node, pageSize, 0);
+}
+
+uint32_t paxLeafMaxCells(uint32_t pageSize) {
+    return paxLeafSpace(pageSize) / PAX_FIXED_ROW_SIZE;
+}
+
+uint32_t *paxLeafKey(void *node, uint32_t cellNum) {
+    return paxLeafKeys(node) + cellNum;
+}
+
+void paxLeafView(void *node, uint32_t cellNum, RowView *row) {
+    uint32_t slots = *paxLeafSlots(node);
+    row->id = *paxLeafKey(node, cellNum);
+    row->username = paxLeafUsernames(node, slots) + cellNum * COLUMN_USERNAME_SIZE;
+    row->usernameLength = strnlen(row->username, COLUMN_USERNAME_SIZE);
+    row->email = (const char *) node + paxLeafEmailOffsets(node, slots)[cellNum];
+    row->emailLength = paxLeafEmailLengths(node, slots)[cellNum];
+}
+
+void paxLeafRead(void *node, uint32_t cellNum, Row *row) {
+    RowView view;
+    paxLeafView(node, cellNum, &view);
+    row->id = view.id;
+    memcpy(row->username, view.username, view.usernameLength);
+    row->username[view.usernameLength] = '\0';
+    memcpy(row->email, view.email, view.emailLength);
+    row->email[view.emailLength] = '\0';
+    STATS_ADD(STAT_BYTES_DESERIALIZED, sizeof(uint32_t) + view.usernameLength + view.emailLength);
+}
+
+void paxLeafSelect(void *node, const RowFilter *filter, uint64_t *selection) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t slots = *paxLeafSlots(node);
+    if (filter->column == COLUMN_EMAIL) {
+        predicateStrings(node, paxLeafEmailLengths(node, slots), paxLeafEmailOffsets(node, slots), numCells,
+                         filter->op == FILTER_SUFFIX, filter->value, filter->length, selection);
+    } else if (filter->op == FILTER_SUFFIX) {
+        predicateSuffixFixed(paxLeafUsernames(node, slots), COLUMN_USERNAME_SIZE, numCells, COLUMN_USERNAME_SIZE,
+                             filter->value, filter->length, selection);
+    } else {
+        // Padded like the usernames, so each is a single compare of the whole slot
+        char pattern[COLUMN_USERNAME_SIZE] = {0};
+        memcpy(pattern, filter->value, filter->length);
+        predicateEqualFixed(paxLeafUsernames(node, slots), COLUMN_USERNAME_SIZE, numCells, pattern,
+                            COLUMN_USERNAME_SIZE, selection);
+    }
+}
+
+bool paxLeafHasRoom(void *node, RowView *row) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t slots = *paxLeafSlots(node);
+    uint32_t needed = numCells < slots ? slots : numCells + 1;
+    return paxLeafMinipagesEnd(needed) + row->emailLength <= *paxLeafHeapStart(node);
+}
+
+/*
+ * Lay the minipages out for more slots. Each moves further than the one
+ * before it, so moving them from the last to the first overwrites none.
+ */
+void paxLeafGrow(void *node, uint32_t slots) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t oldSlots = *paxLeafSlots(node);
+    memmove(paxLeafEmailOffsets(node, slots), paxLeafEmailOffsets(node, oldSlots), numCells * sizeof(uint16_t));
+    memmove(paxLeafEmailLengths(node, slots), paxLeafEmailLengths(node, oldSlots), numCells);
+    memmove(paxLeafUsernames(node, slots), paxLeafUsernames(node, oldSlots), numCells * COLUMN_USERNAME_SIZE);
+    *paxLeafSlots(node) = slots;
+}
+
+void paxLeafInsert(void *node, uint32_t cellNum, uint32_t key, RowView *row) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    uint32_t *heapStart = paxLeafHeapStart(node);
+    if (numCells == *paxLeafSlots(node)) {
+        uint32_t room = (*heapStart - row->emailLength - paxLeafMinipagesEnd(numCells)) / PAX_FIXED_ROW_SIZE;
+        paxLeafGrow(node, numCells + (room < PAX_SLOT_GROWTH ? room : PAX_SLOT_GROWTH));
+    }
+
+    uint32_t slots = *paxLeafSlots(node);
+    uint32_t *keys = paxLeafKeys(node);
+    char *usernames = paxLeafUsernames(node, slots);
+    uint8_t *emailLengths = paxLeafEmailLengths(node, slots);
+    uint16_t *emailOffsets = paxLeafEmailOffsets(node, slots);
+    if (cellNum < numCells) {
+        uint32_t moved = numCells - cellNum;
+        memmove(keys + cellNum + 1, keys + cellNum, moved * sizeof(uint32_t));
+        memmove(usernames + (cellNum + 1) * COLUMN_USERNAME_SIZE, usernames + cellNum * COLUMN_USERNAME_SIZE,
+                moved * COLUMN_USERNAME_SIZE);
+        memmove(emailLengths + cellNum + 1, emailLengths + cellNum, moved);
+        memmove(emailOffsets + cellNum + 1, emailOffsets + cellNum, moved * sizeof(uint16_t));
+    }
+
+    keys[cellNum] = key;
+    char *username = usernames + cellNum * COLUMN_USERNAME_SIZE;
+    memset(username, 0, COLUMN_USERNAME_SIZE);
+    memcpy(username, row->username, row->usernameLength);
+    *heapStart -= row->emailLength;
+    memcpy((char *) node + *heapStart, row->email, row->emailLength);
+    emailLengths[cellNum] = (uint8_t) row->emailLength;
+    emailOffsets[cellNum] = (uint16_t) *heapStart;
+    *leafNodeNumCells(node) = numCells + 1;
+}
+
+/* Row i of the cells of the old leaf with the new row placed at cellNum */
+uint32_t paxSplitRow(void *old, uint32_t cellNum, uint32_t key, RowView *row, uint32_t i, RowView *view) {
+    if (i == cellNum) {
+        *view = *row;
+        return key;
+    }
+    uint32_t oldCell = i < cellNum ? i : i - 1;
+    paxLeafView(old, oldCell, view);
+    return *paxLeafKey(old, oldCell);
+}
+
+void paxLeafSplit(void *oldNode, void *newNode, void *scratch, uint32_t pageSize,
+                  uint32_t cellNum, uint32_t key, RowView *row) {
+    memcpy(scratch, oldNode, pageSize);
+    uint32_t numRows = *leafNodeNumCells(scratch) + 1;
+    uint32_t total = paxRowSize(row);
+    RowView view;
+    for (uint32_t i = 0; i + 1 < numRows; i++) {
+        paxLeafView(scratch, i, &view);
+        total += paxRowSize(&view);
+    }
+
+    uint32_t leftCount = 1;
+    uint32_t leftBytes = 0;
+    uint32_t smallestLarger = UINT32_MAX;
+    for (uint32_t i = 0; i + 1 < numRows; i++) {
+        paxSplitRow(scratch, cellNum, key, row, i, &view);
+        leftBytes += paxRowSize(&view);
+        uint32_t larger = leftBytes > total - leftBytes ? leftBytes : total - leftBytes;
+        if (larger < smallestLarger) {
+            smallestLarger = larger;
+            leftCount = i + 1;
+        }
+    }
+
+    // Each half is laid out for the rows it gets
+    paxLeafInitSlots(oldNode, pageSize, leftCount);
+    paxLeafInitSlots(newNode, pageSize, numRows - leftCount);
+    for (uint32_t i = 0; i < numRows; i++) {
+        uint32_t rowKey = paxSplitRow(scratch, cellNum, key, row, i, &view);
+        void *node = i < leftCount ? oldNode : newNode;
+        paxLeafInsert(node, *leafNodeNumCells(node), rowKey, &view);
+    }
+}
+
+void paxLeafRemoveFirst(void *node, void *scratch, uint32_t pageSize, uint32_t count) {
+    memcpy(scratch, node, pageSize);
+    uint32_t numCells = *leafNodeNumCells(scratch);
+    paxLeafInitSlots(node, pageSize, numCells - count);
+    RowView view;
+    for (uint32_t i = count; i < numCells; i++) {
+        paxLeafView(scratch, i, &view);
+        paxLeafInsert(node, i - count, *paxLeafKey(scratch, i), &view);
+    }
+}
+
+uint32_t paxLeafCopy(void *destination, void *source, uint32_t pageSize) {
+    uint32_t slots = *paxLeafSlots(source);
+    if (slots > paxLeafMaxCells(pageSize)) {
+        slots = paxLeafMaxCells(pageSize);
+    }
+    uint32_t numCells = *leafNodeNumCells(source);
+    if (numCells > slots) {
+        numCells = slots;
+    }
+    uint32_t heapStart = *paxLeafHeapStart(source);
+    if (heapStart < paxLeafMinipagesEnd(slots) || heapStart > pageSize) {
+        heapStart = pageSize;
+    }
+
+    // Only the slots in use of each minipage
+    memcpy(destination, source, PAX_MINIPAGES_OFFSET);
+    memcpy(paxLeafKeys(destination), paxLeafKeys(source), numCells * sizeof(uint32_t));
+    memcpy(paxLeafUsernames(destination, slots), paxLeafUsernames(source, slots), numCells * COLUMN_USERNAME_SIZE);
+    memcpy(paxLeafEmailLengths(destination, slots), paxLeafEmailLengths(source, slots), numCells);
+    memcpy(paxLeafEmailOffsets(destination, slots), paxLeafEmailOffsets(source, slots),
+           numCells * sizeof(uint16_t));
+    memcpy(destination + heapStart, source + heapStart, pageSize - heapStart);
+    *leafNodeNumCells(destination) = numCells;
+    *paxLeafSlots(destination) = slots;
+    *paxLeafHeapStart(destination) = heapStart;
+    return numCells;
+}
+
+uint32_t paxLeafCapacity(void *node, uint32_t pageSize) {
+    uint32_t numCells = *leafNodeNumCells(node);
+    if (numCells == 0) {
+        return paxLeafMaxCells(pageSize);
+    }
+    uint32_t used = numCells * PAX_FIXED_ROW_SIZE + (pageSize - *paxLeafHeapStart(node));
+    return (uint32_t) ((uint64_t) numCells * paxLeafSpace(pageSize) / used);
+}
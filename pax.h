@@ -0,0 +1,76 @@
+#ifndef SQLCLONE_PAX_H
+#define SQLCLONE_PAX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+/*
+ * A PAX leaf keeps each column of its rows together in a minipage of its
+ * own, so a scan of one column reads that column's bytes and no others:
+ *
+ *   leaf header, slots, heap start, padding to PAX_MINIPAGES_OFFSET
+ *   keys:           slots of 4 bytes
+ *   usernames:      slots of COLUMN_USERNAME_SIZE bytes, zero padded
+ *   email lengths:  slots of 1 byte
+ *   email offsets:  slots of 2 bytes, where the email is in the page
+ *   free space
+ *   email heap, from heap start to the end of the page
+ *
+ * Entry i of every minipage belongs to cell i, in key order, and the row
+ * id is the key. Usernames are fixed width, so a comparison of one is a
+ * single 32 byte compare; emails vary too much for that and are kept at
+ * their length, which a match checks first. When the slots run out the
+ * minipages are moved apart to make more, as long as the page has room.
+ *
+ * No row takes more than PAX_MAX_ROW_SIZE, so the rows of a full leaf and
+ * one more, shared out by size, always fit in two leaves.
+ */
+#define PAX_MINIPAGES_OFFSET 32
+#define PAX_FIXED_ROW_SIZE (sizeof(uint32_t) + COLUMN_USERNAME_SIZE + sizeof(uint8_t) + sizeof(uint16_t))
+#define PAX_MAX_ROW_SIZE (PAX_FIXED_ROW_SIZE + COLUMN_EMAIL_SIZE)
+// Slots added at a time when a leaf runs out
+#define PAX_SLOT_GROWTH 8
+
+/* Empty the leaf. The common header is left as it is. */
+void paxLeafInit(void *node, uint32_t pageSize);
+
+uint32_t paxLeafMaxCells(uint32_t pageSize);
+
+uint32_t *paxLeafKey(void *node, uint32_t cellNum);
+
+/* The row, with its strings left in the page. */
+void paxLeafView(void *node, uint32_t cellNum, RowView *row);
+
+void paxLeafRead(void *node, uint32_t cellNum, Row *row);
+
+/* Set the bit of each cell that passes the filter, reading its column alone. */
+void paxLeafSelect(void *node, const RowFilter *filter, uint64_t *selection);
+
+bool paxLeafHasRoom(void *node, RowView *row);
+
+/* Add a row at cellNum, which the leaf must have room for. */
+void paxLeafInsert(void *node, uint32_t cellNum, uint32_t key, RowView *row);
+
+/*
+ * Share the cells of a full leaf and the new row between it and an
+ * empty PAX leaf, at the point that leaves the larger half smallest.
+ * scratch is a page to work from.
+ */
+void paxLeafSplit(void *oldNode, void *newNode, void *scratch, uint32_t pageSize,
+                  uint32_t cellNum, uint32_t key, RowView *row);
+
+/* Drop the first count cells and their emails. */
+void paxLeafRemoveFirst(void *node, void *scratch, uint32_t pageSize, uint32_t count);
+
+/*
+ * Copy the minipages and the heap of a leaf that may be torn; the result
+ * stays inside the page whatever was read. Returns the cell count.
+ */
+uint32_t paxLeafCopy(void *destination, void *source, uint32_t pageSize);
+
+/* How many rows like the ones there the leaf could hold. */
+uint32_t paxLeafCapacity(void *node, uint32_t pageSize);
+
+#endif //SQLCLONE_PAX_H
@@ -0,0 +1,360 @@
+#include "predicate.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PREDICATE_X86
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    const char *name;
+    void (*equalFixed)(const uint8_t *base, uint32_t stride, uint32_t count,
+                       const uint8_t *pattern, uint32_t width, uint64_t *selection);
+    void (*suffixFixed)(const uint8_t *base, uint32_t stride, uint32_t count, uint32_t width,
+                        const uint8_t *suffix, uint32_t length, uint64_t *selection);
+    void (*equalCodes)(const uint8_t *cells, uint32_t count, uint32_t fieldOffset, uint16_t code,
+                       uint64_t *selection);
+    // Lengths equal to length, or at least length
+    void (*lengths)(const uint8_t *lengths, uint32_t count, uint8_t length, bool atLeast, uint64_t *selection);
+} PredicateKernels;
+
+void predicateSet(uint64_t *selection, uint32_t index) {
+    selection[index / 64] |= (uint64_t) 1 << (index % 64);
+}
+
+bool predicateTest(const uint64_t *selection, uint32_t index) {
+    return (selection[index / 64] >> (index % 64)) & 1;
+}
+
+/* Whether a string ending at end, length bytes long, ends in the suffix */
+bool predicateEndsWith(const uint8_t *end, uint32_t length, const uint8_t *suffix, uint32_t suffixLength) {
+    return length >= suffixLength && memcmp(end - suffixLength, suffix, suffixLength) == 0;
+}
+
+void predicateEqualFixedScalar(const uint8_t *base, uint32_t stride, uint32_t count,
+                               const uint8_t *pattern, uint32_t width, uint64_t *selection) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (memcmp(base + (size_t) i * stride, pattern, width) == 0) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+void predicateSuffixFixedScalar(const uint8_t *base, uint32_t stride, uint32_t count, uint32_t width,
+                                const uint8_t *suffix, uint32_t length, uint64_t *selection) {
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *cell = base + (size_t) i * stride;
+        uint32_t cellLength = strnlen((const char *) cell, width);
+        if (predicateEndsWith(cell + cellLength, cellLength, suffix, length)) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+/* Cells from first on; the vector kernels finish with this */
+void predicateEqualCodesFrom(const uint8_t *cells, uint32_t first, uint32_t count, uint32_t fieldOffset,
+                             uint16_t code, uint64_t *selection) {
+    for (uint32_t i = first; i < count; i++) {
+        uint16_t cellCode;
+        memcpy(&cellCode, cells + i * 8 + fieldOffset, sizeof(cellCode));
+        if (cellCode == code) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+void predicateEqualCodesScalar(const uint8_t *cells, uint32_t count, uint32_t fieldOffset, uint16_t code,
+                               uint64_t *selection) {
+    predicateEqualCodesFrom(cells, 0, count, fieldOffset, code, selection);
+}
+
+void predicateLengthsFrom(const uint8_t *lengths, uint32_t first, uint32_t count, uint8_t length, bool atLeast,
+                          uint64_t *selection) {
+    for (uint32_t i = first; i < count; i++) {
+        if (lengths[i] == length || (atLeast && lengths[i] > length)) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+void predicateLengthsScalar(const uint8_t *lengths, uint32_t count, uint8_t length, bool atLeast,
+                            uint64_t *selection) {
+    predicateLengthsFrom(lengths, 0, count, length, atLeast, selection);
+}
+
+const PredicateKernels PREDICATE_SCALAR = {
+        "scalar", predicateEqualFixedScalar, predicateSuffixFixedScalar, predicateEqualCodesScalar,
+        predicateLengthsScalar
+};
+
+#ifdef PREDICATE_X86
+
+/*
+ * The vector kernels compare 16 or 32 bytes at a time and leave what is
+ * left of a cell, less than a vector, to the scalar code; no load goes
+ * past the bytes a kernel was given.
+ */
+__attribute__((target("sse2")))
+void predicateEqualFixedSse2(const uint8_t *base, uint32_t stride, uint32_t count,
+                             const uint8_t *pattern, uint32_t width, uint64_t *selection) {
+    uint32_t vectorWidth = width & ~15u;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *cell = base + (size_t) i * stride;
+        uint32_t j = 0;
+        while (j < vectorWidth) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *) (cell + j));
+            __m128i expected = _mm_loadu_si128((const __m128i *) (pattern + j));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, expected)) != 0xFFFF) {
+                break;
+            }
+            j += 16;
+        }
+        if (j == vectorWidth && memcmp(cell + j, pattern + j, width - j) == 0) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+void predicateSuffixFixedSse2(const uint8_t *base, uint32_t stride, uint32_t count, uint32_t width,
+                              const uint8_t *suffix, uint32_t length, uint64_t *selection) {
+    __m128i zero = _mm_setzero_si128();
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *cell = base + (size_t) i * stride;
+        // Where the padding starts
+        uint32_t cellLength = 0;
+        uint32_t zeros = 0;
+        while (cellLength + 16 <= width) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *) (cell + cellLength));
+            zeros = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+            if (zeros != 0) {
+                break;
+            }
+            cellLength += 16;
+        }
+        if (zeros != 0) {
+            cellLength += __builtin_ctz(zeros);
+        } else {
+            cellLength += strnlen((const char *) cell + cellLength, width - cellLength);
+        }
+        if (predicateEndsWith(cell + cellLength, cellLength, suffix, length)) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+/* Two cells of 8 bytes to a vector */
+__attribute__((target("sse2")))
+void predicateEqualCodesSse2(const uint8_t *cells, uint32_t count, uint32_t fieldOffset, uint16_t code,
+                             uint64_t *selection) {
+    __m128i needle = _mm_set1_epi16((short) code);
+    uint32_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i codes = _mm_loadu_si128((const __m128i *) (cells + i * 8));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi16(codes, needle));
+        uint64_t bits = ((mask >> fieldOffset) & 1) | ((mask >> (fieldOffset + 7)) & 2);
+        selection[i / 64] |= bits << (i % 64);
+    }
+    predicateEqualCodesFrom(cells, i, count, fieldOffset, code, selection);
+}
+
+__attribute__((target("sse2")))
+void predicateLengthsSse2(const uint8_t *lengths, uint32_t count, uint8_t length, bool atLeast,
+                          uint64_t *selection) {
+    __m128i target = _mm_set1_epi8((char) length);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i values = _mm_loadu_si128((const __m128i *) (lengths + i));
+        // An unsigned value is at least the target when the larger of the two is itself
+        __m128i compared = atLeast ? _mm_max_epu8(values, target) : target;
+        uint64_t bits = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(values, compared));
+        selection[i / 64] |= bits << (i % 64);
+    }
+    predicateLengthsFrom(lengths, i, count, length, atLeast, selection);
+}
+
+const PredicateKernels PREDICATE_SSE2 = {
+        "sse2", predicateEqualFixedSse2, predicateSuffixFixedSse2, predicateEqualCodesSse2, predicateLengthsSse2
+};
+
+__attribute__((target("avx2")))
+void predicateEqualFixedAvx2(const uint8_t *base, uint32_t stride, uint32_t count,
+                             const uint8_t *pattern, uint32_t width, uint64_t *selection) {
+    uint32_t vectorWidth = width & ~31u;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *cell = base + (size_t) i * stride;
+        uint32_t j = 0;
+        while (j < vectorWidth) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i *) (cell + j));
+            __m256i expected = _mm256_loadu_si256((const __m256i *) (pattern + j));
+            if ((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, expected)) != UINT32_MAX) {
+                break;
+            }
+            j += 32;
+        }
+        if (j == vectorWidth && memcmp(cell + j, pattern + j, width - j) == 0) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void predicateSuffixFixedAvx2(const uint8_t *base, uint32_t stride, uint32_t count, uint32_t width,
+                              const uint8_t *suffix, uint32_t length, uint64_t *selection) {
+    __m256i zero = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *cell = base + (size_t) i * stride;
+        uint32_t cellLength = 0;
+        uint32_t zeros = 0;
+        while (cellLength + 32 <= width) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i *) (cell + cellLength));
+            zeros = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero));
+            if (zeros != 0) {
+                break;
+            }
+            cellLength += 32;
+        }
+        if (zeros != 0) {
+            cellLength += __builtin_ctz(zeros);
+        } else {
+            cellLength += strnlen((const char *) cell + cellLength, width - cellLength);
+        }
+        if (predicateEndsWith(cell + cellLength, cellLength, suffix, length)) {
+            predicateSet(selection, i);
+        }
+    }
+}
+
+/* Four cells of 8 bytes to a vector */
+__attribute__((target("avx2")))
+void predicateEqualCodesAvx2(const uint8_t *cells, uint32_t count, uint32_t fieldOffset, uint16_t code,
+                             uint64_t *selection) {
+    __m256i needle = _mm256_set1_epi16((short) code);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i codes = _mm256_loadu_si256((const __m256i *) (cells + i * 8));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi16(codes, needle));
+        uint64_t bits = ((mask >> fieldOffset) & 1) | ((mask >> (fieldOffset + 7)) & 2) |
+                        ((mask >> (fieldOffset + 14)) & 4) | ((mask >> (fieldOffset + 21)) & 8);
+        selection[i / 64] |= bits << (i % 64);
+    }
+    predicateEqualCodesFrom(cells, i, count, fieldOffset, code, selection);
+}
+
+__attribute__((target("avx2")))
+void predicateLengthsAvx2(const uint8_t *lengths, uint32_t count, uint8_t length, bool atLeast,
+                          uint64_t *selection) {
+    __m256i target = _mm256_set1_epi8((char) length);
+    uint32_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i values = _mm256_loadu_si256((const __m256i *) (lengths + i));
+        __m256i compared = atLeast ? _mm256_max_epu8(values, target) : target;
+        uint64_t bits = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(values, compared));
+        selection[i / 64] |= bits << (i % 64);
+    }
+    predicateLengthsFrom(lengths, i, count, length, atLeast, selection);
+}
+
+const PredicateKernels PREDICATE_AVX2 = {
+        "avx2", predicateEqualFixedAvx2, predicateSuffixFixedAvx2, predicateEqualCodesAvx2, predicateLengthsAvx2
+};
+
+#endif
+
+const PredicateKernels *predicateChosen = &PREDICATE_SCALAR;
+pthread_once_t predicateChooseOnce = PTHREAD_ONCE_INIT;
+
+void predicateChoose(void) {
+#ifdef PREDICATE_X86
+    const char *limit = getenv("SQLCLONE_SIMD");
+    if (limit != NULL && strcmp(limit, "scalar") == 0) {
+        return;
+    }
+    __builtin_cpu_init();
+    bool sse2Only = limit != NULL && strcmp(limit, "sse2") == 0;
+    if (!sse2Only && __builtin_cpu_supports("avx2")) {
+        predicateChosen = &PREDICATE_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        predicateChosen = &PREDICATE_SSE2;
+    }
+#endif
+}
+
+const PredicateKernels *predicateKernels(void) {
+    pthread_once(&predicateChooseOnce, predicateChoose);
+    return predicateChosen;
+}
+
+const char *predicateKernelName(void) {
+    return predicateKernels()->name;
+}
+
+void predicateClear(uint64_t *selection, uint32_t count) {
+    memset(selection, 0, PREDICATE_WORDS(count) * sizeof(uint64_t));
+}
+
+void predicateEqualFixed(const void *base, uint32_t stride, uint32_t count,
+                         const void *pattern, uint32_t width, uint64_t *selection) {
+    predicateClear(selection, count);
+    predicateKernels()->equalFixed(base, stride, count, pattern, width, selection);
+}
+
+void predicateSuffixFixed(const void *base, uint32_t stride, uint32_t count, uint32_t width,
+                          const void *suffix, uint32_t length, uint64_t *selection) {
+    predicateClear(selection, count);
+    predicateKernels()->suffixFixed(base, stride, count, width, suffix, length, selection);
+}
+
+void predicateEqualCodes(const void *cells, uint32_t count, uint32_t fieldOffset, uint16_t code,
+                         uint64_t *selection) {
+    predicateClear(selection, count);
+    predicateKernels()->equalCodes(cells, count, fieldOffset, code, selection);
+}
+
+void predicateStrings(const void *page, const uint8_t *lengths, const uint16_t *offsets, uint32_t count,
+                      bool suffix, const void *value, uint32_t length, uint64_t *selection) {
+    predicateClear(selection, count);
+    if (length > UINT8_MAX) {
+        return;
+    }
+    predicateKernels()->lengths(lengths, count, (uint8_t) length, suffix, selection);
+
+    // Only the strings of the right length are read
+    for (uint32_t i = predicateNext(selection, 0, count); i < count; i = predicateNext(selection, i + 1, count)) {
+        const uint8_t *string = (const uint8_t *) page + offsets[i];
+        const uint8_t *start = suffix ? string + lengths[i] - length : string;
+        if (memcmp(start, value, length) != 0) {
+            selection[i / 64] &= ~((uint64_t) 1 << (i % 64));
+        }
+    }
+}
+
+uint32_t predicateNext(const uint64_t *selection, uint32_t from, uint32_t count) {
+    while (from < count) {
+        uint64_t word = selection[from / 64] >> (from % 64);
+        if (word != 0) {
+            uint32_t next = from + __builtin_ctzll(word);
+            return next < count ? next : count;
+        }
+        from = (from / 64 + 1) * 64;
+    }
+    return count;
+}
+
+uint32_t predicateCount(const uint64_t *selection, uint32_t from, uint32_t count) {
+    uint32_t total = 0;
+    while (from < count) {
+        uint64_t word = selection[from / 64] >> (from % 64);
+        uint32_t bits = 64 - from % 64;
+        if (count - from < bits) {
+            word &= ((uint64_t) 1 << (count - from)) - 1;
+            bits = count - from;
+        }
+        total += __builtin_popcountll(word);
+        from += bits;
+    }
+    return total;
+}
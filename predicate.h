@@ -0,0 +1,54 @@
+#ifndef SQLCLONE_PREDICATE_H
+#define SQLCLONE_PREDICATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Kernels that test one column of every cell of a leaf in a single pass
+ * and set bit i of a selection bitmap for each cell i that passes. Each
+ * has a scalar, an SSE2 and an AVX2 version; the best one the processor
+ * runs is picked on first use, up to the level SQLCLONE_SIMD names:
+ * scalar, sse2 or avx2. .constants shows which. Cells are read in page order and once, so a filtered
+ * scan goes as fast as memory delivers the column.
+ *
+ * Fixed width strings are padded with zeroes, as rows and PAX usernames
+ * are. A selection holds PREDICATE_WORDS(count) words; the kernels clear
+ * it first.
+ */
+#define PREDICATE_WORDS(bits) (((bits) + 63) / 64)
+
+/* The name of the kernels in use: scalar, sse2 or avx2 */
+const char *predicateKernelName(void);
+
+/* Cells whose first width bytes, at base + i * stride, are the pattern's */
+void predicateEqualFixed(const void *base, uint32_t stride, uint32_t count,
+                         const void *pattern, uint32_t width, uint64_t *selection);
+
+/* Cells whose zero padded string of up to width bytes ends in the suffix */
+void predicateSuffixFixed(const void *base, uint32_t stride, uint32_t count, uint32_t width,
+                          const void *suffix, uint32_t length, uint64_t *selection);
+
+/* Cells of 8 bytes whose two byte code at fieldOffset is the given code */
+void predicateEqualCodes(const void *cells, uint32_t count, uint32_t fieldOffset, uint16_t code,
+                         uint64_t *selection);
+
+/*
+ * Strings kept in the page at offsets with their lengths beside them
+ * that equal the value, or end in it. The lengths rule out most cells
+ * before any of their bytes are read.
+ */
+void predicateStrings(const void *page, const uint8_t *lengths, const uint16_t *offsets, uint32_t count,
+                      bool suffix, const void *value, uint32_t length, uint64_t *selection);
+
+void predicateSet(uint64_t *selection, uint32_t index);
+
+bool predicateTest(const uint64_t *selection, uint32_t index);
+
+/* The first selected index from from on, or count if there is none */
+uint32_t predicateNext(const uint64_t *selection, uint32_t from, uint32_t count);
+
+/* How many indexes from from up to count are selected */
+uint32_t predicateCount(const uint64_t *selection, uint32_t from, uint32_t count);
+
+#endif //SQLCLONE_PREDICATE_H
@@ -0,0 +1,405 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "output.h"
+#include "statement.h"
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_READ_SIZE (64 * 1024)
+/* A client with this much unsent output is not read from until it catches up */
+#define SERVER_MAX_PENDING_OUTPUT (4 << 20)
+
+typedef struct Connection {
+    int fileDescriptor;
+    char *input;
+    size_t inputCapacity;
+    size_t inputLength;
+    OutputBuffer output;
+    size_t outputSent;
+    // Temporaries of the request being executed
+    Arena arena;
+    uint32_t events;
+    // The client has shut down its side; close once the replies are out.
+    bool closing;
+    struct Connection *previous;
+    struct Connection *next;
+} Connection;
+
+volatile sig_atomic_t serverStopRequested = 0;
+
+void serverRequestStop(int signalNumber) {
+    (void) signalNumber;
+    serverStopRequested = 1;
+}
+
+bool serverParseAddress(const char *address, struct sockaddr_storage *socketAddress, socklen_t *length) {
+    memset(socketAddress, 0, sizeof(*socketAddress));
+
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un *unixAddress = (struct sockaddr_un *) socketAddress;
+        const char *path = address + 5;
+        if (*path == 0 || strlen(path) >= sizeof(unixAddress->sun_path)) {
+            return false;
+        }
+        unixAddress->sun_family = AF_UNIX;
+        strcpy(unixAddress->sun_path, path);
+        *length = sizeof(struct sockaddr_un);
+        return true;
+    }
+
+    char host[INET_ADDRSTRLEN] = "127.0.0.1";
+    const char *port = address;
+    const char *colon = strrchr(address, ':');
+    if (colon != NULL) {
+        size_t hostLength = colon - address;
+        if (hostLength >= sizeof(host)) {
+            return false;
+        }
+        if (hostLength == 9 && memcmp(address, "localhost", 9) == 0) {
+            strcpy(host, "127.0.0.1");
+        } else if (hostLength > 0) {
+            memcpy(host, address, hostLength);
+            host[hostLength] = 0;
+        }
+        port = colon + 1;
+    }
+
+    char *end;
+    long portNumber = strtol(port, &end, 10);
+    if (*port == 0 || *end != 0 || portNumber <= 0 || portNumber > 65535) {
+        return false;
+    }
+
+    struct sockaddr_in *inetAddress = (struct sockaddr_in *) socketAddress;
+    inetAddress->sin_family = AF_INET;
+    inetAddress->sin_port = htons((uint16_t) portNumber);
+    if (inet_pton(AF_INET, host, &(inetAddress->sin_addr)) != 1) {
+        return false;
+    }
+    // Only serve the local machine: there is no authentication.
+    if ((ntohl(inetAddress->sin_addr.s_addr) >> 24) != 127) {
+        return false;
+    }
+    *length = sizeof(struct sockaddr_in);
+    return true;
+}
+
+int serverListen(const char *address) {
+    struct sockaddr_storage socketAddress;
+    socklen_t length;
+    if (!serverParseAddress(address, &socketAddress, &length)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fileDescriptor = socket(socketAddress.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fileDescriptor == -1) {
+        return -1;
+    }
+
+    if (socketAddress.ss_family == AF_UNIX) {
+        // Replace a socket left behind by an earlier server, but nothing else.
+        const char *path = ((struct sockaddr_un *) &socketAddress)->sun_path;
+        struct stat pathStat;
+        if (stat(path, &pathStat) == 0 && S_ISSOCK(pathStat.st_mode)) {
+            unlink(path);
+        }
+    } else {
+        int enable = 1;
+        setsockopt(fileDescriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    }
+
+    if (bind(fileDescriptor, (struct sockaddr *) &socketAddress, length) == -1 ||
+        listen(fileDescriptor, SOMAXCONN) == -1) {
+        int error = errno;
+        close(fileDescriptor);
+        errno = error;
+        return -1;
+    }
+    return fileDescriptor;
+}
+
+void serverClose(int listenFileDescriptor, const char *address) {
+    close(listenFileDescriptor);
+    if (strncmp(address, "unix:", 5) == 0) {
+        unlink(address + 5);
+    }
+}
+
+/*
+ * Run one request and append its reply frame. The statement text and
+ * bound fields point straight into the connection's input buffer.
+ */
+void serverExecute(Table *table, OutputBuffer *output, Arena *arena, char *request, uint32_t length) {
+    size_t frameStart = output->length;
+    outputReserve(output, SERVER_FRAME_HEADER_SIZE + 1);
+    output->length += SERVER_FRAME_HEADER_SIZE + 1;
+
+    InputBuffer input = {request, length, length};
+    Statement statement;
+    SQLCloneResult result = prepareResultCode(prepareStatement(&input, &statement, arena));
+    if (result == SQLCLONE_OK) {
+        result = executeResultCode(executeStatement(&statement, table));
+        if (result == SQLCLONE_DONE && statement.type == STATEMENT_SELECT) {
+            Row row;
+            while (statementNextRow(&statement, &row)) {
+                formatRow(output, OUTPUT_BINARY, &row);
+            }
+            formatResultEnd(output, OUTPUT_BINARY);
+            statementReset(&statement);
+        } else if (result == SQLCLONE_DONE && statement.type == STATEMENT_COUNT) {
+            formatCount(output, OUTPUT_BINARY, statement.count);
+            formatResultEnd(output, OUTPUT_BINARY);
+        }
+    }
+
+    // Rows may have moved the buffer, so find the header again.
+    char *frame = output->data + frameStart;
+    formatLittleEndian(frame, output->length - frameStart - SERVER_FRAME_HEADER_SIZE, SERVER_FRAME_HEADER_SIZE);
+    frame[SERVER_FRAME_HEADER_SIZE] = (char) result;
+}
+
+/*
+ * Execute every complete request that has arrived. Pipelined requests
+ * all land in the same output buffer and go out with a single send.
+ */
+void serverProcessInput(Table *table, Connection *connection) {
+    size_t position = 0;
+    while (connection->inputLength - position >= SERVER_FRAME_HEADER_SIZE) {
+        if (connection->output.length - connection->outputSent > SERVER_MAX_PENDING_OUTPUT) {
+            break;
+        }
+        uint32_t length = parseLittleEndian(connection->input + position, SERVER_FRAME_HEADER_SIZE);
+        if (length > SERVER_MAX_REQUEST_SIZE) {
+            // Not a client we understand; drop everything it sent.
+            connection->closing = true;
+            position = connection->inputLength;
+            break;
+        }
+        if (connection->inputLength - position < SERVER_FRAME_HEADER_SIZE + length) {
+            break;
+        }
+        serverExecute(table, &(connection->output), &(connection->arena),
+                      connection->input + position + SERVER_FRAME_HEADER_SIZE, length);
+        position += SERVER_FRAME_HEADER_SIZE + length;
+    }
+
+    memmove(connection->input, connection->input + position, connection->inputLength - position);
+    connection->inputLength -= position;
+}
+
+/* Returns false if the connection failed. */
+bool serverReadInput(Connection *connection) {
+    while (true) {
+        if (connection->inputLength == connection->inputCapacity) {
+            // Only grow far enough for one maximum sized request.
+            if (connection->inputCapacity >= SERVER_FRAME_HEADER_SIZE + SERVER_MAX_REQUEST_SIZE) {
+                return true;
+            }
+            connection->inputCapacity *= 2;
+            connection->input = realloc(connection->input, connection->inputCapacity);
+        }
+
+        ssize_t result = read(connection->fileDescriptor, connection->input + connection->inputLength,
+                              connection->inputCapacity - connection->inputLength);
+        if (result > 0) {
+            connection->inputLength += result;
+        } else if (result == 0) {
+            connection->closing = true;
+            return true;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+/* Returns false if the connection failed. */
+bool serverWriteOutput(Connection *connection) {
+    OutputBuffer *output = &(connection->output);
+    while (connection->outputSent < output->length) {
+        ssize_t result = send(connection->fileDescriptor, output->data + connection->outputSent,
+                              output->length - connection->outputSent, MSG_NOSIGNAL);
+        if (result >= 0) {
+            connection->outputSent += result;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+
+    output->length = 0;
+    connection->outputSent = 0;
+    // Give back the memory of a large select once it has been sent.
+    if (output->capacity > SERVER_MAX_PENDING_OUTPUT) {
+        free(output->data);
+        outputInit(output, -1, SERVER_READ_SIZE);
+    }
+    return true;
+}
+
+bool serverHasPendingOutput(Connection *connection) {
+    return connection->outputSent < connection->output.length;
+}
+
+void serverDropConnection(int epollFileDescriptor, Connection **connections, Connection *connection) {
+    epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, connection->fileDescriptor, NULL);
+    close(connection->fileDescriptor);
+
+    if (connection->previous != NULL) {
+        connection->previous->next = connection->next;
+    } else {
+        *connections = connection->next;
+    }
+    if (connection->next != NULL) {
+        connection->next->previous = connection->previous;
+    }
+
+    free(connection->input);
+    free(connection->output.data);
+    arenaFree(&(connection->arena));
+    free(connection);
+}
+
+void serverAccept(int epollFileDescriptor, int listenFileDescriptor, Connection **connections) {
+    while (true) {
+        int fileDescriptor = accept4(listenFileDescriptor, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fileDescriptor == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+
+        // Replies are already batched; don't let Nagle hold them back.
+        int enable = 1;
+        setsockopt(fileDescriptor, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        Connection *connection = calloc(1, sizeof(Connection));
+        connection->fileDescriptor = fileDescriptor;
+        connection->inputCapacity = SERVER_READ_SIZE;
+        connection->input = malloc(connection->inputCapacity);
+        outputInit(&(connection->output), -1, SERVER_READ_SIZE);
+        arenaInit(&(connection->arena));
+        connection->events = EPOLLIN;
+
+        struct epoll_event event = {.events = connection->events, .data.ptr = connection};
+        if (epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, fileDescriptor, &event) == -1) {
+            close(fileDescriptor);
+            free(connection->input);
+            free(connection->output.data);
+            free(connection);
+            continue;
+        }
+
+        connection->next = *connections;
+        if (*connections != NULL) {
+            (*connections)->previous = connection;
+        }
+        *connections = connection;
+    }
+}
+
+/*
+ * Bring the connection up to date after an event: run whatever requests
+ * are complete, send the replies, and decide what to wait for next.
+ * Returns false once the connection should be dropped.
+ */
+bool serverService(int epollFileDescriptor, Table *table, Connection *connection, uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        return false;
+    }
+    if ((events & EPOLLIN) && !serverReadInput(connection)) {
+        return false;
+    }
+
+    // Writing may free up room for requests held back by backpressure.
+    do {
+        serverProcessInput(table, connection);
+        if (!serverWriteOutput(connection)) {
+            return false;
+        }
+    } while (!serverHasPendingOutput(connection) && connection->inputLength >= SERVER_FRAME_HEADER_SIZE &&
+             connection->inputLength >= SERVER_FRAME_HEADER_SIZE +
+                                        parseLittleEndian(connection->input, SERVER_FRAME_HEADER_SIZE));
+
+    if (connection->closing && !serverHasPendingOutput(connection)) {
+        return false;
+    }
+
+    uint32_t wanted = 0;
+    if (!connection->closing && connection->output.length - connection->outputSent <= SERVER_MAX_PENDING_OUTPUT) {
+        wanted |= EPOLLIN;
+    }
+    if (serverHasPendingOutput(connection)) {
+        wanted |= EPOLLOUT;
+    }
+    if (wanted != connection->events) {
+        connection->events = wanted;
+        struct epoll_event event = {.events = wanted, .data.ptr = connection};
+        epoll_ctl(epollFileDescriptor, EPOLL_CTL_MOD, connection->fileDescriptor, &event);
+    }
+    return true;
+}
+
+void serverRun(Table *table, int listenFileDescriptor) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serverRequestStop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFileDescriptor == -1) {
+        printf("Unable to create epoll instance: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // The listening socket is the only one registered without a connection.
+    struct epoll_event listenEvent = {.events = EPOLLIN, .data.ptr = NULL};
+    epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, listenFileDescriptor, &listenEvent);
+
+    Connection *connections = NULL;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+
+    while (!serverStopRequested) {
+        int count = epoll_wait(epollFileDescriptor, events, SERVER_MAX_EVENTS, -1);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            Connection *connection = events[i].data.ptr;
+            if (connection == NULL) {
+                serverAccept(epollFileDescriptor, listenFileDescriptor, &connections);
+            } else if (!serverService(epollFileDescriptor, table, connection, events[i].events)) {
+                serverDropConnection(epollFileDescriptor, &connections, connection);
+            }
+        }
+    }
+
+    while (connections != NULL) {
+        serverDropConnection(epollFileDescriptor, &connections, connections);
+    }
+    close(epollFileDescriptor);
+}
@@ -0,0 +1,38 @@
+#ifndef SQLCLONE_SERVER_H
+#define SQLCLONE_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "btree.h"
+
+/*
+ * Wire protocol. Every frame is a u32 little endian length followed by
+ * that many bytes. A request frame carries one statement in shell syntax.
+ * Clients may pipeline any number of requests; each one gets exactly one
+ * reply frame, in order, holding a status byte (an SQLCloneResult) and,
+ * for a successful select, the rows in the binary result format ending
+ * with an empty row frame. A count is sent the same way, as one row.
+ */
+#define SERVER_FRAME_HEADER_SIZE 4
+#define SERVER_MAX_REQUEST_SIZE (64 * 1024)
+
+/*
+ * Addresses are "unix:<path>" for a Unix domain socket or "[host:]port"
+ * for TCP. TCP hosts default to 127.0.0.1 and must be loopback.
+ */
+bool serverParseAddress(const char *address, struct sockaddr_storage *socketAddress, socklen_t *length);
+
+/* Returns the listening socket, or -1 with errno set. */
+int serverListen(const char *address);
+
+/*
+ * Serve clients from a single epoll loop until SIGINT or SIGTERM.
+ * The table stays open, and its pages cached, across connections.
+ */
+void serverRun(Table *table, int listenFileDescriptor);
+
+void serverClose(int listenFileDescriptor, const char *address);
+
+#endif //SQLCLONE_SERVER_H
@@ -0,0 +1,437 @@
+#include "statement.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "vacuum.h"
+
+void lexerInit(Lexer *lexer, const char *input, size_t length) {
+    lexer->position = input;
+    lexer->end = input + length;
+}
+
+bool lexerNext(Lexer *lexer, Token *token) {
+    const char *position = lexer->position;
+    while (position < lexer->end && (*position == ' ' || *position == '\t')) {
+        position++;
+    }
+    const char *start = position;
+    while (position < lexer->end && *position != ' ' && *position != '\t') {
+        position++;
+    }
+    lexer->position = position;
+    token->start = start;
+    token->length = position - start;
+    return token->length > 0;
+}
+
+bool tokenEquals(Token *token, const char *word, uint32_t length) {
+    return token->length == length && memcmp(token->start, word, length) == 0;
+}
+
+bool tokenIsParameter(Token *token) {
+    return token->length == 1 && token->start[0] == '?';
+}
+
+PrepareResult parseId(Token *token, uint32_t *id) {
+    const char *digit = token->start;
+    const char *end = token->start + token->length;
+
+    if (*digit == '-') {
+        return (token->length > 1) ? PREPARE_NEGATIVE_ID : PREPARE_SYNTAX_ERROR;
+    }
+
+    uint32_t value = 0;
+    for (; digit < end; digit++) {
+        uint32_t d = (uint32_t) (*digit - '0');
+        if (d > 9) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        if (value > (UINT32_MAX - d) / 10) {
+            return PREPARE_ID_TOO_LARGE;
+        }
+        value = value * 10 + d;
+    }
+
+    *id = value;
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult prepareInsert(Lexer *lexer, Statement *statement) {
+    statement->type = STATEMENT_INSERT;
+    statement->cursor = NULL;
+    statement->numParams = 0;
+    statement->boundMask = 0;
+    statement->hasFilter = false;
+
+    Token idToken, username, email, extra;
+    if (!lexerNext(lexer, &idToken) || !lexerNext(lexer, &username) || !lexerNext(lexer, &email)) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    if (lexerNext(lexer, &extra)) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    if (tokenIsParameter(&idToken)) {
+        statement->paramColumns[statement->numParams++] = COLUMN_ID;
+    } else {
+        PrepareResult result = parseId(&idToken, &(statement->rowToInsert.id));
+        if (result != PREPARE_SUCCESS) {
+            return result;
+        }
+    }
+
+    if (tokenIsParameter(&username)) {
+        statement->paramColumns[statement->numParams++] = COLUMN_USERNAME;
+    } else if (username.length > COLUMN_USERNAME_SIZE) {
+        return PREPARE_STRING_TOO_LONG;
+    } else {
+        statement->rowToInsert.username = username.start;
+        statement->rowToInsert.usernameLength = username.length;
+    }
+
+    if (tokenIsParameter(&email)) {
+        statement->paramColumns[statement->numParams++] = COLUMN_EMAIL;
+    } else if (email.length > COLUMN_EMAIL_SIZE) {
+        return PREPARE_STRING_TOO_LONG;
+    } else {
+        statement->rowToInsert.email = email.start;
+        statement->rowToInsert.emailLength = email.length;
+    }
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+ * where <username|email> = <value>, or like %<suffix> for the rows whose
+ * value ends in the suffix. Only a leading % is a wildcard; a parameter
+ * takes its place as =? or like %?.
+ */
+PrepareResult prepareWhere(Lexer *lexer, Statement *statement) {
+    Token column, comparison, value, extra;
+    if (!lexerNext(lexer, &column) || !lexerNext(lexer, &comparison) || !lexerNext(lexer, &value) ||
+        lexerNext(lexer, &extra)) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    if (tokenEquals(&comparison, "=", 1)) {
+        statement->filter.op = FILTER_EQUALS;
+    } else if (tokenEquals(&comparison, "like", 4) && value.start[0] == '%') {
+        statement->filter.op = FILTER_SUFFIX;
+        value.start++;
+        value.length--;
+    } else {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    uint32_t maxLength;
+    if (tokenEquals(&column, "username", 8)) {
+        statement->filter.column = COLUMN_USERNAME;
+        maxLength = COLUMN_USERNAME_SIZE;
+    } else if (tokenEquals(&column, "email", 5)) {
+        statement->filter.column = COLUMN_EMAIL;
+        maxLength = COLUMN_EMAIL_SIZE;
+    } else {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    if (tokenIsParameter(&value)) {
+        statement->paramColumns[statement->numParams++] = statement->filter.column;
+    } else if (value.length > maxLength) {
+        return PREPARE_STRING_TOO_LONG;
+    } else {
+        statement->filter.value = value.start;
+        statement->filter.length = value.length;
+    }
+    statement->hasFilter = true;
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult prepareStatement(InputBuffer *inputBuffer, Statement *statement, Arena *arena) {
+    Lexer lexer;
+    Token keyword, extra;
+    lexerInit(&lexer, inputBuffer->buffer, inputBuffer->inputLength);
+    statement->arena = arena;
+
+    if (!lexerNext(&lexer, &keyword)) {
+        return PREPARE_UNRECOGNIZED_STATEMENT;
+    }
+    if (tokenEquals(&keyword, "insert", 6)) {
+        return prepareInsert(&lexer, statement);
+    }
+    if (tokenEquals(&keyword, "select", 6)) {
+        statement->type = STATEMENT_SELECT;
+        statement->cursor = NULL;
+        statement->numParams = 0;
+        statement->boundMask = 0;
+        statement->hasFilter = false;
+        bool more = lexerNext(&lexer, &extra);
+        if (more && tokenEquals(&extra, "count(*)", 8)) {
+            statement->type = STATEMENT_COUNT;
+            more = lexerNext(&lexer, &extra);
+        }
+        if (more) {
+            return tokenEquals(&extra, "where", 5) ? prepareWhere(&lexer, statement) : PREPARE_SYNTAX_ERROR;
+        }
+        return PREPARE_SUCCESS;
+    }
+    if (tokenEquals(&keyword, "vacuum", 6)) {
+        statement->type = STATEMENT_VACUUM;
+        statement->vacuumLeaves = 0;
+        if (lexerNext(&lexer, &extra)) {
+            PrepareResult result = parseId(&extra, &(statement->vacuumLeaves));
+            if (result != PREPARE_SUCCESS) {
+                return result;
+            }
+            if (statement->vacuumLeaves == 0 || lexerNext(&lexer, &extra)) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+        }
+        statement->cursor = NULL;
+        statement->numParams = 0;
+        statement->boundMask = 0;
+        statement->hasFilter = false;
+        return PREPARE_SUCCESS;
+    }
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+}
+
+/*
+ * Parameters are numbered from 1. A bound value stays in place
+ * until it is rebound or the bindings are cleared, so only the
+ * parameters that change between steps need to be bound again.
+ * Text is not copied here: it is read once, when the row is written
+ * into its leaf cell, or as the rows of a select are filtered, so the
+ * buffer must outlive the next step.
+ */
+BindResult statementBindInt(Statement *statement, uint32_t index, int64_t value) {
+    if (index < 1 || index > statement->numParams) {
+        return BIND_RANGE;
+    }
+    if (statement->paramColumns[index - 1] != COLUMN_ID) {
+        return BIND_TYPE_MISMATCH;
+    }
+    if (value < 0) {
+        return BIND_NEGATIVE_ID;
+    }
+    if (value > UINT32_MAX) {
+        return BIND_RANGE;
+    }
+
+    statement->rowToInsert.id = (uint32_t) value;
+    statement->boundMask |= 1u << (index - 1);
+    return BIND_SUCCESS;
+}
+
+BindResult statementBindText(Statement *statement, uint32_t index, const char *text, size_t length) {
+    if (index < 1 || index > statement->numParams) {
+        return BIND_RANGE;
+    }
+
+    Column column = statement->paramColumns[index - 1];
+    switch (column) {
+        case COLUMN_USERNAME:
+            if (length > COLUMN_USERNAME_SIZE) {
+                return BIND_STRING_TOO_LONG;
+            }
+            break;
+        case COLUMN_EMAIL:
+            if (length > COLUMN_EMAIL_SIZE) {
+                return BIND_STRING_TOO_LONG;
+            }
+            break;
+        default:
+            return BIND_TYPE_MISMATCH;
+    }
+
+    if (statement->type != STATEMENT_INSERT) {
+        statement->filter.value = text;
+        statement->filter.length = length;
+    } else if (column == COLUMN_USERNAME) {
+        statement->rowToInsert.username = text;
+        statement->rowToInsert.usernameLength = length;
+    } else {
+        statement->rowToInsert.email = text;
+        statement->rowToInsert.emailLength = length;
+    }
+
+    statement->boundMask |= 1u << (index - 1);
+    return BIND_SUCCESS;
+}
+
+void statementClearBindings(Statement *statement) {
+    statement->boundMask = 0;
+}
+
+ExecuteResult executeInsert(Statement *statement, Table *table) {
+    tableBeginWrite(table);
+    TableInsertResult result = tableInsert(table, &(statement->rowToInsert));
+    tableEndWrite(table);
+
+    switch (result) {
+        case TABLE_INSERT_DUPLICATE_KEY:
+            return EXECUTE_DUPLICATE_KEY;
+        case TABLE_INSERT_FULL:
+            return EXECUTE_TABLE_FULL;
+        default:
+            return EXECUTE_SUCCESS;
+    }
+}
+
+ExecuteResult executeSelect(Statement *statement, Table *table) {
+    statementReset(statement);
+    statement->startTime = statsNanoseconds();
+    statement->cursor = tableStartInArena(table, statement->arena);
+    if (statement->hasFilter) {
+        cursorSetFilter(statement->cursor, &(statement->filter));
+    }
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * Answered from the header, without a scan, unless there is a where
+ * clause; then the rows each leaf selects are counted, and none of them
+ * is read.
+ */
+ExecuteResult executeCount(Statement *statement, Table *table) {
+    if (!statement->hasFilter) {
+        statement->count = tableRowCount(table);
+        return EXECUTE_SUCCESS;
+    }
+    statementReset(statement);
+    Cursor *cursor = tableStartInArena(table, statement->arena);
+    cursorSetFilter(cursor, &(statement->filter));
+    statement->count = cursorCountFiltered(cursor);
+    cursorClose(cursor);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * A whole vacuum pass holds other writers off until it is done; a
+ * bounded step only for as long as it runs.
+ */
+ExecuteResult executeVacuum(Statement *statement, Table *table) {
+    tableBeginWrite(table);
+    tableVacuum(table, statement->vacuumLeaves, &(statement->vacuum));
+    tableEndWrite(table);
+    return EXECUTE_SUCCESS;
+}
+
+/*
+ * Fetch the next row of an executed select. Returns false, and
+ * releases the cursor, once the end of the table is reached.
+ */
+bool statementNextRow(Statement *statement, Row *row) {
+    Cursor *cursor = statement->cursor;
+    if (cursor == NULL) {
+        return false;
+    }
+    if (cursor->endOfTable) {
+        statementReset(statement);
+        return false;
+    }
+
+    cursorRow(cursor, row);
+    cursorAdvance(cursor);
+    return true;
+}
+
+/*
+ * Release the cursor of a select that was not read to the end, and
+ * everything else the execution allocated. Bindings are kept.
+ */
+void statementReset(Statement *statement) {
+    if (statement->cursor != NULL) {
+        statsRecordLatency(LATENCY_SCAN, statsNanoseconds() - statement->startTime);
+    }
+    cursorClose(statement->cursor);
+    statement->cursor = NULL;
+    if (statement->arena != NULL) {
+        arenaReset(statement->arena);
+    }
+}
+
+/*
+ * Run a prepared statement with its current bindings. The statement
+ * is not consumed, so it can be rebound and executed again without
+ * going back through prepareStatement. A select only positions its
+ * cursor; rows are then read with statementNextRow. A count leaves
+ * its result in the statement.
+ */
+ExecuteResult executeStatement(Statement *statement, Table *table) {
+    uint32_t allParams = (1u << statement->numParams) - 1;
+    if ((statement->boundMask & allParams) != allParams) {
+        return EXECUTE_UNBOUND_PARAMETER;
+    }
+
+    uint64_t start = statsNanoseconds();
+    ExecuteResult result = EXECUTE_SUCCESS;
+    switch (statement->type) {
+        case (STATEMENT_INSERT):
+            result = executeInsert(statement, table);
+            statsRecordLatency(LATENCY_INSERT, statsNanoseconds() - start);
+            break;
+        case (STATEMENT_SELECT):
+            // Recorded when the cursor is released
+            result = executeSelect(statement, table);
+            break;
+        case (STATEMENT_COUNT):
+            result = executeCount(statement, table);
+            statsRecordLatency(LATENCY_ROW_COUNT, statsNanoseconds() - start);
+            break;
+        case (STATEMENT_VACUUM):
+            result = executeVacuum(statement, table);
+            statsRecordLatency(LATENCY_VACUUM, statsNanoseconds() - start);
+            break;
+    }
+    return result;
+}
+
+SQLCloneResult prepareResultCode(PrepareResult result) {
+    switch (result) {
+        case PREPARE_SUCCESS:
+            return SQLCLONE_OK;
+        case PREPARE_NEGATIVE_ID:
+            return SQLCLONE_NEGATIVE_ID;
+        case PREPARE_ID_TOO_LARGE:
+            return SQLCLONE_ID_TOO_LARGE;
+        case PREPARE_STRING_TOO_LONG:
+            return SQLCLONE_STRING_TOO_LONG;
+        case PREPARE_SYNTAX_ERROR:
+            return SQLCLONE_SYNTAX_ERROR;
+        case PREPARE_UNRECOGNIZED_STATEMENT:
+            return SQLCLONE_UNRECOGNIZED_STATEMENT;
+    }
+    return SQLCLONE_SYNTAX_ERROR;
+}
+
+SQLCloneResult bindResultCode(BindResult result) {
+    switch (result) {
+        case BIND_SUCCESS:
+            return SQLCLONE_OK;
+        case BIND_RANGE:
+            return SQLCLONE_RANGE;
+        case BIND_TYPE_MISMATCH:
+            return SQLCLONE_TYPE_MISMATCH;
+        case BIND_NEGATIVE_ID:
+            return SQLCLONE_NEGATIVE_ID;
+        case BIND_STRING_TOO_LONG:
+            return SQLCLONE_STRING_TOO_LONG;
+    }
+    return SQLCLONE_RANGE;
+}
+
+SQLCloneResult executeResultCode(ExecuteResult result) {
+    switch (result) {
+        case EXECUTE_SUCCESS:
+            return SQLCLONE_DONE;
+        case EXECUTE_DUPLICATE_KEY:
+            return SQLCLONE_DUPLICATE_KEY;
+        case EXECUTE_TABLE_FULL:
+            return SQLCLONE_TABLE_FULL;
+        case EXECUTE_UNBOUND_PARAMETER:
+            return SQLCLONE_UNBOUND_PARAMETER;
+    }
+    return SQLCLONE_DONE;
+}
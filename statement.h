@@ -0,0 +1,120 @@
+#ifndef SQLCLONE_STATEMENT_H
+#define SQLCLONE_STATEMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "btree.h"
+#include "input.h"
+#include "library.h"
+#include "vacuum.h"
+
+typedef enum {
+    PREPARE_SUCCESS,
+    PREPARE_NEGATIVE_ID,
+    PREPARE_ID_TOO_LARGE,
+    PREPARE_STRING_TOO_LONG,
+    PREPARE_SYNTAX_ERROR,
+    PREPARE_UNRECOGNIZED_STATEMENT
+} PrepareResult;
+
+typedef enum {
+    STATEMENT_INSERT,
+    STATEMENT_SELECT,
+    STATEMENT_COUNT,
+    STATEMENT_VACUUM
+} StatementType;
+
+typedef enum {
+    EXECUTE_SUCCESS,
+    EXECUTE_DUPLICATE_KEY,
+    EXECUTE_TABLE_FULL,
+    EXECUTE_UNBOUND_PARAMETER
+} ExecuteResult;
+
+typedef enum {
+    BIND_SUCCESS,
+    BIND_RANGE,
+    BIND_TYPE_MISMATCH,
+    BIND_NEGATIVE_ID,
+    BIND_STRING_TOO_LONG
+} BindResult;
+
+#define STATEMENT_MAX_PARAMS 3
+
+/*
+ * A prepared statement is parsed once and can be executed many times.
+ * Fields written as '?' become parameters (numbered from 1, left to right)
+ * whose values are supplied through the bind functions before each step.
+ * Text fields point into the prepared input or the bound buffers, which
+ * must stay valid until the statement has been executed.
+ */
+typedef struct {
+    StatementType type;
+    RowView rowToInsert;
+    uint32_t numParams;
+    Column paramColumns[STATEMENT_MAX_PARAMS];
+    uint32_t boundMask;
+    // Where the temporaries of each execution go; reset with the statement
+    Arena *arena;
+    Cursor *cursor;
+    // When the select that opened the cursor was executed
+    uint64_t startTime;
+    // Result of a count, once executed
+    uint64_t count;
+    // Leaves a vacuum may visit, 0 for a whole pass, and what it did once executed
+    uint32_t vacuumLeaves;
+    VacuumStats vacuum;
+    // The where clause of a select or count, if it has one
+    bool hasFilter;
+    RowFilter filter;
+} Statement;
+
+typedef struct {
+    const char *start;
+    uint32_t length;
+} Token;
+
+/*
+ * Single pass, non-destructive lexer. Tokens are whitespace separated
+ * words that point back into the input buffer.
+ */
+typedef struct {
+    const char *position;
+    const char *end;
+} Lexer;
+
+void lexerInit(Lexer *lexer, const char *input, size_t length);
+
+bool lexerNext(Lexer *lexer, Token *token);
+
+PrepareResult parseId(Token *token, uint32_t *id);
+
+/*
+ * The arena, if given, belongs to the statement until it is reset and
+ * keeps allocations off the execution path; without one they come from
+ * malloc.
+ */
+PrepareResult prepareStatement(InputBuffer *inputBuffer, Statement *statement, Arena *arena);
+
+BindResult statementBindInt(Statement *statement, uint32_t index, int64_t value);
+
+BindResult statementBindText(Statement *statement, uint32_t index, const char *text, size_t length);
+
+void statementClearBindings(Statement *statement);
+
+ExecuteResult executeStatement(Statement *statement, Table *table);
+
+bool statementNextRow(Statement *statement, Row *row);
+
+void statementReset(Statement *statement);
+
+/* Translate engine results into the codes of the public interface. */
+SQLCloneResult prepareResultCode(PrepareResult result);
+
+SQLCloneResult bindResultCode(BindResult result);
+
+SQLCloneResult executeResultCode(ExecuteResult result);
+
+#endif //SQLCLONE_STATEMENT_H
@@ -0,0 +1,83 @@
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+const char *const STAT_NAMES[STAT_COUNT] = {
+        "CACHE_HITS",
+        "CACHE_MISSES",
+        "PAGES_READ",
+        "PAGES_WRITTEN",
+        "BYTES_READ",
+        "BYTES_WRITTEN",
+        "LEAF_SPLITS",
+        "INTERNAL_SPLITS",
+        "TREE_DESCENTS",
+        "BYTES_DESERIALIZED",
+        "CURSORS_OPENED",
+        "LEAVES_SKIPPED",
+};
+
+const char *const LATENCY_NAMES[LATENCY_KINDS] = {
+        "insert",
+        "point select",
+        "scan",
+        "count",
+        "vacuum",
+};
+
+_Thread_local StatsBlock *threadStats = NULL;
+
+pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+_Atomic(StatsBlock *) statsBlocks = NULL;
+
+StatsBlock *statsRegisterThread() {
+    StatsBlock *block = malloc(sizeof(StatsBlock));
+    if (block == NULL) {
+        printf("Out of memory for counters\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < STAT_COUNT; i++) {
+        atomic_init(&(block->counters[i]), 0);
+    }
+
+    pthread_mutex_lock(&statsLock);
+    block->next = atomic_load_explicit(&statsBlocks, memory_order_relaxed);
+    atomic_store_explicit(&statsBlocks, block, memory_order_release);
+    pthread_mutex_unlock(&statsLock);
+
+    threadStats = block;
+    return block;
+}
+
+void statsCollect(uint64_t totals[STAT_COUNT]) {
+    for (uint32_t i = 0; i < STAT_COUNT; i++) {
+        totals[i] = 0;
+    }
+    // Blocks are only ever pushed on the front, so the list can be walked without the lock.
+    for (StatsBlock *block = atomic_load_explicit(&statsBlocks, memory_order_acquire);
+         block != NULL; block = block->next) {
+        for (uint32_t i = 0; i < STAT_COUNT; i++) {
+            totals[i] += atomic_load_explicit(&(block->counters[i]), memory_order_relaxed);
+        }
+    }
+}
+
+// Zero is a valid empty histogram, so these need no initialization.
+Histogram statementLatencies[LATENCY_KINDS];
+
+uint64_t statsNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+void statsRecordLatency(LatencyKind kind, uint64_t nanoseconds) {
+    histogramRecord(&statementLatencies[kind], nanoseconds);
+}
+
+Histogram *statsLatency(LatencyKind kind) {
+    return &statementLatencies[kind];
+}
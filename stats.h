@@ -0,0 +1,78 @@
+#ifndef SQLCLONE_STATS_H
+#define SQLCLONE_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+/*
+ * Engine counters, cheap enough to leave on. Each thread counts into a
+ * block of its own with a plain load and store: no lock and no
+ * read-modify-write. A thread's block is registered the first time it
+ * counts anything, and reading the counters sums every block. Blocks
+ * outlive their threads, so nothing counted is lost.
+ */
+typedef enum {
+    STAT_CACHE_HITS,
+    STAT_CACHE_MISSES,
+    STAT_PAGES_READ,
+    STAT_PAGES_WRITTEN,
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_LEAF_SPLITS,
+    STAT_INTERNAL_SPLITS,
+    STAT_TREE_DESCENTS,
+    STAT_BYTES_DESERIALIZED,
+    STAT_CURSORS_OPENED,
+    // Leaves a filter passed over without looking at a cell
+    STAT_LEAVES_SKIPPED,
+    STAT_COUNT
+} Stat;
+
+extern const char *const STAT_NAMES[STAT_COUNT];
+
+typedef struct StatsBlock {
+    // Written only by the owning thread, read by anyone
+    _Atomic uint64_t counters[STAT_COUNT];
+    struct StatsBlock *next;
+} StatsBlock;
+
+extern _Thread_local StatsBlock *threadStats;
+
+StatsBlock *statsRegisterThread();
+
+#define STATS_ADD(stat, amount) do { \
+        StatsBlock *statsBlock = (threadStats != NULL) ? threadStats : statsRegisterThread(); \
+        uint64_t statsValue = atomic_load_explicit(&(statsBlock->counters[stat]), memory_order_relaxed); \
+        atomic_store_explicit(&(statsBlock->counters[stat]), statsValue + (amount), memory_order_relaxed); \
+    } while (0)
+
+/* Totals over all threads since the process started */
+void statsCollect(uint64_t totals[STAT_COUNT]);
+
+/*
+ * Latency of every statement, by kind, kept since the process started.
+ * A select is timed from execution until its cursor is released, so the
+ * time spent reading its rows counts; point selects are the key lookups
+ * of library cursors.
+ */
+typedef enum {
+    LATENCY_INSERT,
+    LATENCY_POINT_SELECT,
+    LATENCY_SCAN,
+    LATENCY_ROW_COUNT,
+    LATENCY_VACUUM,
+    LATENCY_KINDS
+} LatencyKind;
+
+extern const char *const LATENCY_NAMES[LATENCY_KINDS];
+
+/* Monotonic clock for timing statements */
+uint64_t statsNanoseconds();
+
+void statsRecordLatency(LatencyKind kind, uint64_t nanoseconds);
+
+Histogram *statsLatency(LatencyKind kind);
+
+#endif //SQLCLONE_STATS_H
@@ -0,0 +1,278 @@
+#include "vacuum.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    Table *table;
+    VacuumStats *stats;
+    // Copies of the nodes being moved, taken before either page changes
+    void *fromImage;
+    void *toImage;
+} Vacuum;
+
+/* The slot of the parent that points at the child: numKeys for the right child, UINT32_MAX for none */
+uint32_t vacuumChildIndex(void *parent, uint32_t childPageNum) {
+    uint32_t numKeys = *internalNodeNumKeys(parent);
+    for (uint32_t i = 0; i <= numKeys; i++) {
+        if (*internalNodeChild(parent, i) == childPageNum) {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+/* Where a page number points once the node on from has gone to to, and in a swap the other way round */
+uint32_t vacuumMapPage(uint32_t pageNum, uint32_t from, uint32_t to, bool swap) {
+    if (pageNum == from) {
+        return to;
+    }
+    if (swap && pageNum == to) {
+        return from;
+    }
+    return pageNum;
+}
+
+bool vacuumIsMoving(uint32_t pageNum, uint32_t from, uint32_t to, bool swap) {
+    return pageNum == from || (swap && pageNum == to);
+}
+
+/*
+ * Write a node image to its new page, with the page numbers it holds
+ * remapped, and point its children there. Children that are moving
+ * too get the right parent from their own image.
+ */
+void vacuumPlace(Vacuum *vacuum, void *image, uint32_t newPageNum, uint32_t from, uint32_t to, bool swap) {
+    Pager *pager = vacuum->table->pager;
+    void *node = pagerLatchExclusive(pager, newPageNum);
+    memcpy(node, image, vacuum->table->layout.pageSize);
+    *nodeParent(node) = vacuumMapPage(*nodeParent(image), from, to, swap);
+    bool internal = getNodeType(node) == NODE_INTERNAL;
+    if (internal) {
+        for (uint32_t i = 0; i <= *internalNodeNumKeys(node); i++) {
+            *internalNodeChild(node, i) = vacuumMapPage(*internalNodeChild(node, i), from, to, swap);
+        }
+    }
+    pagerUnlatchExclusive(pager, newPageNum);
+
+    if (!internal) {
+        return;
+    }
+    for (uint32_t i = 0; i <= *internalNodeNumKeys(image); i++) {
+        uint32_t childPageNum = *internalNodeChild(image, i);
+        if (!vacuumIsMoving(childPageNum, from, to, swap)) {
+            void *child = pagerLatchExclusive(pager, childPageNum);
+            *nodeParent(child) = newPageNum;
+            pagerUnlatchExclusive(pager, childPageNum);
+        }
+    }
+}
+
+/* Repoint a parent that is not moving itself at the new pages of its children. */
+void vacuumRepointParent(Vacuum *vacuum, uint32_t parentPageNum, uint32_t from, uint32_t to, bool swap) {
+    if (vacuumIsMoving(parentPageNum, from, to, swap)) {
+        return;
+    }
+    Pager *pager = vacuum->table->pager;
+    void *parent = pagerLatchExclusive(pager, parentPageNum);
+    for (uint32_t i = 0; i <= *internalNodeNumKeys(parent); i++) {
+        *internalNodeChild(parent, i) = vacuumMapPage(*internalNodeChild(parent, i), from, to, swap);
+    }
+    pagerUnlatchExclusive(pager, parentPageNum);
+}
+
+/*
+ * Move the node on from to the page to, whose old contents are no longer
+ * in the tree, or swap the nodes on the two pages. Neither may be the
+ * root. Every page that changes is latched, so snapshots keep seeing
+ * the nodes where they were.
+ */
+void vacuumRelocate(Vacuum *vacuum, uint32_t from, uint32_t to, bool swap) {
+    Pager *pager = vacuum->table->pager;
+    uint32_t pageSize = vacuum->table->layout.pageSize;
+    memcpy(vacuum->fromImage, getPage(pager, from), pageSize);
+    if (swap) {
+        memcpy(vacuum->toImage, getPage(pager, to), pageSize);
+    }
+
+    vacuumPlace(vacuum, vacuum->fromImage, to, from, to, swap);
+    uint32_t fromParent = *nodeParent(vacuum->fromImage);
+    vacuumRepointParent(vacuum, fromParent, from, to, swap);
+    if (swap) {
+        vacuumPlace(vacuum, vacuum->toImage, from, from, to, swap);
+        // Siblings share a parent, which must only be remapped once.
+        uint32_t toParent = *nodeParent(vacuum->toImage);
+        if (toParent != fromParent) {
+            vacuumRepointParent(vacuum, toParent, from, to, swap);
+        }
+    }
+    vacuum->stats->pagesMoved += swap ? 2 : 1;
+}
+
+/* Whether the tree points at the page; anything else at the end of the file is left over. */
+bool vacuumInTree(Table *table, uint32_t pageNum) {
+    if (pageNum == table->rootPageNum) {
+        return true;
+    }
+    Pager *pager = table->pager;
+    uint32_t parentPageNum = *nodeParent(getPage(pager, pageNum));
+    if (parentPageNum == 0 || parentPageNum >= atomic_load(&(pager->numPages))) {
+        return false;
+    }
+    void *parent = getPage(pager, parentPageNum);
+    return getNodeType(parent) == NODE_INTERNAL &&
+           *internalNodeNumKeys(parent) <= table->layout.internalNodeMaxCells &&
+           vacuumChildIndex(parent, pageNum) != UINT32_MAX;
+}
+
+/*
+ * Give up a page nothing in the tree points to any more: move the node
+ * on the last page into it and cut the file by one. Returns the page
+ * the node now on pageNum came from.
+ */
+uint32_t vacuumFreePage(Vacuum *vacuum, uint32_t pageNum) {
+    Table *table = vacuum->table;
+    Pager *pager = table->pager;
+    vacuum->stats->pagesFreed++;
+    while (true) {
+        uint32_t last = atomic_load(&(pager->numPages)) - 1;
+        if (last == pageNum) {
+            pagerTruncate(pager, last);
+            return pageNum;
+        }
+        if (last == table->rootPageNum) {
+            // Only in files whose root is not page 1: leave the page empty.
+            return pageNum;
+        }
+        if (vacuumInTree(table, last)) {
+            vacuumRelocate(vacuum, last, pageNum, false);
+            pagerTruncate(pager, last);
+            return last;
+        }
+        pagerTruncate(pager, last);
+    }
+}
+
+/*
+ * Fill the leaf with cells from its right siblings under the same
+ * parent, freeing every sibling it empties. The parent's key for the
+ * leaf follows, and the parent's own maximum does not change. Returns
+ * the leaf's page, which moves if the leaf was on the last page.
+ */
+uint32_t vacuumFillLeaf(Vacuum *vacuum, uint32_t pageNum) {
+    Table *table = vacuum->table;
+    Pager *pager = table->pager;
+    while (true) {
+        void *leaf = getPage(pager, pageNum);
+        uint32_t numCells = *leafNodeNumCells(leaf);
+        uint32_t parentPageNum = *nodeParent(leaf);
+        void *parent = getPage(pager, parentPageNum);
+        uint32_t numKeys = *internalNodeNumKeys(parent);
+        uint32_t index = vacuumChildIndex(parent, pageNum);
+        if (index >= numKeys) {
+            return pageNum;
+        }
+
+        uint32_t siblingPageNum = *internalNodeChild(parent, index + 1);
+        void *sibling = getPage(pager, siblingPageNum);
+        uint32_t siblingCells = *leafNodeNumCells(sibling);
+        RowView first;
+        if (siblingCells > 0) {
+            leafNodeView(sibling, 0, &first);
+            if (!leafNodeHasRoom(table, leaf, &first)) {
+                return pageNum;
+            }
+        }
+
+        leaf = pagerLatchExclusive(pager, pageNum);
+        uint32_t moved = leafNodeAppendCells(table, leaf, sibling);
+        pagerUnlatchExclusive(pager, pageNum);
+
+        sibling = pagerLatchExclusive(pager, siblingPageNum);
+        leafNodeRemoveFirstCells(table, sibling, moved);
+        pagerUnlatchExclusive(pager, siblingPageNum);
+
+        parent = pagerLatchExclusive(pager, parentPageNum);
+        if (moved < siblingCells) {
+            *internalNodeKey(parent, index) = *leafNodeKey(leaf, numCells + moved - 1);
+        } else if (index + 1 == numKeys) {
+            // The sibling was the right child: the leaf takes its place.
+            *internalNodeRightChild(parent) = pageNum;
+            *internalNodeNumKeys(parent) = numKeys - 1;
+        } else {
+            *internalNodeKey(parent, index) = *internalNodeKey(parent, index + 1);
+            memmove(internalNodeCell(parent, index + 1), internalNodeCell(parent, index + 2),
+                    (char *) internalNodeCell(parent, numKeys) - (char *) internalNodeCell(parent, index + 2));
+            *internalNodeNumKeys(parent) = numKeys - 1;
+        }
+        pagerUnlatchExclusive(pager, parentPageNum);
+
+        if (moved == siblingCells && vacuumFreePage(vacuum, siblingPageNum) == pageNum) {
+            pageNum = siblingPageNum;
+        }
+    }
+}
+
+void tableVacuum(Table *table, uint32_t maxLeaves, VacuumStats *stats) {
+    memset(stats, 0, sizeof(VacuumStats));
+    Pager *pager = table->pager;
+    if (maxLeaves == 0 || !table->vacuumRunning) {
+        table->vacuumRunning = true;
+        table->vacuumNextKey = 0;
+        table->vacuumNextPage = 1;
+    }
+
+    Vacuum vacuum = {table, stats, malloc(table->layout.pageSize), malloc(table->layout.pageSize)};
+    if (vacuum.fromImage == NULL || vacuum.toImage == NULL) {
+        printf("Out of memory for vacuum\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (maxLeaves == 0 || stats->leavesVisited < maxLeaves) {
+        if (table->vacuumNextPage == table->rootPageNum) {
+            table->vacuumNextPage++;
+        }
+        uint32_t pageNum = tableFindLeaf(table, table->vacuumNextKey);
+        void *leaf = getPage(pager, pageNum);
+        uint32_t numCells = *leafNodeNumCells(leaf);
+        // Past the last key, the search ends on the leaf placed last.
+        if (pageNum == table->rootPageNum || numCells == 0 ||
+            *leafNodeKey(leaf, numCells - 1) < table->vacuumNextKey) {
+            stats->passComplete = true;
+            break;
+        }
+
+        // Leaves before the next page are in place already, though rows may have been added to them since.
+        if (pageNum >= table->vacuumNextPage) {
+            pagerWriteBegin(pager);
+            pageNum = vacuumFillLeaf(&vacuum, pageNum);
+            uint32_t target = table->vacuumNextPage;
+            if (pageNum != target && vacuumInTree(table, target)) {
+                vacuumRelocate(&vacuum, pageNum, target, true);
+            } else if (pageNum != target) {
+                // Whatever was left over on the target goes, and so does the leaf's old page.
+                vacuumRelocate(&vacuum, pageNum, target, false);
+                vacuumFreePage(&vacuum, pageNum);
+            }
+            pageNum = target;
+            table->vacuumNextPage++;
+            pagerWriteCommit(pager);
+        }
+        stats->leavesVisited++;
+
+        leaf = getPage(pager, pageNum);
+        uint32_t lastKey = *leafNodeKey(leaf, *leafNodeNumCells(leaf) - 1);
+        if (lastKey == UINT32_MAX) {
+            stats->passComplete = true;
+            break;
+        }
+        table->vacuumNextKey = lastKey + 1;
+    }
+    if (stats->passComplete) {
+        table->vacuumRunning = false;
+    }
+
+    free(vacuum.fromImage);
+    free(vacuum.toImage);
+}
@@ -0,0 +1,40 @@
+#ifndef SQLCLONE_VACUUM_H
+#define SQLCLONE_VACUUM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+/*
+ * A vacuum pass walks the leaves in key order. Each leaf is first
+ * filled up with cells from the leaves to its right under the same
+ * parent, and then moved to the next page after those already placed,
+ * swapping with whatever node was there. At the end of a pass the
+ * leaves follow the root in key order, the internal nodes come after
+ * them, and the file is as short as the tree allows.
+ *
+ * A page a leaf is emptied out of is filled with the node from the last
+ * page of the file, and the file is cut by one, so the file never has
+ * holes and there is no free list to keep.
+ *
+ * Every leaf is its own commit, so readers, and writers in between
+ * steps, carry on as usual; rows added behind the pass are simply left
+ * where they land until the next one.
+ */
+typedef struct {
+    uint32_t leavesVisited;
+    uint32_t pagesMoved;
+    uint32_t pagesFreed;
+    // The pass reached the end of the table and the next one starts over.
+    bool passComplete;
+} VacuumStats;
+
+/*
+ * Carry the current pass on for at most maxLeaves leaves, starting one
+ * if there is none; with maxLeaves 0, run a whole pass from the start.
+ * For the writer, between tableBeginWrite and tableEndWrite.
+ */
+void tableVacuum(Table *table, uint32_t maxLeaves, VacuumStats *stats);
+
+#endif //SQLCLONE_VACUUM_H